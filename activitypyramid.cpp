@@ -0,0 +1,80 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+
+#include "activitypyramid.h"
+
+
+namespace WaylandDebug {
+
+void ActivityPyramid::clear()
+{
+    *this = ActivityPyramid();
+}
+
+void ActivityPyramid::build(const MessageStore &store, const QList<int> &ordinals)
+{
+    clear();
+    if (store.isEmpty())
+        return;
+
+    // the whole log, so the time line does not jump around when the filter changes
+    const auto [min, max] = std::minmax_element(store.m_time.cbegin(), store.m_time.cend());
+    m_timeMin = *min;
+    m_timeMax = *max;
+    const quint64 span = m_timeMax - m_timeMin + 1;
+    m_baseWidth = std::max<quint64>(1, (span + BaseBuckets - 1) / BaseBuckets);
+
+    QList<Bucket> base(qsizetype((span + m_baseWidth - 1) / m_baseWidth));
+    for (int o : ordinals) {
+        Bucket &bucket = base[qsizetype((store.m_time.at(o) - m_timeMin) / m_baseWidth)];
+        if (store.m_direction.at(o) == Direction::ToCompositor)
+            ++bucket.m_requests;
+        else
+            ++bucket.m_events;
+    }
+    m_levels.append(base);
+
+    while (m_levels.constLast().size() > 1) {
+        const QList<Bucket> &below = m_levels.constLast();
+        QList<Bucket> above((below.size() + 1) / 2);
+        for (qsizetype i = 0; i < below.size(); ++i) {
+            above[i / 2].m_requests += below.at(i).m_requests;
+            above[i / 2].m_events += below.at(i).m_events;
+        }
+        m_levels.append(above);
+    }
+}
+
+QList<ActivityPyramid::Bucket> ActivityPyramid::query(quint64 from, quint64 to, int count) const
+{
+    QList<Bucket> bins(std::max(count, 0));
+    if (isEmpty() || (count <= 0) || (to <= from))
+        return bins;
+
+    // zoomed in further than level 0 goes, every bucket still only ends up in one bin
+    const quint64 binWidth = (to - from) / quint64(count);
+    int level = 0;
+    while ((level + 1 < levelCount()) && (bucketWidth(level + 1) <= binWidth))
+        ++level;
+
+    const QList<Bucket> &buckets = m_levels.at(level);
+    const quint64 width = bucketWidth(level);
+    const qsizetype first = (from > m_timeMin) ? qsizetype((from - m_timeMin) / width) : 0;
+    const qsizetype last = (to > m_timeMin) ? std::min(buckets.size(), qsizetype((to - m_timeMin - 1) / width) + 1) : 0;
+    const double scale = double(count) / double(to - from);
+
+    for (qsizetype b = first; b < last; ++b) {
+        const Bucket &bucket = buckets.at(b);
+        if (!bucket.total())
+            continue;
+        const quint64 middle = std::clamp(m_timeMin + quint64(b) * width + width / 2, from, to - 1);
+        Bucket &bin = bins[std::min(count - 1, int(double(middle - from) * scale))];
+        bin.m_requests += bucket.m_requests;
+        bin.m_events += bucket.m_events;
+    }
+    return bins;
+}
+
+} // namespace WaylandDebug
@@ -0,0 +1,50 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QList>
+
+#include "waylanddebug.h"
+
+namespace WaylandDebug {
+
+// Message counts over time, split by direction. Level 0 cuts the time span of the log into
+// BaseBuckets equal buckets, every level above merges two buckets of the one below. Any view
+// of the time line is then answered from the coarsest level that still has at least one bucket
+// per bin, without looking at the messages again: the cost depends on the size of the view,
+// not on the size of the log.
+class ActivityPyramid
+{
+public:
+    struct Bucket
+    {
+        quint32 m_requests = 0; // to the compositor
+        quint32 m_events = 0;   // from the compositor and unknown
+
+        quint32 total() const { return m_requests + m_events; }
+    };
+
+    static constexpr qsizetype BaseBuckets = 1 << 18;
+
+    void clear();
+    // counts the given rows of the store, the time span is the one of the whole store
+    void build(const MessageStore &store, const QList<int> &ordinals);
+
+    bool isEmpty() const { return m_levels.isEmpty(); }
+    quint64 timeMin() const { return m_timeMin; }
+    quint64 timeMax() const { return m_timeMax; }
+    int levelCount() const { return int(m_levels.size()); }
+    quint64 bucketWidth(int level) const { return m_baseWidth << level; }
+
+    // the counts in [from, to) split into count equally wide bins
+    QList<Bucket> query(quint64 from, quint64 to, int count) const;
+
+private:
+    quint64 m_timeMin = 0;
+    quint64 m_timeMax = 0;
+    quint64 m_baseWidth = 1; // in µs
+    QList<QList<Bucket>> m_levels;
+};
+
+} // namespace WaylandDebug
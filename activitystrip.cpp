@@ -0,0 +1,208 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QTimer>
+#include <QToolTip>
+#include <QWheelEvent>
+
+#include "activitystrip.h"
+
+
+using namespace Qt::StringLiterals;
+
+namespace {
+
+// same format as the time column
+QString formatTime(quint64 t)
+{
+    return u"%1'%2.%3"_s
+        .arg(t / 1000 / 1000)
+        .arg(t / 1000 % 1000, 3, 10, QChar('0'))
+        .arg(t % 1000, 3, 10, QChar('0'));
+}
+
+const QColor RequestColor(0x3f, 0x7f, 0xbf);
+const QColor EventColor(0xbf, 0x7f, 0x3f);
+
+} // namespace
+
+ActivityStrip::ActivityStrip(QWidget *parent)
+    : QWidget(parent)
+    , m_rebuildTimer(new QTimer(this))
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    setMouseTracking(true);
+
+    // rows come in batches while loading and filtering: count them at most four times a second
+    m_rebuildTimer->setSingleShot(true);
+    m_rebuildTimer->setInterval(250);
+    connect(m_rebuildTimer, &QTimer::timeout, this, &ActivityStrip::rebuild);
+}
+
+void ActivityStrip::setModel(const WaylandDebug::Model *model)
+{
+    m_model = model;
+    m_viewFrom = m_viewTo = 0;
+    m_pyramid.clear();
+    if (model) {
+        auto schedule = [this]() {
+            if (!m_rebuildTimer->isActive())
+                m_rebuildTimer->start();
+        };
+        connect(model, &QAbstractItemModel::modelReset, this, schedule);
+        connect(model, &QAbstractItemModel::rowsInserted, this, schedule);
+        connect(model, &QAbstractItemModel::rowsRemoved, this, schedule);
+        connect(model, &QAbstractItemModel::layoutChanged, this, schedule);
+    }
+    update();
+}
+
+QSize ActivityStrip::sizeHint() const
+{
+    return { 400, fontMetrics().height() * 3 };
+}
+
+void ActivityStrip::rebuild()
+{
+    if (m_model)
+        m_pyramid.build(m_model->messages(), m_model->visibleOrdinals());
+    else
+        m_pyramid.clear();
+    update();
+}
+
+std::pair<quint64, quint64> ActivityStrip::viewRange() const
+{
+    if (!m_viewFrom && !m_viewTo)
+        return { m_pyramid.timeMin(), m_pyramid.timeMax() + 1 };
+    return { m_viewFrom, m_viewTo };
+}
+
+void ActivityStrip::setViewRange(quint64 from, quint64 to)
+{
+    // at least a µs per pixel, and never outside of the log
+    const quint64 min = m_pyramid.timeMin();
+    const quint64 max = m_pyramid.timeMax() + 1;
+    const quint64 span = std::clamp<quint64>(to - from, std::min<quint64>(width(), max - min), max - min);
+    from = std::clamp(from, min, max - span);
+    to = from + span;
+    if ((from == min) && (to == max))
+        m_viewFrom = m_viewTo = 0;
+    else
+        std::tie(m_viewFrom, m_viewTo) = std::tie(from, to);
+    update();
+}
+
+quint64 ActivityStrip::timeAt(double x) const
+{
+    const auto [from, to] = viewRange();
+    x = std::clamp(x, 0.0, double(width()));
+    return from + quint64(double(to - from) * x / std::max(1, width()));
+}
+
+void ActivityStrip::paintEvent(QPaintEvent *)
+{
+    QPainter p(this);
+    p.fillRect(rect(), palette().base());
+    if (m_pyramid.isEmpty())
+        return;
+
+    const auto [from, to] = viewRange();
+    const auto bins = m_pyramid.query(from, to, width());
+    quint32 peak = 0;
+    for (const auto &bin : bins)
+        peak = std::max(peak, bin.total());
+
+    const int h = height() - fontMetrics().height();
+    if (peak) {
+        for (int x = 0; x < bins.size(); ++x) {
+            const auto &bin = bins.at(x);
+            if (!bin.total())
+                continue;
+            // a single message still gets a pixel
+            const int total = std::max(1, int(std::lround(double(bin.total()) * h / peak)));
+            const int requests = int(std::lround(double(total) * bin.m_requests / bin.total()));
+            p.fillRect(x, h - requests, 1, requests, RequestColor);
+            p.fillRect(x, h - total, 1, total - requests, EventColor);
+        }
+    }
+
+    p.setPen(palette().color(QPalette::Text));
+    const QRect labels(2, h, width() - 4, fontMetrics().height());
+    p.drawText(labels, Qt::AlignLeft | Qt::AlignVCenter, formatTime(from));
+    p.drawText(labels, Qt::AlignRight | Qt::AlignVCenter, formatTime(to));
+    p.drawText(labels, Qt::AlignHCenter | Qt::AlignVCenter,
+               tr("peak: %n message(s) per %1 µs", nullptr, int(peak)).arg((to - from) / std::max(1, width())));
+}
+
+void ActivityStrip::wheelEvent(QWheelEvent *event)
+{
+    if (m_pyramid.isEmpty())
+        return;
+    const auto [from, to] = viewRange();
+    const double factor = std::pow(0.8, event->angleDelta().y() / 120.0);
+    const double x = event->position().x() / std::max(1, width());
+    const quint64 center = timeAt(event->position().x());
+    const auto span = quint64(std::max(1.0, double(to - from) * factor));
+    const auto left = quint64(double(span) * x);
+    setViewRange((center > left) ? center - left : 0, ((center > left) ? center - left : 0) + span);
+    event->accept();
+}
+
+void ActivityStrip::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QWidget::mousePressEvent(event);
+    m_pressX = int(event->position().x());
+    m_pressRange = viewRange();
+    m_dragged = false;
+}
+
+void ActivityStrip::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_pyramid.isEmpty())
+        return;
+    const int x = int(event->position().x());
+    if ((m_pressX >= 0) && (event->buttons() & Qt::LeftButton)) {
+        if (std::abs(x - m_pressX) > 3)
+            m_dragged = true;
+        if (m_dragged) {
+            const auto [from, to] = m_pressRange;
+            const double shift = double(to - from) * (m_pressX - x) / std::max(1, width());
+            const auto newFrom = quint64(std::max(0.0, double(from) + shift));
+            setViewRange(newFrom, newFrom + (to - from));
+        }
+        return;
+    }
+
+    const quint64 binFrom = timeAt(x);
+    const quint64 binTo = timeAt(x + 1);
+    const auto bin = m_pyramid.query(binFrom, std::max(binTo, binFrom + 1), 1).value(0);
+    QToolTip::showText(event->globalPosition().toPoint(),
+                       tr("%1 – %2\n%3 request(s), %4 event(s)")
+                           .arg(formatTime(binFrom), formatTime(binTo))
+                           .arg(bin.m_requests).arg(bin.m_events), this);
+}
+
+void ActivityStrip::mouseReleaseEvent(QMouseEvent *event)
+{
+    if ((event->button() != Qt::LeftButton) || (m_pressX < 0))
+        return QWidget::mouseReleaseEvent(event);
+    const int x = int(event->position().x());
+    if (!m_dragged && !m_pyramid.isEmpty())
+        emit timeRangeActivated(timeAt(x), std::max(timeAt(x + 1), timeAt(x) + 1) - 1);
+    m_pressX = -1;
+    m_dragged = false;
+}
+
+void ActivityStrip::mouseDoubleClickEvent(QMouseEvent *)
+{
+    m_viewFrom = m_viewTo = 0;
+    update();
+}
@@ -0,0 +1,50 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QWidget>
+
+#include "activitypyramid.h"
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+// The message rate over time of the visible rows, requests at the bottom and events stacked on
+// top. The wheel zooms around the mouse, dragging pans and a double click shows everything
+// again. Clicking a bar asks for its time range.
+class ActivityStrip : public QWidget
+{
+    Q_OBJECT
+
+public:
+    ActivityStrip(QWidget *parent = nullptr);
+
+    void setModel(const WaylandDebug::Model *model);
+    QSize sizeHint() const override;
+
+signals:
+    void timeRangeActivated(quint64 from, quint64 to);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    void rebuild();
+    std::pair<quint64, quint64> viewRange() const;
+    void setViewRange(quint64 from, quint64 to);
+    quint64 timeAt(double x) const;
+
+    const WaylandDebug::Model *m_model = nullptr;
+    WaylandDebug::ActivityPyramid m_pyramid;
+    QTimer *m_rebuildTimer;
+    quint64 m_viewFrom = 0; // both 0: the whole log
+    quint64 m_viewTo = 0;
+    int m_pressX = -1;
+    std::pair<quint64, quint64> m_pressRange;
+    bool m_dragged = false;
+};
@@ -0,0 +1,18 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QColor>
+#include <QMetaType>
+
+// What a model returns for the tint role of the ExtendedDelegate: the cell background gets mixed
+// with m_color, either across the whole cell or as a bar of m_width (0 .. 1) from the left.
+class BackgroundTint
+{
+public:
+    QColor m_color;
+    double m_width = 1;
+};
+
+Q_DECLARE_METATYPE(BackgroundTint)
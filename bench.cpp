@@ -0,0 +1,470 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTemporaryFile>
+
+#include "waylanddebug.h"
+#include "exception.h"
+#include "perfcounters.h"
+
+using namespace Qt::StringLiterals;
+using namespace WaylandDebug;
+
+
+namespace {
+
+struct Scenario
+{
+    const char *m_name;
+    qint64 m_messages = 1'000'000;
+    int m_connections = 1;
+    double m_churn = 0.05;  // share of the messages that create or destroy a surface
+    int m_liveObjects = 100; // surfaces per connection, once warmed up
+};
+
+// Writes a WAYLAND_DEBUG log as it would come out of one or more clients: surfaces get created
+// and destroyed (with the ids libwayland would reuse), everything else is attach, damage and
+// commit on a live surface plus the matching buffer releases. The same seed gives the same log.
+class Generator
+{
+public:
+    Generator(const Scenario &scenario, quint32 seed)
+        : m_scenario(scenario)
+        , m_random(seed)
+    {
+        m_clients.resize(std::max(1, scenario.m_connections));
+    }
+
+    qint64 write(QIODevice *device)
+    {
+        // the warm up, so the registry holds m_liveObjects right from the start
+        for (int c = 0; c < m_clients.size(); ++c) {
+            line(c, true, "wl_display#1.get_registry(new id wl_registry#2)"_ba);
+            line(c, false, "wl_registry#2.global(1, \"wl_compositor\", 6)"_ba);
+            line(c, true, "wl_registry#2.bind(1, \"wl_compositor\", 6, new id wl_compositor#3)"_ba);
+            line(c, false, "wl_registry#2.global(2, \"wl_shm\", 1)"_ba);
+            line(c, true, "wl_registry#2.bind(2, \"wl_shm\", 1, new id wl_shm#4)"_ba);
+            line(c, true, "wl_shm#4.create_pool(new id wl_shm_pool#5, fd 7, 4096)"_ba);
+            line(c, true, "wl_shm_pool#5.create_buffer(new id wl_buffer#6, 0, 32, 32, 128, 0)"_ba);
+            m_clients[c].m_nextId = 7;
+        }
+        for (int c = 0; c < m_clients.size(); ++c) {
+            for (int i = 0; i < m_scenario.m_liveObjects; ++i)
+                create(c);
+        }
+
+        while (m_lines < m_scenario.m_messages) {
+            const int c = int(m_random.bounded(qint64(m_clients.size())));
+            Client &client = m_clients[c];
+            if (client.m_surfaces.isEmpty() || (m_random.generateDouble() < m_scenario.m_churn)) {
+                // keep the number of live surfaces around the target
+                if (client.m_surfaces.size() <= qsizetype(m_scenario.m_liveObjects) && m_random.bounded(2))
+                    create(c);
+                else if (!client.m_surfaces.isEmpty())
+                    destroy(c);
+                else
+                    create(c);
+            } else {
+                const QByteArray surface = "wl_surface#"_ba
+                    + QByteArray::number(client.m_surfaces.at(m_random.bounded(client.m_surfaces.size())));
+                switch (m_random.bounded(4)) {
+                case 0:
+                    line(c, true, surface + ".attach(wl_buffer#6, 0, 0)"_ba);
+                    break;
+                case 1:
+                    line(c, true, surface + ".damage_buffer(0, 0, "_ba + QByteArray::number(m_random.bounded(1, 4096))
+                                      + ", "_ba + QByteArray::number(m_random.bounded(1, 4096)) + ')');
+                    break;
+                case 2:
+                    line(c, true, surface + ".commit()"_ba);
+                    break;
+                default:
+                    line(c, false, "wl_buffer#6.release()"_ba);
+                    break;
+                }
+            }
+            if (m_buffer.size() >= 1024 * 1024)
+                flush(device);
+        }
+        flush(device);
+        return m_lines;
+    }
+
+private:
+    struct Client
+    {
+        QList<uint> m_surfaces;
+        QList<uint> m_freeIds; // libwayland hands out the most recently freed id first
+        uint m_nextId = 1;
+    };
+
+    void line(int connection, bool request, QByteArrayView call)
+    {
+        m_time += quint64(m_random.bounded(1, 200));
+        if (m_clients.size() > 1)
+            m_buffer.append("<client-"_ba).append(QByteArray::number(connection)).append("> "_ba);
+        m_buffer.append('[').append(QByteArray::number(m_time / 1000).rightJustified(7, ' ')).append('.')
+            .append(QByteArray::number(m_time % 1000).rightJustified(3, '0')).append("] "_ba);
+        m_buffer.append(request ? " -> "_ba : " "_ba).append(call).append('\n');
+        ++m_lines;
+    }
+
+    void create(int c)
+    {
+        Client &client = m_clients[c];
+        const uint id = client.m_freeIds.isEmpty() ? client.m_nextId++ : client.m_freeIds.takeLast();
+        client.m_surfaces.append(id);
+        line(c, true, "wl_compositor#3.create_surface(new id wl_surface#"_ba + QByteArray::number(id) + ')');
+    }
+
+    void destroy(int c)
+    {
+        Client &client = m_clients[c];
+        const qsizetype i = m_random.bounded(client.m_surfaces.size());
+        const uint id = client.m_surfaces.at(i);
+        client.m_surfaces.swapItemsAt(i, client.m_surfaces.size() - 1);
+        client.m_surfaces.removeLast();
+        line(c, true, "wl_surface#"_ba + QByteArray::number(id) + ".destroy()"_ba);
+        line(c, false, "wl_display#1.delete_id("_ba + QByteArray::number(id) + ')');
+        client.m_freeIds.append(id);
+    }
+
+    void flush(QIODevice *device)
+    {
+        if (device->write(m_buffer) != m_buffer.size())
+            throw Exception("could not write the log: %1").arg(device->errorString());
+        m_buffer.clear();
+    }
+
+    const Scenario m_scenario;
+    QRandomGenerator m_random;
+    QList<Client> m_clients;
+    QByteArray m_buffer;
+    quint64 m_time = 1'000'000;
+    qint64 m_lines = 0;
+};
+
+double seconds(qint64 nsecs)
+{
+    return double(nsecs) / 1e9;
+}
+
+void report(const char *step, qint64 nsecs, const QByteArray &detail = { })
+{
+    std::printf("  %-24s %10.3f ms  %s\n", step, double(nsecs) / 1e6, detail.constData());
+}
+
+// filtering finishes in the background
+void waitForFilter(Model &model)
+{
+    if (!model.isFiltering())
+        return;
+    QEventLoop loop;
+    QObject::connect(&model, &Model::filteringChanged, &loop, [&loop](bool running) {
+        if (!running)
+            loop.quit();
+    });
+    loop.exec();
+}
+
+void run(const Scenario &scenario, quint32 seed)
+{
+    std::printf("%s: %lld messages, %d connection(s), churn %.2f, %d live surface(s) per connection\n",
+                scenario.m_name, static_cast<long long>(scenario.m_messages), scenario.m_connections,
+                scenario.m_churn, scenario.m_liveObjects);
+    PerfCounters::reset();
+
+    QTemporaryFile log;
+    if (!log.open())
+        throw Exception("could not create a temporary file: %1").arg(log.errorString());
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 lines = Generator(scenario, seed).write(&log);
+    log.close();
+    const qint64 bytes = log.size();
+    report("generate", timer.nsecsElapsed(), QByteArray::number(lines) + " lines, "_ba
+                                                 + QByteArray::number(double(bytes) / 1e6, 'f', 1) + " MB"_ba);
+
+    // the parser on its own, the batches are dropped right away
+    timer.restart();
+    {
+        Parser parser(log.fileName());
+        parser.parse([](const Parser::Batch &) { });
+    }
+    const qint64 parseTime = timer.nsecsElapsed();
+    report("parse", parseTime, QByteArray::number(double(lines) / seconds(parseTime), 'f', 0) + " lines/s, "_ba
+                                   + QByteArray::number(double(bytes) / 1e6 / seconds(parseTime), 'f', 1) + " MB/s"_ba);
+
+    // the same as the Loader does, without the queued signals in between
+    Model model;
+    timer.restart();
+    {
+        Parser parser(log.fileName());
+        parser.parse([&model](const Parser::Batch &batch) {
+            model.appendMessages(batch.m_messages, batch.m_newAtoms);
+        });
+        model.finishLoading();
+    }
+    report("parse into model", timer.nsecsElapsed(),
+           QByteArray::number(model.messages().size()) + " messages"_ba);
+
+    auto filter = [&model](const char *step, Filter *f) {
+        QElapsedTimer timer;
+        timer.start();
+        model.setFilter(f);
+        waitForFilter(model);
+        report(step, timer.nsecsElapsed(), QByteArray::number(model.rowCount({ })) + " rows"_ba);
+    };
+    auto *commits = new Filter;
+    commits->m_classMatch = { u"wl_surface"_s };
+    commits->m_methodMatch = { u"commit"_s };
+    filter("filter class+method", commits);
+    auto *requests = new Filter;
+    requests->m_directionMatch = Direction::ToCompositor;
+    requests->m_argumentMatch = { u"0"_s };
+    filter("filter argument", requests);
+    filter("filter none", nullptr);
+
+    for (int column = 0; column < Model::Count; ++column) {
+        timer.restart();
+        model.sort(column, Qt::AscendingOrder);
+        const QByteArray name = "sort "_ba + model.headerData(column, Qt::Horizontal, Qt::DisplayRole).toString().toUtf8();
+        report(name.constData(), timer.nsecsElapsed());
+    }
+    model.sort(Model::Time, Qt::AscendingOrder);
+
+    for (int counter = 0; counter < PerfCounters::CounterCount; ++counter) {
+        const auto c = PerfCounters::Counter(counter);
+        std::printf("  counter %-16s %10.3f ms in %lld call(s)\n", qPrintable(PerfCounters::name(c)),
+                    double(PerfCounters::total(c)) / 1e6, static_cast<long long>(PerfCounters::count(c)));
+    }
+    std::printf("  peak RSS %.1f MB\n\n", double(PerfCounters::peakResidentSize()) / 1e6);
+}
+
+// lines both tokenizers have to agree on: the usual forms, the corners of the grammar and
+// lines that are almost, but not quite valid
+const char *tokenizerCorpus[] = {
+    "[1234567.890]  -> wl_surface#12.commit()",
+    "[      0.001] wl_display#1.delete_id(3)",
+    "[3829671.352] {Default Queue}  -> wl_registry#2.bind(1, \"wl_compositor\", 6, new id wl_compositor#3)",
+    "[3829671.352] {Display Queue} wl_callback#27.done(123456)",
+    "<client-1> [12.345]  -> wl_surface#5.attach(wl_buffer#6, 0, 0)",
+    "<wl_display#0x5581> [12.345] wl_buffer@6.release()",
+    "[12.345]  -> xdg_wm_base#9.get_xdg_surface(new id xdg_surface#10, wl_surface#5)",
+    "[12.345]  -> wl_surface#5.attach(nil, 0, 0)",
+    "[12.345]  -> wl_surface@5.attach(wl_buffer@6, 0, 0)",
+    "[12.345]  -> wl_compositor@3.create_surface(new id wl_surface@5)",
+    "[12.345] wl_keyboard#14.keymap(1, fd 31, 65276)",
+    "[12.345] wl_pointer#15.axis(5.4, 1, -10.00000000)",
+    "[12.345]  -> wl_surface#5.damage(0, 0, 2147483647, 2147483647)",
+    "[12.345] xdg_toplevel#11.configure(0, 0, array[8])",
+    "[12.345] wl_data_offer#30.offer(\"text/plain;charset=utf-8\")",
+    "[12.345] wl_seat#7.name(\"seat(0)\")",
+    "[12.345]  -> wl_surface#5.set_buffer_scale(2)) trailing)",
+    "[12.345]->wl_surface#5.commit()",
+    "[12.345]   ->   wl_surface#5.commit()",
+    "[12.345] -> wl_surface#5.commit()",
+    "[12.345] {} wl_surface#5.commit()",
+    "[12.345] {Queue wl_surface#5.commit()",
+    "[12.345] {Queue}wl_surface#5.commit()",
+    "[12.345] {Queue}->wl_surface#5.commit()",
+    "<> [12.345] wl_surface#5.commit()",
+    "<client-1>[12.345] wl_surface#5.commit()",
+    "<client-1 [12.345] wl_surface#5.commit()",
+    "[12345] wl_surface#5.commit()",
+    "[.345] wl_surface#5.commit()",
+    "[12.] wl_surface#5.commit()",
+    "[12.345 wl_surface#5.commit()",
+    "[12.345]wl_surface#5.commit()",
+    "[ 12.345] wl_surface#.commit()",
+    "[12.345] wl_surface5.commit()",
+    "[12.345] #5.commit()",
+    "[12.345] wl_surface#5commit()",
+    "[12.345] wl_surface#5.()",
+    "[12.345] wl_surface#5.commit(",
+    "[12.345] wl_surface#5.commit",
+    "[12.345] wl_surface#5.commit() ",
+    "[12.345] wl-surface#5.commit()",
+    "[12.345] wl_surface#0x5.commit()",
+    "[12.345] wl_surface#5.com-mit()",
+    "[12.345] wl_surf\xc3\xa4" "ce#5.commit()",
+    "[12.345] wl_surface#5.commit(\"\xc3\xa4\")",
+    "[12.345] wl_surface#5.commit(\t)",
+    "\t[12.345] wl_surface#5.commit()",
+    " [12.345] wl_surface#5.commit()",
+    "discarded[12.345] wl_surface#5.commit()",
+    "[12.345] wl_surface#5.commit() discarded",
+    "[12.345]",
+    "[",
+    "",
+};
+
+// objects that are only named as an argument have to show up in their lifetime, no matter
+// if the log writes class#id or the class@id of older libwayland versions
+int checkObjectArguments()
+{
+    QByteArray log = "[1.000]  -> wl_shm_pool#5.create_buffer(new id wl_buffer#6, 0, 32, 32, 128, 0)\n"
+                     "[1.001]  -> wl_compositor#3.create_surface(new id wl_surface#7)\n"
+                     "[1.002]  -> wl_surface#7.attach(wl_buffer#6, 0, 0)\n"
+                     "[1.003]  -> wl_shm_pool@5.create_buffer(new id wl_buffer@8, 0, 32, 32, 128, 0)\n"
+                     "[1.004]  -> wl_surface@7.attach(wl_buffer@8, 0, 0)\n"_ba;
+    QBuffer buffer(&log);
+    buffer.open(QIODevice::ReadOnly);
+    const std::unique_ptr<Model> model(Parser(&buffer).parse());
+
+    const Atom buffers = model->atoms().find(u"wl_buffer"_s);
+    int failures = 0;
+    int found = 0;
+    for (const auto &key : model->lifetimeIndex().leaks()) {
+        if (key.m_object.m_class != buffers)
+            continue;
+        ++found;
+        const QList<int> expected = (key.m_object.m_instance == 6) ? QList<int> { 0, 2 } : QList<int> { 3, 4 };
+        const QList<int> &messages = model->lifetimeIndex().lifetime(key)->m_messages;
+        if (messages != expected) {
+            std::printf("  wl_buffer#%u is referred to by %lld message(s) instead of %lld\n", key.m_object.m_instance,
+                        static_cast<long long>(messages.size()), static_cast<long long>(expected.size()));
+            ++failures;
+        }
+    }
+    if (found != 2) {
+        std::printf("  %d wl_buffer lifetime(s) instead of 2\n", found);
+        ++failures;
+    }
+    return failures;
+}
+
+// every corpus line, the lines of the synthetic logs and those of the given files
+int checkTokenizers(const QStringList &files, quint32 seed)
+{
+    qint64 lines = 0;
+    qint64 accepted = 0;
+    qint64 failures = 0;
+
+    auto check = [&](QByteArrayView line) {
+        ++lines;
+        bool ok = false;
+        const QString difference = Parser::compareTokenizers(line, &ok);
+        if (ok)
+            ++accepted;
+        if (!difference.isEmpty()) {
+            std::printf("  %s\n    %s\n", line.toByteArray().constData(), qPrintable(difference));
+            ++failures;
+        }
+    };
+
+    for (const char *line : tokenizerCorpus)
+        check(QByteArrayView(line));
+
+    QTemporaryFile log;
+    if (!log.open())
+        throw Exception("could not create a temporary file: %1").arg(log.errorString());
+    Generator(Scenario { "tokenizers", 10'000, 4, 0.2 }, seed).write(&log);
+    log.close();
+    QStringList logFiles { log.fileName() };
+    logFiles << files;
+
+    for (const auto &fileName : std::as_const(logFiles)) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            throw Exception("could not open %1: %2").arg(fileName).arg(file.errorString());
+        while (!file.atEnd()) {
+            const QByteArray data = file.readLine();
+            QByteArrayView line = data;
+            if (line.endsWith('\n'))
+                line.chop(1);
+            if (line.endsWith('\r'))
+                line.chop(1);
+            check(line);
+        }
+    }
+
+    std::printf("%lld lines, %lld accepted, %lld differences\n", static_cast<long long>(lines),
+                static_cast<long long>(accepted), static_cast<long long>(failures));
+    failures += checkObjectArguments();
+    return failures ? 1 : 0;
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(u"wlanalyze-bench"_s);
+    QCoreApplication::setApplicationVersion(u"0.1"_s);
+
+    QCommandLineParser clp;
+    clp.setApplicationDescription(u"Times parsing, filtering and sorting on synthetic WAYLAND_DEBUG logs. "
+                                  "Without any of the scenario options, a fixed set of scenarios is run."_s);
+    clp.addHelpOption();
+    clp.addVersionOption();
+    const QCommandLineOption messagesOption(u"messages"_s, u"Number of messages in the log"_s, u"n"_s);
+    const QCommandLineOption connectionsOption(u"connections"_s, u"Number of clients in the log"_s, u"n"_s);
+    const QCommandLineOption churnOption(u"churn"_s, u"Share of messages creating or destroying surfaces"_s, u"0..1"_s);
+    const QCommandLineOption liveObjectsOption(u"live-objects"_s, u"Live surfaces per connection"_s, u"n"_s);
+    const QCommandLineOption seedOption(u"seed"_s, u"Seed of the generator, the same seed gives the same log"_s, u"n"_s);
+    const QCommandLineOption checkTokenizersOption(u"check-tokenizers"_s, u"Instead of timing anything, check that the line scanner "
+                                                   "and the reference regexp split a corpus of lines, a synthetic log and "
+                                                   "the given logs the same way"_s);
+    for (const auto *option : { &messagesOption, &connectionsOption, &churnOption, &liveObjectsOption, &seedOption,
+                                &checkTokenizersOption }) {
+        clp.addOption(*option);
+    }
+    clp.addPositionalArgument(u"logfile"_s, u"Logs to check with --check-tokenizers"_s, u"[logfile...]"_s);
+    clp.process(app);
+
+    const quint32 seed = clp.isSet(seedOption) ? clp.value(seedOption).toUInt() : 1;
+
+    if (clp.isSet(checkTokenizersOption)) {
+        try {
+            return checkTokenizers(clp.positionalArguments(), seed);
+        } catch (const Exception &e) {
+            std::fprintf(stderr, "wlanalyze-bench: %s\n", qPrintable(e.errorString()));
+            return 1;
+        }
+    }
+
+    QList<Scenario> scenarios;
+    if (clp.isSet(messagesOption) || clp.isSet(connectionsOption) || clp.isSet(churnOption)
+        || clp.isSet(liveObjectsOption)) {
+        Scenario custom { "custom" };
+        if (clp.isSet(messagesOption))
+            custom.m_messages = clp.value(messagesOption).toLongLong();
+        if (clp.isSet(connectionsOption))
+            custom.m_connections = std::clamp(clp.value(connectionsOption).toInt(), 1, 1000);
+        if (clp.isSet(churnOption))
+            custom.m_churn = std::clamp(clp.value(churnOption).toDouble(), 0.0, 1.0);
+        if (clp.isSet(liveObjectsOption))
+            custom.m_liveObjects = std::clamp(clp.value(liveObjectsOption).toInt(), 0, 500'000);
+        scenarios = { custom };
+    } else {
+        scenarios = {
+            { "small", 100'000 },
+            { "large", 5'000'000 },
+            { "connections", 1'000'000, 32 },
+            { "churn", 1'000'000, 1, 0.5 },
+            { "registry", 1'000'000, 1, 0.05, 100'000 },
+        };
+    }
+    try {
+        for (const auto &scenario : std::as_const(scenarios))
+            run(scenario, seed);
+    } catch (const Exception &e) {
+        std::fprintf(stderr, "wlanalyze-bench: %s\n", qPrintable(e.errorString()));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <bit>
+
+#include "bitmapscan.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define WLA_SCAN_X86
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define WLA_TARGET_AVX2
+#  else
+#    define WLA_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#  define WLA_SCAN_NEON
+#  include <arm_neon.h>
+#endif
+
+
+namespace WaylandDebug {
+
+namespace {
+
+// every kernel produces the bits for a block of 64 rows
+using ByteBlock = quint64 (*)(const quint8 *p, std::span<const quint8> values);
+using AtomBlock = quint64 (*)(const quint16 *p, std::span<const quint16> values);
+
+template <typename T> inline bool matchesAny(T v, std::span<const T> values)
+{
+    for (T value : values) {
+        if (v == value)
+            return true;
+    }
+    return false;
+}
+
+template <typename T> quint64 blockScalar(const T *p, std::span<const T> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (matchesAny(p[i], values))
+            bits |= quint64(1) << i;
+    }
+    return bits;
+}
+
+#if defined(WLA_SCAN_X86)
+
+quint64 byteBlockSse2(const quint8 *p, std::span<const quint8> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 16) {
+        const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i eq = _mm_setzero_si128();
+        for (quint8 value : values)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(data, _mm_set1_epi8(char(value))));
+        bits |= quint64(quint16(_mm_movemask_epi8(eq))) << i;
+    }
+    return bits;
+}
+
+quint64 atomBlockSse2(const quint16 *p, std::span<const quint16> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 16) {
+        const __m128i data0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        const __m128i data1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 8));
+        __m128i eq0 = _mm_setzero_si128();
+        __m128i eq1 = _mm_setzero_si128();
+        for (quint16 value : values) {
+            const __m128i v = _mm_set1_epi16(short(value));
+            eq0 = _mm_or_si128(eq0, _mm_cmpeq_epi16(data0, v));
+            eq1 = _mm_or_si128(eq1, _mm_cmpeq_epi16(data1, v));
+        }
+        // 0xffff / 0x0000 saturate to 0xff / 0x00
+        bits |= quint64(quint16(_mm_movemask_epi8(_mm_packs_epi16(eq0, eq1)))) << i;
+    }
+    return bits;
+}
+
+WLA_TARGET_AVX2 quint64 byteBlockAvx2(const quint8 *p, std::span<const quint8> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 32) {
+        const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i eq = _mm256_setzero_si256();
+        for (quint8 value : values)
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(data, _mm256_set1_epi8(char(value))));
+        bits |= quint64(quint32(_mm256_movemask_epi8(eq))) << i;
+    }
+    return bits;
+}
+
+WLA_TARGET_AVX2 quint64 atomBlockAvx2(const quint16 *p, std::span<const quint16> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 32) {
+        const __m256i data0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        const __m256i data1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 16));
+        __m256i eq0 = _mm256_setzero_si256();
+        __m256i eq1 = _mm256_setzero_si256();
+        for (quint16 value : values) {
+            const __m256i v = _mm256_set1_epi16(short(value));
+            eq0 = _mm256_or_si256(eq0, _mm256_cmpeq_epi16(data0, v));
+            eq1 = _mm256_or_si256(eq1, _mm256_cmpeq_epi16(data1, v));
+        }
+        // packs works per 128 bit lane: put the quarters back in row order
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, eq1), 0xd8);
+        bits |= quint64(quint32(_mm256_movemask_epi8(packed))) << i;
+    }
+    return bits;
+}
+
+bool hasAvx2()
+{
+#  if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    if (!osxsave || ((_xgetbv(0) & 0x6) != 0x6))
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#  else
+    return __builtin_cpu_supports("avx2");
+#  endif
+}
+
+#elif defined(WLA_SCAN_NEON)
+
+inline quint64 movemask(uint8x16_t eq)
+{
+    static const quint8 weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t masked = vandq_u8(eq, vld1q_u8(weights));
+    return quint64(vaddv_u8(vget_low_u8(masked))) | (quint64(vaddv_u8(vget_high_u8(masked))) << 8);
+}
+
+quint64 byteBlockNeon(const quint8 *p, std::span<const quint8> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 16) {
+        const uint8x16_t data = vld1q_u8(p + i);
+        uint8x16_t eq = vdupq_n_u8(0);
+        for (quint8 value : values)
+            eq = vorrq_u8(eq, vceqq_u8(data, vdupq_n_u8(value)));
+        bits |= movemask(eq) << i;
+    }
+    return bits;
+}
+
+quint64 atomBlockNeon(const quint16 *p, std::span<const quint16> values)
+{
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 16) {
+        const uint16x8_t data0 = vld1q_u16(p + i);
+        const uint16x8_t data1 = vld1q_u16(p + i + 8);
+        uint16x8_t eq0 = vdupq_n_u16(0);
+        uint16x8_t eq1 = vdupq_n_u16(0);
+        for (quint16 value : values) {
+            const uint16x8_t v = vdupq_n_u16(value);
+            eq0 = vorrq_u16(eq0, vceqq_u16(data0, v));
+            eq1 = vorrq_u16(eq1, vceqq_u16(data1, v));
+        }
+        bits |= movemask(vcombine_u8(vmovn_u16(eq0), vmovn_u16(eq1))) << i;
+    }
+    return bits;
+}
+
+#endif
+
+struct Kernels
+{
+    const char *m_name;
+    ByteBlock m_bytes;
+    AtomBlock m_atoms;
+};
+
+const Kernels &kernels()
+{
+    static const Kernels k = []() -> Kernels {
+#if defined(WLA_SCAN_X86)
+        if (hasAvx2())
+            return { "avx2", byteBlockAvx2, atomBlockAvx2 };
+        return { "sse2", byteBlockSse2, atomBlockSse2 }; // always there on x86-64
+#elif defined(WLA_SCAN_NEON)
+        return { "neon", byteBlockNeon, atomBlockNeon };
+#else
+        return { "scalar", blockScalar<quint8>, blockScalar<quint16> };
+#endif
+    }();
+    return k;
+}
+
+template <typename T, typename Block>
+void scan(const T *column, qsizetype rows, std::span<const T> values, quint64 *bits, bool intersect,
+          Block block)
+{
+    auto store = [bits, intersect](qsizetype word, quint64 result) {
+        bits[word] = intersect ? (bits[word] & result) : result;
+    };
+
+    const qsizetype full = rows / 64;
+    if (values.empty()) {
+        for (qsizetype w = 0; w < BitmapScan::words(rows); ++w)
+            store(w, 0);
+        return;
+    }
+    for (qsizetype w = 0; w < full; ++w)
+        store(w, block(column + w * 64, values));
+
+    if (rows % 64) {
+        quint64 result = 0;
+        for (qsizetype i = full * 64; i < rows; ++i) {
+            if (matchesAny(column[i], values))
+                result |= quint64(1) << (i % 64);
+        }
+        store(full, result);
+    }
+}
+
+} // namespace
+
+
+const char *BitmapScan::implementation()
+{
+    return kernels().m_name;
+}
+
+void BitmapScan::matchBytes(const quint8 *column, qsizetype rows, std::span<const quint8> values,
+                            quint64 *bits, bool intersect)
+{
+    scan(column, rows, values, bits, intersect, kernels().m_bytes);
+}
+
+void BitmapScan::matchAtoms(const quint16 *column, qsizetype rows, std::span<const quint16> values,
+                            quint64 *bits, bool intersect)
+{
+    scan(column, rows, values, bits, intersect, kernels().m_atoms);
+}
+
+QList<int> BitmapScan::toOrdinals(const quint64 *bits, qsizetype rows)
+{
+    qsizetype count = 0;
+    for (qsizetype w = 0; w < words(rows); ++w)
+        count += std::popcount(bits[w]);
+
+    QList<int> result;
+    result.reserve(count);
+    for (qsizetype w = 0; w < words(rows); ++w) {
+        for (quint64 word = bits[w]; word; word &= word - 1)
+            result.append(int(w * 64 + std::countr_zero(word)));
+    }
+    return result;
+}
+
+} // namespace WaylandDebug
@@ -0,0 +1,36 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <span>
+
+#include <QList>
+
+namespace WaylandDebug {
+
+// Full scans over packed message columns for the filter criteria that have no postings lists.
+// Every row is one bit in a bitmap of 64 bit words: bit (i % 64) of word (i / 64) is row i.
+// The scans use AVX2, SSE2 or NEON depending on what the CPU in front of us supports and fall
+// back to plain C++ everywhere else.
+class BitmapScan
+{
+public:
+    using Bitmap = QList<quint64>;
+
+    static const char *implementation();
+
+    static qsizetype words(qsizetype rows) { return (rows + 63) / 64; }
+
+    // set the bits of all rows that equal one of the values. With intersect, the result is
+    // ANDed into the existing bits instead.
+    static void matchBytes(const quint8 *column, qsizetype rows, std::span<const quint8> values,
+                           quint64 *bits, bool intersect);
+    static void matchAtoms(const quint16 *column, qsizetype rows, std::span<const quint16> values,
+                           quint64 *bits, bool intersect);
+
+    static QList<int> toOrdinals(const quint64 *bits, qsizetype rows);
+    static bool test(const Bitmap &bits, int row) { return bits.at(row / 64) & (quint64(1) << (row % 64)); }
+};
+
+} // namespace WaylandDebug
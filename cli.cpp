@@ -0,0 +1,491 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+
+#include "waylanddebug.h"
+#include "exception.h"
+#include "perfcounters.h"
+#include "query.h"
+
+using namespace Qt::StringLiterals;
+using namespace WaylandDebug;
+
+
+namespace {
+
+enum class Format { None, Tsv, Json };
+enum class GroupBy { None, Method, Class, Object, Connection, Queue, Direction };
+
+// stdout through one big buffer: millions of tiny writes are slow
+class Output
+{
+public:
+    explicit Output(FILE *file)
+        : m_file(file)
+    {
+        m_buffer.reserve(BufferSize);
+    }
+    ~Output() { flush(); }
+
+    Output &operator<<(QByteArrayView str)
+    {
+        m_buffer.append(str);
+        if (m_buffer.size() >= BufferSize)
+            flush();
+        return *this;
+    }
+    Output &operator<<(char c) { return *this << QByteArrayView(&c, 1); }
+    Output &operator<<(quint64 v) { return *this << QByteArray::number(v); }
+
+    void flush()
+    {
+        std::fwrite(m_buffer.constData(), 1, size_t(m_buffer.size()), m_file);
+        std::fflush(m_file);
+        m_buffer.clear();
+    }
+
+private:
+    static constexpr qsizetype BufferSize = 1024 * 1024;
+
+    FILE *m_file;
+    QByteArray m_buffer;
+};
+
+QByteArray directionName(Direction direction)
+{
+    switch (direction) {
+    case Direction::ToCompositor:   return "request"_ba;
+    case Direction::FromCompositor: return "event"_ba;
+    default:                        return "unknown"_ba;
+    }
+}
+
+QByteArray jsonString(QByteArrayView str)
+{
+    QByteArray result;
+    result.reserve(str.size() + 2);
+    result.append('"');
+    for (char c : str) {
+        switch (c) {
+        case '"':  result.append("\\\""); break;
+        case '\\': result.append("\\\\"); break;
+        case '\t': result.append("\\t"); break;
+        default:
+            if (uchar(c) < 0x20)
+                result.append("\\u00").append(QByteArray::number(uchar(c), 16).rightJustified(2, '0'));
+            else
+                result.append(c);
+        }
+    }
+    result.append('"');
+    return result;
+}
+
+QByteArray tsvField(QByteArrayView str)
+{
+    // string arguments are the only place where a tab could show up
+    if (!str.contains('\t'))
+        return str.toByteArray();
+    return str.toByteArray().replace('\t', "\\t");
+}
+
+struct Group
+{
+    QByteArray m_name;
+    quint64 m_count = 0;
+    quint64 m_first = 0;
+    quint64 m_last = 0;
+};
+
+// only objects need the instance and generation: ids like the one of a wl_callback are
+// reused once per frame, so all of them have to be compared in full
+struct GroupKey
+{
+    quint64 m_value = 0;
+    uint m_instance = 0;
+    uint m_generation = 0;
+
+    bool operator==(const GroupKey &) const = default;
+    friend size_t qHash(const GroupKey &key, size_t seed = 0) noexcept
+    {
+        return qHashMulti(seed, key.m_value, key.m_instance, key.m_generation);
+    }
+};
+
+class BatchProcessor
+{
+public:
+    Filter m_filter;
+    bool m_filtering = false;
+    Format m_format = Format::Tsv;
+    GroupBy m_groupBy = GroupBy::None;
+    quint64 m_limit = 0;
+
+    quint64 m_messages = 0;
+    quint64 m_matches = 0;
+    quint64 m_firstTime = 0;
+    quint64 m_lastTime = 0;
+    std::atomic_bool m_done = false;
+
+    explicit BatchProcessor(Output &out)
+        : m_out(out)
+    { }
+
+    void startFile()
+    {
+        // every file has its own atoms
+        m_atoms = { };
+        m_utf8 = { QByteArray { } };
+        m_groupNameKeys.clear();
+        if (m_filtering)
+            m_filter.compile(m_atoms);
+    }
+
+    void writeHeader()
+    {
+        if (m_format == Format::Tsv)
+            m_out << "time\tconnection\tqueue\tdirection\tobject\tmethod\targuments\n"_ba;
+    }
+
+    void process(const Parser::Batch &batch)
+    {
+        for (const auto &str : batch.m_newAtoms) {
+            m_atoms.intern(str);
+            m_utf8.append(str.toUtf8());
+        }
+        // names that show up for the first time may be part of the filter
+        if (m_filtering && !batch.m_newAtoms.isEmpty())
+            m_filter.compile(m_atoms);
+
+        const MessageStore &ms = batch.m_messages;
+        for (qsizetype i = 0; (i < ms.size()) && !m_done; ++i) {
+            ++m_messages;
+            if (m_filtering && !m_filter.match(ms, i))
+                continue;
+
+            const quint64 time = ms.m_time.at(i);
+            if (!m_matches++)
+                m_firstTime = time;
+            m_firstTime = std::min(m_firstTime, time);
+            m_lastTime = std::max(m_lastTime, time);
+
+            if (m_format == Format::Tsv)
+                writeTsv(ms, i);
+            else if (m_format == Format::Json)
+                writeJson(ms, i);
+            if (m_groupBy != GroupBy::None)
+                count(ms, i);
+
+            if (m_limit && (m_matches >= m_limit))
+                m_done = true;
+        }
+    }
+
+    void writeGroups(Format format)
+    {
+        QList<Group> groups = m_groups.values();
+        std::sort(groups.begin(), groups.end(), [](const Group &g1, const Group &g2) {
+            return (g1.m_count != g2.m_count) ? (g1.m_count > g2.m_count) : (g1.m_name < g2.m_name);
+        });
+
+        // rates are over the time span of all matches, in messages per second
+        const double seconds = double(m_lastTime - m_firstTime) / 1000 / 1000;
+        auto rate = [seconds](quint64 count) {
+            return QByteArray::number((seconds > 0) ? double(count) / seconds : 0.0, 'f', 2);
+        };
+        auto share = [this](quint64 count) {
+            return QByteArray::number(m_matches ? 100.0 * double(count) / double(m_matches) : 0.0, 'f', 2);
+        };
+
+        if (format == Format::Json) {
+            m_out << "{\"messages\":"_ba << m_messages << ",\"matches\":"_ba << m_matches
+                  << ",\"seconds\":"_ba << QByteArray::number(seconds, 'f', 6) << ",\"groups\":["_ba;
+            for (qsizetype g = 0; g < groups.size(); ++g) {
+                const Group &group = groups.at(g);
+                m_out << (g ? ",{\"key\":"_ba : "{\"key\":"_ba) << jsonString(group.m_name)
+                      << ",\"count\":"_ba << group.m_count << ",\"percent\":"_ba << share(group.m_count)
+                      << ",\"rate\":"_ba << rate(group.m_count) << ",\"first\":"_ba << group.m_first
+                      << ",\"last\":"_ba << group.m_last << '}';
+            }
+            m_out << "]}\n"_ba;
+        } else {
+            m_out << "key\tcount\tpercent\trate\tfirst\tlast\n"_ba;
+            for (const Group &group : std::as_const(groups)) {
+                m_out << tsvField(group.m_name) << '\t' << group.m_count << '\t' << share(group.m_count)
+                      << '\t' << rate(group.m_count) << '\t' << group.m_first << '\t' << group.m_last << '\n';
+            }
+        }
+    }
+
+private:
+    const QByteArray &atom(Atom a) const { return m_utf8.at(a); }
+
+    QByteArray objectName(const ObjectRef &o) const
+    {
+        return atom(o.m_class) + '#' + QByteArray::number(o.m_instance);
+    }
+
+    void writeTsv(const MessageStore &ms, qsizetype i)
+    {
+        m_out << ms.m_time.at(i) << '\t' << atom(ms.m_connection.at(i)) << '\t' << atom(ms.m_queue.at(i))
+              << '\t' << directionName(ms.m_direction.at(i)) << '\t' << objectName(ms.m_object.at(i))
+              << '\t' << atom(ms.m_method.at(i)) << '\t' << tsvField(ms.arguments(i)) << '\n';
+    }
+
+    void writeJson(const MessageStore &ms, qsizetype i)
+    {
+        // JSON lines: one object per message, so the output can be streamed as well
+        const ObjectRef &o = ms.m_object.at(i);
+        m_out << "{\"time\":"_ba << ms.m_time.at(i)
+              << ",\"connection\":"_ba << jsonString(atom(ms.m_connection.at(i)))
+              << ",\"queue\":"_ba << jsonString(atom(ms.m_queue.at(i)))
+              << ",\"direction\":\""_ba << directionName(ms.m_direction.at(i))
+              << "\",\"class\":"_ba << jsonString(atom(o.m_class))
+              << ",\"instance\":"_ba << quint64(o.m_instance)
+              << ",\"generation\":"_ba << quint64(o.m_generation)
+              << ",\"method\":"_ba << jsonString(atom(ms.m_method.at(i)))
+              << ",\"arguments\":["_ba;
+        const auto args = ms.argumentList(i);
+        for (qsizetype a = 0; a < args.size(); ++a)
+            m_out << (a ? ","_ba : QByteArray { }) << jsonString(args.at(a));
+        m_out << "]}\n"_ba;
+    }
+
+    void count(const MessageStore &ms, qsizetype i)
+    {
+        const ObjectRef &o = ms.m_object.at(i);
+        GroupKey key;
+        switch (m_groupBy) {
+        case GroupBy::Method:     key.m_value = (quint64(o.m_class) << 16) | ms.m_method.at(i); break;
+        case GroupBy::Class:      key.m_value = o.m_class; break;
+        case GroupBy::Object:     key = { o.m_class, o.m_instance, o.m_generation }; break;
+        case GroupBy::Connection: key.m_value = ms.m_connection.at(i); break;
+        case GroupBy::Queue:      key.m_value = ms.m_queue.at(i); break;
+        case GroupBy::Direction:  key.m_value = quint64(ms.m_direction.at(i)); break;
+        case GroupBy::None:       return;
+        }
+
+        // group names are by string: the atoms are only valid within one file
+        auto it = m_groupNameKeys.constFind(key);
+        QByteArray name;
+        if (it == m_groupNameKeys.cend()) {
+            switch (m_groupBy) {
+            case GroupBy::Method:     name = atom(o.m_class) + '.' + atom(ms.m_method.at(i)); break;
+            case GroupBy::Class:      name = atom(o.m_class); break;
+            case GroupBy::Object:     name = objectName(o) + " ["_ba + QByteArray::number(o.m_generation) + ']'; break;
+            case GroupBy::Connection: name = atom(ms.m_connection.at(i)); break;
+            case GroupBy::Queue:      name = atom(ms.m_queue.at(i)); break;
+            case GroupBy::Direction:  name = directionName(ms.m_direction.at(i)); break;
+            case GroupBy::None:       break;
+            }
+            it = m_groupNameKeys.insert(key, name);
+        }
+
+        Group &group = m_groups[*it];
+        const quint64 time = ms.m_time.at(i);
+        if (!group.m_count++) {
+            group.m_name = *it;
+            group.m_first = time;
+        }
+        group.m_last = time;
+    }
+
+    Output &m_out;
+    AtomTable m_atoms;
+    QList<QByteArray> m_utf8 = { QByteArray { } }; // the atoms, ready for output
+    QHash<GroupKey, QByteArray> m_groupNameKeys;
+    QHash<QByteArray, Group> m_groups;
+};
+
+QStringList values(const QCommandLineParser &clp, const QCommandLineOption &option)
+{
+    // repeated options and comma separated lists mean the same
+    QStringList result;
+    for (const auto &value : clp.values(option))
+        result.append(value.split(u',', Qt::SkipEmptyParts));
+    return result;
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(u"wlanalyze-cli"_s);
+    QCoreApplication::setApplicationVersion(u"0.1"_s);
+
+    QCommandLineParser clp;
+    clp.setApplicationDescription(u"Filters and aggregates WAYLAND_DEBUG logs without a GUI. "
+                                  "Prints the matching messages as TSV or JSON lines to stdout."_s);
+    clp.addHelpOption();
+    clp.addVersionOption();
+    clp.addPositionalArgument(u"logfile"_s, u"The logfiles to read, - for stdin"_s, u"[logfile...]"_s);
+
+    const QCommandLineOption classOption(u"class"_s, u"Only messages to or from objects of <class>"_s, u"class"_s);
+    const QCommandLineOption instanceOption(u"instance"_s, u"Only messages to or from object <id>"_s, u"id"_s);
+    const QCommandLineOption methodOption(u"method"_s, u"Only requests or events named <method>"_s, u"method"_s);
+    const QCommandLineOption argumentOption(u"argument"_s, u"Only messages with the argument <value>"_s, u"value"_s);
+    const QCommandLineOption connectionOption(u"connection"_s, u"Only messages on <connection>"_s, u"connection"_s);
+    const QCommandLineOption queueOption(u"queue"_s, u"Only messages on <queue>"_s, u"queue"_s);
+    const QCommandLineOption createdOption(u"created-class"_s, u"Only messages creating a <class> object"_s, u"class"_s);
+    const QCommandLineOption destroyedOption(u"destroyed-class"_s, u"Only messages destroying a <class> object"_s, u"class"_s);
+    const QCommandLineOption directionOption(u"direction"_s, u"Only requests or only events"_s, u"request|event"_s);
+    const QCommandLineOption fromOption(u"from"_s, u"Only messages at or after <time> (µs, as in the log)"_s, u"time"_s);
+    const QCommandLineOption toOption(u"to"_s, u"Only messages at or before <time> (µs, as in the log)"_s, u"time"_s);
+    const QCommandLineOption queryOption(u"query"_s, u"Only messages matching the filter <expression>, e.g. "
+                                         "'(method:commit OR method:attach) AND NOT queue:default'"_s, u"expression"_s);
+    const QCommandLineOption formatOption(u"format"_s, u"Output format, JSON is one object per line"_s, u"tsv|json|none"_s);
+    const QCommandLineOption countByOption(u"count-by"_s, u"Print the message counts and rates per <key> instead of the messages"_s,
+                                           u"method|class|object|connection|queue|direction"_s);
+    const QCommandLineOption limitOption(u"limit"_s, u"Stop after <n> matching messages"_s, u"n"_s);
+    const QCommandLineOption quietOption({ u"q"_s, u"quiet"_s }, u"No summary on stderr"_s);
+    const QCommandLineOption statsOption(u"stats"_s, u"Print the parser throughput and peak memory to stderr"_s);
+    for (const auto *option : { &classOption, &instanceOption, &methodOption, &argumentOption, &connectionOption,
+                                &queueOption, &createdOption, &destroyedOption, &directionOption, &fromOption,
+                                &toOption, &queryOption, &formatOption, &countByOption, &limitOption, &quietOption,
+                                &statsOption }) {
+        clp.addOption(*option);
+    }
+    clp.process(app);
+
+    auto fail = [](const QString &message) {
+        std::fprintf(stderr, "wlanalyze-cli: %s\n", qPrintable(message));
+        return 1;
+    };
+
+    Output out(stdout);
+    BatchProcessor processor(out);
+    Filter &filter = processor.m_filter;
+    filter.m_classMatch = values(clp, classOption);
+    filter.m_methodMatch = values(clp, methodOption);
+    filter.m_argumentMatch = clp.values(argumentOption); // arguments may contain commas
+    filter.m_connectionMatch = values(clp, connectionOption);
+    filter.m_queueMatch = values(clp, queueOption);
+    filter.m_createClassMatch = values(clp, createdOption);
+    filter.m_destroyClassMatch = values(clp, destroyedOption);
+    for (const auto &str : values(clp, instanceOption)) {
+        bool ok = false;
+        filter.m_instanceMatch.append(str.toUInt(&ok));
+        if (!ok)
+            return fail(u"invalid object id: %1"_s.arg(str));
+    }
+    if (clp.isSet(directionOption)) {
+        const QString direction = clp.value(directionOption);
+        if (direction == u"request")
+            filter.m_directionMatch = Direction::ToCompositor;
+        else if (direction == u"event")
+            filter.m_directionMatch = Direction::FromCompositor;
+        else
+            return fail(u"invalid direction: %1"_s.arg(direction));
+    }
+    for (const auto &[option, time] : { std::pair { &fromOption, &filter.m_timeMin }, std::pair { &toOption, &filter.m_timeMax } }) {
+        if (clp.isSet(*option)) {
+            bool ok = false;
+            *time = clp.value(*option).toULongLong(&ok);
+            if (!ok)
+                return fail(u"invalid time: %1"_s.arg(clp.value(*option)));
+        }
+    }
+    if (clp.isSet(queryOption)) {
+        filter.m_query = clp.value(queryOption).trimmed();
+        try {
+            Query::parse(filter.m_query);
+        } catch (const Exception &e) {
+            return fail(u"invalid query: %1"_s.arg(e.errorString()));
+        }
+    }
+    processor.m_filtering = !filter.isEmpty();
+
+    static const QHash<QString, GroupBy> groupBys = {
+        { u"method"_s, GroupBy::Method }, { u"class"_s, GroupBy::Class }, { u"object"_s, GroupBy::Object },
+        { u"connection"_s, GroupBy::Connection }, { u"queue"_s, GroupBy::Queue },
+        { u"direction"_s, GroupBy::Direction },
+    };
+    if (clp.isSet(countByOption)) {
+        processor.m_groupBy = groupBys.value(clp.value(countByOption), GroupBy::None);
+        if (processor.m_groupBy == GroupBy::None)
+            return fail(u"invalid --count-by key: %1"_s.arg(clp.value(countByOption)));
+    }
+
+    Format format = Format::Tsv;
+    if (clp.isSet(formatOption)) {
+        static const QHash<QString, Format> formats = {
+            { u"tsv"_s, Format::Tsv }, { u"json"_s, Format::Json }, { u"none"_s, Format::None },
+        };
+        format = formats.value(clp.value(formatOption), Format(-1));
+        if (format == Format(-1))
+            return fail(u"invalid format: %1"_s.arg(clp.value(formatOption)));
+    }
+    // with aggregates, only those get printed
+    processor.m_format = (processor.m_groupBy == GroupBy::None) ? format : Format::None;
+    if (clp.isSet(limitOption))
+        processor.m_limit = clp.value(limitOption).toULongLong();
+
+    QStringList logfiles = clp.positionalArguments();
+    if (logfiles.isEmpty())
+        logfiles << u"-"_s;
+
+    quint64 lines = 0;
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    processor.writeHeader();
+    for (const auto &logfile : std::as_const(logfiles)) {
+        if (processor.m_done)
+            break;
+
+        QFile file;
+        if (logfile == u"-")
+            file.open(stdin, QIODevice::ReadOnly);
+        else
+            file.setFileName(logfile);
+        if (!file.isOpen() && !file.open(QIODevice::ReadOnly))
+            return fail(u"%1: %2"_s.arg(logfile, file.errorString()));
+
+        // batches are processed and dropped right away, so memory stays bounded by the slice
+        // size and the live objects
+        processor.startFile();
+        try {
+            Parser parser(&file);
+            qint64 fileBytes = 0;
+            parser.parse([&processor, &fileBytes](const Parser::Batch &batch) {
+                processor.process(batch);
+                fileBytes = batch.m_bytesRead;
+            }, &processor.m_done);
+            lines += parser.lineCount();
+            bytes += fileBytes;
+        } catch (const Exception &e) {
+            out.flush();
+            return fail(u"%1: %2"_s.arg(logfile, e.errorString()));
+        }
+    }
+    if ((processor.m_groupBy != GroupBy::None) && (format != Format::None))
+        processor.writeGroups(format);
+    out.flush();
+
+    if (!clp.isSet(quietOption)) {
+        std::fprintf(stderr, "%llu of %llu messages matched in %.3f s\n",
+                     static_cast<unsigned long long>(processor.m_matches),
+                     static_cast<unsigned long long>(processor.m_messages), double(timer.elapsed()) / 1000);
+    }
+    if (clp.isSet(statsOption)) {
+        const double seconds = std::max(double(timer.nsecsElapsed()) / 1e9, 1e-9);
+        std::fprintf(stderr, "%llu lines, %lld bytes in %.3f s: %.0f lines/s, %.1f MB/s, "
+                     "%.3f s parsing, peak RSS %.1f MB\n",
+                     static_cast<unsigned long long>(lines), static_cast<long long>(bytes), seconds,
+                     double(lines) / seconds, double(bytes) / seconds / 1e6,
+                     double(PerfCounters::total(PerfCounters::Parse)) / 1e9,
+                     double(PerfCounters::peakResidentSize()) / 1e6);
+    }
+    return 0;
+}
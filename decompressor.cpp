@@ -0,0 +1,479 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstring>
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QScopeGuard>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+
+#if defined(WLA_HAVE_ZLIB)
+#  include <zlib.h>
+#endif
+#if defined(WLA_HAVE_LZMA)
+#  include <lzma.h>
+#endif
+#if defined(WLA_HAVE_ZSTD)
+#  include <zstd.h>
+#endif
+
+#include "decompressor.h"
+
+using namespace Qt::StringLiterals;
+
+
+namespace WaylandDebug {
+
+namespace {
+
+constexpr qint64 InputSize = 1024 * 1024;
+
+#if defined(WLA_HAVE_ZSTD)
+QString zstdError(size_t code)
+{
+    return u"zstd: "_s + QString::fromLatin1(ZSTD_getErrorName(code));
+}
+
+// one complete frame into a buffer of unknown size
+QString decodeZstdStream(QByteArrayView input, QByteArray &output)
+{
+    static constexpr qsizetype Step = 4 * 1024 * 1024;
+
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    auto freeCtx = qScopeGuard([ctx]() { ZSTD_freeDCtx(ctx); });
+
+    ZSTD_inBuffer in { input.data(), size_t(input.size()), 0 };
+    bool outputFull = false;
+    size_t ret = 0;
+    while ((in.pos < in.size) || outputFull) {
+        const qsizetype used = output.size();
+        output.resize(used + Step);
+        ZSTD_outBuffer out { output.data() + used, size_t(Step), 0 };
+        ret = ZSTD_decompressStream(ctx, &out, &in);
+        output.resize(used + qsizetype(out.pos));
+        if (ZSTD_isError(ret))
+            return zstdError(ret);
+        outputFull = (out.pos == out.size);
+    }
+    return ret ? u"zstd: unexpected end of data"_s : QString { };
+}
+#endif
+
+} // namespace
+
+
+DecompressingDevice::Format DecompressingDevice::detect(QIODevice *source)
+{
+    if (!source || !source->isReadable())
+        return Format::None;
+    const QByteArray magic = source->peek(6);
+    auto startsWith = [&magic](std::initializer_list<uchar> bytes) {
+        return (magic.size() >= qsizetype(bytes.size()))
+               && std::equal(bytes.begin(), bytes.end(), magic.cbegin(),
+                             [](uchar b, char c) { return b == uchar(c); });
+    };
+
+    if (startsWith({ 0x1f, 0x8b }))
+        return Format::Gzip;
+    if (startsWith({ 0xfd, '7', 'z', 'X', 'Z', 0x00 }))
+        return Format::Xz;
+    if (startsWith({ 0x28, 0xb5, 0x2f, 0xfd }))
+        return Format::Zstd;
+    // zstd skippable frames come first in the seekable format
+    if ((magic.size() >= 4) && ((uchar(magic.at(0)) & 0xf0) == 0x50) && startsWith({ uchar(magic.at(0)), 0x2a, 0x4d, 0x18 }))
+        return Format::Zstd;
+    return Format::None;
+}
+
+bool DecompressingDevice::isSupported(Format format)
+{
+    switch (format) {
+#if defined(WLA_HAVE_ZLIB)
+    case Format::Gzip: return true;
+#endif
+#if defined(WLA_HAVE_LZMA)
+    case Format::Xz: return true;
+#endif
+#if defined(WLA_HAVE_ZSTD)
+    case Format::Zstd: return true;
+#endif
+    default: return false;
+    }
+}
+
+QString DecompressingDevice::formatName(Format format)
+{
+    switch (format) {
+    case Format::Gzip: return u"gzip"_s;
+    case Format::Zstd: return u"zstd"_s;
+    case Format::Xz:   return u"xz"_s;
+    default:           return { };
+    }
+}
+
+DecompressingDevice::DecompressingDevice(QIODevice *source, Format format, QObject *parent)
+    : QIODevice(parent)
+    , m_source(source)
+    , m_format(format)
+{ }
+
+DecompressingDevice::~DecompressingDevice()
+{
+    close();
+}
+
+bool DecompressingDevice::open(OpenMode mode)
+{
+    if ((mode & WriteOnly) || !isSupported(m_format) || !m_source || !m_source->isReadable())
+        return false;
+    // everything is buffered in m_blocks already
+    if (!QIODevice::open(mode | Unbuffered))
+        return false;
+
+    m_stop = false;
+    m_done = false;
+    m_error.clear();
+    m_producer = QThread::create([this]() { produce(); });
+    m_producer->start();
+    return true;
+}
+
+void DecompressingDevice::close()
+{
+    if (m_producer) {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stop = true;
+            m_notFull.wakeAll();
+        }
+        m_producer->wait();
+        delete m_producer;
+        m_producer = nullptr;
+    }
+    m_blocks.clear();
+    m_frontPos = 0;
+    m_queuedBytes = 0;
+    if (isOpen())
+        QIODevice::close();
+}
+
+bool DecompressingDevice::atEnd() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_done && m_blocks.isEmpty();
+}
+
+qint64 DecompressingDevice::bytesAvailable() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queuedBytes - m_frontPos + QIODevice::bytesAvailable();
+}
+
+qint64 DecompressingDevice::sourceSize() const
+{
+    return m_source->isSequential() ? 0 : m_source->size();
+}
+
+QString DecompressingDevice::error() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_error;
+}
+
+qint64 DecompressingDevice::readData(char *data, qint64 maxSize)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_blocks.isEmpty() && !m_done)
+        m_notEmpty.wait(&m_mutex);
+    if (m_blocks.isEmpty()) {
+        if (!m_error.isEmpty())
+            setErrorString(m_error);
+        return -1;
+    }
+
+    qint64 copied = 0;
+    while ((copied < maxSize) && !m_blocks.isEmpty()) {
+        const QByteArray &front = m_blocks.constFirst();
+        const qint64 n = std::min<qint64>(maxSize - copied, front.size() - m_frontPos);
+        std::memcpy(data + copied, front.constData() + m_frontPos, size_t(n));
+        copied += n;
+        m_frontPos += n;
+        if (m_frontPos == front.size()) {
+            m_queuedBytes -= front.size();
+            m_blocks.removeFirst();
+            m_frontPos = 0;
+        }
+    }
+    m_notFull.wakeAll();
+    return copied;
+}
+
+qint64 DecompressingDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
+
+bool DecompressingDevice::push(QByteArray block)
+{
+    QMutexLocker locker(&m_mutex);
+    // a single block always fits, however big it is
+    while (!m_stop && m_queuedBytes && (m_queuedBytes + block.size() > MaxQueuedBytes))
+        m_notFull.wait(&m_mutex);
+    if (m_stop)
+        return false;
+    m_queuedBytes += block.size();
+    m_blocks.append(std::move(block));
+    m_notEmpty.wakeAll();
+    return true;
+}
+
+void DecompressingDevice::finish(const QString &error)
+{
+    QMutexLocker locker(&m_mutex);
+    m_done = true;
+    m_error = error;
+    m_notEmpty.wakeAll();
+}
+
+void DecompressingDevice::produce()
+{
+    switch (m_format) {
+#if defined(WLA_HAVE_ZLIB)
+    case Format::Gzip: decodeGzip(); break;
+#endif
+#if defined(WLA_HAVE_LZMA)
+    case Format::Xz:   decodeXz(); break;
+#endif
+#if defined(WLA_HAVE_ZSTD)
+    case Format::Zstd: decodeZstd(); break;
+#endif
+    default:           finish(u"%1 is not supported by this build"_s.arg(formatName(m_format))); break;
+    }
+}
+
+void DecompressingDevice::decodeGzip()
+{
+#if defined(WLA_HAVE_ZLIB)
+    z_stream z { };
+    if (inflateInit2(&z, 15 + 32) != Z_OK) // 32: gzip or zlib header
+        return finish(u"gzip: could not initialize the decoder"_s);
+    auto cleanup = qScopeGuard([&z]() { inflateEnd(&z); });
+
+    QByteArray input;
+    QByteArray output(BlockSize, Qt::Uninitialized);
+    qsizetype used = 0;
+    bool outputFull = false;
+    bool streamEnd = false;
+
+    while (!m_stop) {
+        // the decoder may still hold output even though it consumed all the input
+        if (!z.avail_in && !outputFull) {
+            input = m_source->read(InputSize);
+            m_sourceBytesRead += input.size();
+            if (input.isEmpty())
+                break;
+            z.next_in = reinterpret_cast<Bytef *>(input.data());
+            z.avail_in = uInt(input.size());
+        }
+        z.next_out = reinterpret_cast<Bytef *>(output.data() + used);
+        z.avail_out = uInt(output.size() - used);
+        const int ret = inflate(&z, Z_NO_FLUSH);
+        used = output.size() - qsizetype(z.avail_out);
+        outputFull = !z.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            // concatenated members, as written by pigz
+            streamEnd = true;
+            inflateReset(&z);
+        } else if (ret == Z_OK) {
+            streamEnd = false;
+        } else if (ret != Z_BUF_ERROR) {
+            return finish(u"gzip: "_s + QString::fromLatin1(z.msg ? z.msg : "corrupt data"));
+        }
+
+        if (outputFull) {
+            if (!push(output))
+                return;
+            output = QByteArray(BlockSize, Qt::Uninitialized);
+            used = 0;
+        }
+    }
+    if (m_stop)
+        return;
+    output.resize(used);
+    if (!output.isEmpty() && !push(output))
+        return;
+    finish(streamEnd ? QString { } : u"gzip: unexpected end of data"_s);
+#endif
+}
+
+void DecompressingDevice::decodeXz()
+{
+#if defined(WLA_HAVE_LZMA)
+    lzma_stream s = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&s, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        return finish(u"xz: could not initialize the decoder"_s);
+    auto cleanup = qScopeGuard([&s]() { lzma_end(&s); });
+
+    QByteArray input;
+    QByteArray output(BlockSize, Qt::Uninitialized);
+    qsizetype used = 0;
+    lzma_action action = LZMA_RUN;
+
+    while (!m_stop) {
+        if (!s.avail_in && (action == LZMA_RUN)) {
+            input = m_source->read(InputSize);
+            m_sourceBytesRead += input.size();
+            if (input.isEmpty())
+                action = LZMA_FINISH;
+            s.next_in = reinterpret_cast<const uint8_t *>(input.constData());
+            s.avail_in = size_t(input.size());
+        }
+        s.next_out = reinterpret_cast<uint8_t *>(output.data() + used);
+        s.avail_out = size_t(output.size() - used);
+        const lzma_ret ret = lzma_code(&s, action);
+        used = output.size() - qsizetype(s.avail_out);
+
+        if (!s.avail_out || (ret == LZMA_STREAM_END)) {
+            output.resize(used);
+            if (!output.isEmpty() && !push(output))
+                return;
+            output = QByteArray(BlockSize, Qt::Uninitialized);
+            used = 0;
+        }
+        if (ret == LZMA_STREAM_END)
+            return finish();
+        if (ret == LZMA_BUF_ERROR)
+            return finish(u"xz: unexpected end of data"_s);
+        if (ret != LZMA_OK)
+            return finish(u"xz: corrupt data (error %1)"_s.arg(int(ret)));
+    }
+#endif
+}
+
+void DecompressingDevice::decodeZstd()
+{
+#if defined(WLA_HAVE_ZSTD)
+    // independent frames can be decoded in parallel, but only if we can see all of them
+    if (auto *file = qobject_cast<QFile *>(m_source); file && !file->isSequential() && (file->size() > 0)) {
+        if (uchar *mapped = file->map(0, file->size())) {
+            auto unmap = qScopeGuard([file, mapped]() { file->unmap(mapped); });
+            if (decodeZstdFrames(reinterpret_cast<const char *>(mapped), file->size()))
+                return;
+        }
+    }
+
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    auto freeCtx = qScopeGuard([ctx]() { ZSTD_freeDCtx(ctx); });
+
+    QByteArray input;
+    QByteArray output(BlockSize, Qt::Uninitialized);
+    qsizetype used = 0;
+    bool outputFull = false;
+    size_t ret = 0;
+    ZSTD_inBuffer in { nullptr, 0, 0 };
+
+    while (!m_stop) {
+        // the decoder may still hold output even though it consumed all the input
+        if ((in.pos == in.size) && !outputFull) {
+            input = m_source->read(InputSize);
+            m_sourceBytesRead += input.size();
+            if (input.isEmpty())
+                break;
+            in = { input.constData(), size_t(input.size()), 0 };
+        }
+        ZSTD_outBuffer out { output.data() + used, size_t(output.size() - used), 0 };
+        ret = ZSTD_decompressStream(ctx, &out, &in);
+        if (ZSTD_isError(ret))
+            return finish(zstdError(ret));
+        used += qsizetype(out.pos);
+        outputFull = (used == output.size());
+
+        if (outputFull) {
+            if (!push(output))
+                return;
+            output = QByteArray(BlockSize, Qt::Uninitialized);
+            used = 0;
+        }
+    }
+    if (m_stop)
+        return;
+    output.resize(used);
+    if (!output.isEmpty() && !push(output))
+        return;
+    finish(ret ? u"zstd: unexpected end of data"_s : QString { });
+#endif
+}
+
+bool DecompressingDevice::decodeZstdFrames(const char *data, qint64 size)
+{
+#if defined(WLA_HAVE_ZSTD)
+    QList<QByteArrayView> frames;
+    for (qint64 pos = 0; pos < size; ) {
+        const size_t frameSize = ZSTD_findFrameCompressedSize(data + pos, size_t(size - pos));
+        if (ZSTD_isError(frameSize))
+            return false; // let the streaming decoder report it
+        frames.append(QByteArrayView(data + pos, qsizetype(frameSize)));
+        pos += qint64(frameSize);
+    }
+    if (frames.size() < 2)
+        return false;
+
+    struct Frame
+    {
+        QByteArrayView m_input;
+        QByteArray m_output;
+        QString m_error;
+    };
+
+    // a window of frames at a time: decoded in parallel, queued in order
+    const qsizetype window = 2 * std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    for (qsizetype first = 0; (first < frames.size()) && !m_stop; first += window) {
+        QList<Frame> batch;
+        for (qsizetype i = first; i < std::min(first + window, frames.size()); ++i)
+            batch.append({ frames.at(i), { }, { } });
+
+        QtConcurrent::blockingMap(batch, [](Frame &f) {
+            static constexpr unsigned long long MaxPreallocated = 1024 * 1024 * 1024;
+            const auto contentSize = ZSTD_getFrameContentSize(f.m_input.data(), size_t(f.m_input.size()));
+            if ((contentSize == ZSTD_CONTENTSIZE_UNKNOWN) || (contentSize == ZSTD_CONTENTSIZE_ERROR)
+                || (contentSize > MaxPreallocated)) {
+                f.m_error = decodeZstdStream(f.m_input, f.m_output);
+                return;
+            }
+            f.m_output = QByteArray(qsizetype(contentSize), Qt::Uninitialized);
+            const size_t ret = ZSTD_decompress(f.m_output.data(), size_t(contentSize),
+                                               f.m_input.data(), size_t(f.m_input.size()));
+            if (ZSTD_isError(ret))
+                f.m_error = zstdError(ret);
+            else
+                f.m_output.resize(qsizetype(ret));
+        });
+
+        for (auto &f : batch) {
+            if (!f.m_error.isEmpty()) {
+                finish(f.m_error);
+                return true;
+            }
+            m_sourceBytesRead += f.m_input.size();
+            if (!f.m_output.isEmpty() && !push(std::move(f.m_output)))
+                return true;
+        }
+    }
+    if (!m_stop)
+        finish();
+    return true;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+    return false;
+#endif
+}
+
+} // namespace WaylandDebug
@@ -0,0 +1,86 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+namespace WaylandDebug {
+
+// A read-only, sequential view of the decompressed content of another device. Decompression
+// runs on a thread of its own, a few blocks ahead of the reader, so it overlaps with the
+// parsing. zstd files with many frames (as written by pzstd or in the seekable format) are
+// decoded frame by frame in parallel.
+// Which formats are available depends on the libraries found at build time.
+class DecompressingDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    enum class Format {
+        None,
+        Gzip,
+        Zstd,
+        Xz,
+    };
+
+    // looks at the magic bytes without consuming them
+    static Format detect(QIODevice *source);
+    static bool isSupported(Format format);
+    static QString formatName(Format format);
+
+    DecompressingDevice(QIODevice *source, Format format, QObject *parent = nullptr);
+    ~DecompressingDevice() override;
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    bool isSequential() const override { return true; }
+    bool atEnd() const override;
+    qint64 bytesAvailable() const override;
+
+    // for progress reports: how much of the compressed source has been consumed
+    qint64 sourceBytesRead() const { return m_sourceBytesRead.load(std::memory_order_relaxed); }
+    qint64 sourceSize() const;
+    // empty unless the source is broken
+    QString error() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    void produce();
+    bool push(QByteArray block);
+    void finish(const QString &error = { });
+    void decodeGzip();
+    void decodeXz();
+    void decodeZstd();
+    bool decodeZstdFrames(const char *data, qint64 size);
+
+    static constexpr qsizetype BlockSize = 4 * 1024 * 1024;
+    static constexpr qsizetype MaxQueuedBytes = 64 * 1024 * 1024;
+
+    QIODevice *m_source;
+    Format m_format;
+    QThread *m_producer = nullptr;
+    std::atomic_bool m_stop = false;
+    std::atomic<qint64> m_sourceBytesRead = 0;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QList<QByteArray> m_blocks;
+    qsizetype m_frontPos = 0;
+    qsizetype m_queuedBytes = 0;
+    bool m_done = false;
+    QString m_error;
+};
+
+} // namespace WaylandDebug
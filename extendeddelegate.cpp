@@ -1,16 +1,18 @@
 // Copyright (C) 2025 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
+
 #include <QApplication>
 #include <QPainter>
 
 #include "extendeddelegate.h"
+#include "backgroundtint.h"
 
 
-ExtendedDelegate::ExtendedDelegate(int tintRole, int tintWidthRole, QObject *parent = nullptr)
+ExtendedDelegate::ExtendedDelegate(int tintRole, QObject *parent = nullptr)
     : QStyledItemDelegate(parent)
     , m_tintRole(tintRole)
-    , m_tintWidthRole(tintWidthRole)
 { }
 
 void ExtendedDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
@@ -29,24 +31,23 @@ void ExtendedDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
     };
 
     if (m_tintRole) {
-        QColor bgTint = index.data(m_tintRole).value<QColor>();
-        if (bgTint.isValid()) {
-            QColor base = opt.palette.color(opt.features & QStyleOptionViewItem::Alternate
-                                                ? QPalette::AlternateBase : QPalette::Base);
-            QColor mix = mixColor(base, bgTint, 0.1f);
-
-            QVariant v = index.data(m_tintWidthRole);
-            if (v.isValid() && v.typeId() == qMetaTypeId<double>()) {
-                auto w = v.toDouble();
-
-                QPixmap pix(opt.rect.size());
-                pix.fill(base);
-                QPainter pixPainter(&pix);
-                pixPainter.fillRect(0, 0, w * pix.width(), pix.height(), mix);
-                pixPainter.end();
-                opt.backgroundBrush = pix;
-            } else {
-                opt.backgroundBrush = mix;
+        const QVariant v = index.data(m_tintRole);
+        if (v.typeId() == qMetaTypeId<BackgroundTint>()) {
+            const auto tint = v.value<BackgroundTint>();
+            if (tint.m_color.isValid()) {
+                QColor base = opt.palette.color(opt.features & QStyleOptionViewItem::Alternate
+                                                    ? QPalette::AlternateBase : QPalette::Base);
+                QColor mix = mixColor(base, tint.m_color, 0.1f);
+
+                if (tint.m_width < 1) {
+                    // paint the bar straight into the cell, the style only adds the selection
+                    QRect bar = opt.rect;
+                    bar.setWidth(int(std::max(0.0, tint.m_width) * opt.rect.width()));
+                    painter->fillRect(opt.rect, base);
+                    painter->fillRect(bar, mix);
+                } else {
+                    opt.backgroundBrush = mix;
+                }
             }
         }
     }
@@ -9,11 +9,10 @@ class ExtendedDelegate : public QStyledItemDelegate
 {
     Q_OBJECT
 public:
-    ExtendedDelegate(int tintRole, int tintWidthRole, QObject *parent);
+    ExtendedDelegate(int tintRole, QObject *parent);
 
     void paint(QPainter *painter, const QStyleOptionViewItem &option,
                const QModelIndex &index) const override;
 private:
     int m_tintRole = 0;
-    int m_tintWidthRole = 0;
 };
@@ -0,0 +1,247 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+
+#include <QHash>
+
+#include "frameanalysis.h"
+
+
+using namespace Qt::StringLiterals;
+
+namespace WaylandDebug {
+
+QString FrameAnalysis::metricName(Metric metric)
+{
+    switch (metric) {
+    case FrameLatency:        return u"Frame latency"_s;
+    case FrameInterval:       return u"Frame interval"_s;
+    case BufferRelease:       return u"Buffer release"_s;
+    case PresentationLatency: return u"Presentation latency"_s;
+    default:                  return { };
+    }
+}
+
+int FrameAnalysis::bucket(qint64 value)
+{
+    if (value <= 0)
+        return 0;
+    return std::min(int(std::bit_width(quint64(value))) - 1, HistogramBuckets - 1);
+}
+
+FrameAnalysis::Summary FrameAnalysis::summarize(const Series &series)
+{
+    Summary s;
+    s.m_count = series.m_samples.size();
+    if (!s.m_count)
+        return s;
+
+    QList<qint64> values;
+    values.reserve(s.m_count);
+    double sum = 0;
+    for (const auto &sample : series.m_samples) {
+        values.append(sample.m_value);
+        sum += double(sample.m_value);
+    }
+    s.m_mean = sum / double(s.m_count);
+    double squares = 0;
+    for (qint64 v : std::as_const(values))
+        squares += (double(v) - s.m_mean) * (double(v) - s.m_mean);
+    s.m_stddev = std::sqrt(squares / double(s.m_count));
+
+    // nth_element is linear, no need to sort everything for three quantiles
+    auto quantile = [&values](double q) {
+        const auto n = qsizetype(std::llround(double(values.size() - 1) * q));
+        std::nth_element(values.begin(), values.begin() + n, values.end());
+        return values.at(n);
+    };
+    s.m_p50 = quantile(0.5);
+    s.m_p90 = quantile(0.9);
+    s.m_p99 = quantile(0.99);
+    const auto [min, max] = std::minmax_element(values.cbegin(), values.cend());
+    s.m_min = *min;
+    s.m_max = *max;
+    return s;
+}
+
+QList<qsizetype> FrameAnalysis::outliers(const Series &series, qsizetype count)
+{
+    QList<qsizetype> result(series.m_samples.size());
+    std::iota(result.begin(), result.end(), 0);
+    count = std::min(count, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), [&series](qsizetype i1, qsizetype i2) {
+        return series.m_samples.at(i1).m_value > series.m_samples.at(i2).m_value;
+    });
+    result.resize(count);
+    return result;
+}
+
+QList<FrameAnalysis::Surface> FrameAnalysis::analyze(const MessageStore &store, const AtomTable &atoms)
+{
+    const Atom surfaceClass = atoms.find(u"wl_surface"_s);
+    if (surfaceClass == AtomTable::NoAtom)
+        return { };
+    const Atom callbackClass = atoms.find(u"wl_callback"_s);
+    const Atom bufferClass = atoms.find(u"wl_buffer"_s);
+    const Atom presentationClass = atoms.find(u"wp_presentation"_s);
+    const Atom feedbackClass = atoms.find(u"wp_presentation_feedback"_s);
+    const Atom frameMethod = atoms.find(u"frame"_s);
+    const Atom attachMethod = atoms.find(u"attach"_s);
+    const Atom commitMethod = atoms.find(u"commit"_s);
+    const Atom doneMethod = atoms.find(u"done"_s);
+    const Atom releaseMethod = atoms.find(u"release"_s);
+    const Atom feedbackMethod = atoms.find(u"feedback"_s);
+    const Atom presentedMethod = atoms.find(u"presented"_s);
+    const Atom discardedMethod = atoms.find(u"discarded"_s);
+
+    using Key = LifetimeIndex::Key;
+    using Id = std::pair<Atom, uint>; // connection and instance
+
+    // the double buffered state of a surface: applied by the next commit
+    struct State
+    {
+        QList<Key> m_callbacks;
+        QList<Key> m_feedbacks;
+        bool m_attached = false;
+        uint m_buffer = 0; // 0 for a null buffer
+        int m_lastDone = -1;
+    };
+    // waiting for the event that ends the sample: the surface and the ordinal of the commit
+    struct Pending
+    {
+        qsizetype m_surface;
+        int m_commit;
+    };
+
+    QList<Surface> surfaces;
+    QList<State> states;
+    QHash<Key, qsizetype> surfaceIndex;
+    QHash<Id, Key> aliveSurfaces; // arguments carry no generation
+    QHash<Key, Pending> callbacks;
+    QHash<Key, Pending> feedbacks;
+    QHash<Id, Pending> buffers; // neither do the buffers in attach
+
+    auto surfaceFor = [&](const Key &key) {
+        auto it = surfaceIndex.constFind(key);
+        if (it != surfaceIndex.cend())
+            return it.value();
+        surfaces.append({ key, { }, 0, 0 });
+        states.append({ });
+        surfaceIndex.insert(key, surfaces.size() - 1);
+        return surfaces.size() - 1;
+    };
+    auto addSample = [&](qsizetype s, Metric metric, int from, int to) {
+        const qint64 value = qint64(store.m_time.at(to)) - qint64(store.m_time.at(from));
+        Series &series = surfaces[s].m_series[metric];
+        series.m_samples.append({ value, from, to });
+        ++series.m_histogram[bucket(value)];
+    };
+    // the instance of the first object argument, 0 for nil and -1 if it is not of class_
+    auto firstObjectArgument = [&store, &atoms](qsizetype i, Atom class_) -> qint64 {
+        if (class_ == AtomTable::NoAtom)
+            return -1;
+        for (const auto &text : MessageStore::splitArguments(store.arguments(i))) {
+            const auto type = Argument::typeOf(text);
+            if (type == Argument::Type::Nil)
+                return 0;
+            if (type != Argument::Type::Object)
+                continue;
+            const Argument argument = Argument::decode(text, type);
+            return (QLatin1StringView(argument.m_string) == atoms.string(class_)) ? argument.m_value : -1;
+        }
+        return -1;
+    };
+
+    for (qsizetype i = 0; i < store.size(); ++i) {
+        const int o = int(i);
+        const Atom connection = store.m_connection.at(i);
+        const ObjectRef &object = store.m_object.at(i);
+        const Atom method = store.m_method.at(i);
+        const Key key { connection, object };
+
+        for (const ObjectRef &created : store.created(i)) {
+            if (created.m_class == surfaceClass)
+                aliveSurfaces.insert({ connection, created.m_instance }, { connection, created });
+        }
+
+        if (object.m_class == surfaceClass) {
+            const qsizetype s = surfaceFor(key);
+            State &state = states[s];
+            if (method == frameMethod) {
+                for (const ObjectRef &created : store.created(i)) {
+                    if (created.m_class == callbackClass)
+                        state.m_callbacks.append({ connection, created });
+                }
+            } else if (method == attachMethod) {
+                const qint64 buffer = firstObjectArgument(i, bufferClass);
+                state.m_attached = (buffer >= 0);
+                state.m_buffer = uint(std::max<qint64>(buffer, 0));
+            } else if (method == commitMethod) {
+                ++surfaces[s].m_commits;
+                for (const Key &callback : std::as_const(state.m_callbacks))
+                    callbacks.insert(callback, { s, o });
+                for (const Key &feedback : std::as_const(state.m_feedbacks))
+                    feedbacks.insert(feedback, { s, o });
+                if (state.m_attached && state.m_buffer)
+                    buffers.insert({ connection, state.m_buffer }, { s, o });
+                state.m_callbacks.clear();
+                state.m_feedbacks.clear();
+                state.m_attached = false;
+            }
+        } else if ((object.m_class == callbackClass) && (method == doneMethod)) {
+            auto it = callbacks.find(key);
+            if (it != callbacks.end()) {
+                const Pending pending = it.value();
+                callbacks.erase(it);
+                addSample(pending.m_surface, FrameLatency, pending.m_commit, o);
+                State &state = states[pending.m_surface];
+                if (state.m_lastDone >= 0)
+                    addSample(pending.m_surface, FrameInterval, state.m_lastDone, o);
+                state.m_lastDone = o;
+            }
+        } else if ((object.m_class == bufferClass) && (method == releaseMethod)) {
+            auto it = buffers.find({ connection, object.m_instance });
+            if (it != buffers.end()) {
+                addSample(it->m_surface, BufferRelease, it->m_commit, o);
+                buffers.erase(it);
+            }
+        } else if ((object.m_class == presentationClass) && (method == feedbackMethod)) {
+            const qint64 surface = firstObjectArgument(i, surfaceClass);
+            auto it = (surface > 0) ? aliveSurfaces.constFind({ connection, uint(surface) }) : aliveSurfaces.cend();
+            if (it != aliveSurfaces.cend()) {
+                State &state = states[surfaceFor(it.value())];
+                for (const ObjectRef &created : store.created(i)) {
+                    if (created.m_class == feedbackClass)
+                        state.m_feedbacks.append({ connection, created });
+                }
+            }
+        } else if (object.m_class == feedbackClass) {
+            if ((method == presentedMethod) || (method == discardedMethod)) {
+                auto it = feedbacks.find(key);
+                if (it != feedbacks.end()) {
+                    if (method == presentedMethod)
+                        addSample(it->m_surface, PresentationLatency, it->m_commit, o);
+                    else
+                        ++surfaces[it->m_surface].m_discarded;
+                    feedbacks.erase(it);
+                }
+            }
+        }
+
+        for (const ObjectRef &destroyed : store.destroyed(i)) {
+            if (destroyed.m_class == surfaceClass)
+                aliveSurfaces.remove({ connection, destroyed.m_instance });
+            else if (destroyed.m_class == bufferClass)
+                buffers.remove({ connection, destroyed.m_instance });
+        }
+    }
+
+    surfaces.removeIf([](const Surface &surface) { return !surface.m_commits; });
+    return surfaces;
+}
+
+} // namespace WaylandDebug
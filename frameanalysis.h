@@ -0,0 +1,80 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <array>
+
+#include <QList>
+
+#include "waylanddebug.h"
+
+namespace WaylandDebug {
+
+// Frame timing per surface, from the request/event pairs that belong together:
+// - FrameLatency: the commit that carried a wl_surface.frame until its wl_callback.done
+// - FrameInterval: one wl_callback.done of a surface until the next one, i.e. the pacing
+// - BufferRelease: the commit of an attached wl_buffer until its wl_buffer.release
+// - PresentationLatency: the commit that carried a wp_presentation.feedback until the
+//   feedback's presented event
+// All times are the log's timestamps in µs. The surfaces, callbacks and feedbacks are matched
+// by connection and generation, so a reused id never gets mixed up with its predecessor.
+class FrameAnalysis
+{
+public:
+    enum Metric {
+        FrameLatency,
+        FrameInterval,
+        BufferRelease,
+        PresentationLatency,
+
+        MetricCount
+    };
+    static QString metricName(Metric metric);
+
+    // bucket i counts the samples in [2^i, 2^(i+1)) µs, the last one everything above
+    static constexpr int HistogramBuckets = 25;
+    using Histogram = std::array<int, HistogramBuckets>;
+    static int bucket(qint64 value);
+
+    struct Sample
+    {
+        qint64 m_value = 0;
+        int m_from = 0; // the ordinals of the two messages the sample was taken between
+        int m_to = 0;
+    };
+
+    struct Series
+    {
+        QList<Sample> m_samples; // in log order
+        Histogram m_histogram { };
+    };
+
+    struct Summary
+    {
+        qsizetype m_count = 0;
+        qint64 m_min = 0;
+        qint64 m_max = 0;
+        double m_mean = 0;
+        double m_stddev = 0; // the jitter, for intervals
+        qint64 m_p50 = 0;
+        qint64 m_p90 = 0;
+        qint64 m_p99 = 0;
+    };
+    static Summary summarize(const Series &series);
+    // the indexes of the count biggest samples, biggest first
+    static QList<qsizetype> outliers(const Series &series, qsizetype count);
+
+    struct Surface
+    {
+        LifetimeIndex::Key m_surface;
+        std::array<Series, MetricCount> m_series;
+        int m_commits = 0;
+        int m_discarded = 0; // presentation feedbacks that never made it to the screen
+    };
+
+    // one pass over the messages. Surfaces without any commit are left out.
+    static QList<Surface> analyze(const MessageStore &store, const AtomTable &atoms);
+};
+
+} // namespace WaylandDebug
@@ -0,0 +1,168 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+
+#include <QHeaderView>
+#include <QLabel>
+#include <QToolButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "framedock.h"
+
+
+using namespace Qt::StringLiterals;
+using WaylandDebug::FrameAnalysis;
+
+namespace {
+
+enum Column {
+    Name,
+    Count,
+    P50,
+    P90,
+    P99,
+    Max,
+    Jitter,
+
+    ColumnCount
+};
+
+constexpr int OrdinalRole = Qt::UserRole;
+
+QString formatDuration(double us)
+{
+    return u"%1 ms"_s.arg(us / 1000, 0, 'f', 3);
+}
+
+} // namespace
+
+FrameDock::FrameDock(QWidget *parent)
+    : QDockWidget(tr("Frame Timing"), parent)
+    , m_tree(new QTreeWidget)
+    , m_status(new QLabel)
+{
+    setObjectName(u"FrameDock"_s);
+    setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+
+    auto *inner = new QWidget;
+    auto *layout = new QVBoxLayout(inner);
+    layout->setContentsMargins(0, 0, 0, 0);
+    auto *top = new QHBoxLayout;
+    top->addWidget(m_status, 1);
+    auto *refresh = new QToolButton;
+    refresh->setText(tr("Analyze"));
+    connect(refresh, &QToolButton::clicked, this, &FrameDock::analyze);
+    top->addWidget(refresh);
+    layout->addLayout(top);
+
+    m_tree->setHeaderLabels({ tr("Surface / Metric"), tr("Count"), tr("p50"), tr("p90"), tr("p99"),
+                              tr("Max"), tr("Jitter") });
+    m_tree->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_tree->setUniformRowHeights(true);
+    connect(m_tree, &QTreeWidget::itemActivated, this, [this](QTreeWidgetItem *item) {
+        const QVariant ordinal = item->data(Name, OrdinalRole);
+        if (ordinal.isValid())
+            emit messageActivated(ordinal.toInt());
+    });
+    layout->addWidget(m_tree);
+    setWidget(inner);
+
+    setModel(nullptr);
+}
+
+void FrameDock::setModel(const WaylandDebug::Model *model)
+{
+    m_model = model;
+    ++m_run;
+    m_tree->clear();
+    m_status->setText(model ? tr("Not analyzed yet") : tr("No log"));
+}
+
+void FrameDock::analyze()
+{
+    if (!m_model)
+        return;
+
+    // the copies are shallow: the model can go on appending meanwhile
+    const int run = ++m_run;
+    m_status->setText(tr("Analyzing..."));
+    QtConcurrent::run([messages = m_model->messages(), atoms = m_model->atoms()]() {
+        return FrameAnalysis::analyze(messages, atoms);
+    }).then(this, [this, run](const QList<FrameAnalysis::Surface> &surfaces) {
+        if (run == m_run)
+            showResult(surfaces);
+    });
+}
+
+void FrameDock::showResult(const QList<FrameAnalysis::Surface> &surfaces)
+{
+    m_tree->clear();
+    m_status->setText(tr("%n surface(s)", nullptr, int(surfaces.size())));
+    if (!m_model)
+        return;
+
+    const auto &atoms = m_model->atoms();
+    QList<QTreeWidgetItem *> items;
+    for (const auto &surface : surfaces) {
+        const auto &object = surface.m_surface.m_object;
+        QString name = u"%1#%2 [%3]"_s.arg(atoms.string(object.m_class)).arg(object.m_instance).arg(object.m_generation);
+        if (surface.m_surface.m_connection != WaylandDebug::AtomTable::EmptyAtom)
+            name += u" – "_s + atoms.string(surface.m_surface.m_connection);
+
+        auto *item = new QTreeWidgetItem({ name, QString::number(surface.m_commits) });
+        item->setToolTip(Name, tr("%n commit(s)", nullptr, surface.m_commits)
+                                   + (surface.m_discarded ? tr(", %n discarded presentation(s)", nullptr, surface.m_discarded)
+                                                          : QString { }));
+        item->setTextAlignment(Count, Qt::AlignRight);
+        for (int metric = 0; metric < FrameAnalysis::MetricCount; ++metric) {
+            const auto &series = surface.m_series.at(metric);
+            if (!series.m_samples.isEmpty())
+                item->addChild(metricItem(FrameAnalysis::Metric(metric), series));
+        }
+        items.append(item);
+    }
+    m_tree->addTopLevelItems(items);
+}
+
+QTreeWidgetItem *FrameDock::metricItem(FrameAnalysis::Metric metric, const FrameAnalysis::Series &series)
+{
+    const auto summary = FrameAnalysis::summarize(series);
+    auto *item = new QTreeWidgetItem({ FrameAnalysis::metricName(metric),
+                                       QString::number(summary.m_count),
+                                       formatDuration(double(summary.m_p50)),
+                                       formatDuration(double(summary.m_p90)),
+                                       formatDuration(double(summary.m_p99)),
+                                       formatDuration(double(summary.m_max)),
+                                       formatDuration(summary.m_stddev) });
+    for (int column = Count; column < ColumnCount; ++column)
+        item->setTextAlignment(column, Qt::AlignRight);
+
+    // the histogram as a tooltip: one bar per power of two
+    const int first = int(std::find_if(series.m_histogram.cbegin(), series.m_histogram.cend(),
+                                       [](int n) { return n > 0; }) - series.m_histogram.cbegin());
+    const int last = int(series.m_histogram.crend() - std::find_if(series.m_histogram.crbegin(), series.m_histogram.crend(),
+                                                                   [](int n) { return n > 0; }));
+    const int peak = *std::max_element(series.m_histogram.cbegin(), series.m_histogram.cend());
+    QStringList lines;
+    for (int b = first; b < last; ++b) {
+        const int n = series.m_histogram.at(b);
+        lines << u"%1 %2 %3"_s.arg(formatDuration(double(quint64(1) << b)), 12)
+                     .arg(QString(peak ? (n * 40 + peak - 1) / peak : 0, QChar(0x2588)), -40)
+                     .arg(n);
+    }
+    item->setToolTip(Name, u"<pre>"_s + lines.join(u'\n').toHtmlEscaped() + u"</pre>"_s);
+
+    for (qsizetype i : FrameAnalysis::outliers(series, OutlierCount)) {
+        const auto &sample = series.m_samples.at(i);
+        auto *outlier = new QTreeWidgetItem({ tr("Messages %1 – %2").arg(sample.m_from).arg(sample.m_to), QString(),
+                                              QString(), QString(), QString(), formatDuration(double(sample.m_value)) });
+        outlier->setTextAlignment(Max, Qt::AlignRight);
+        outlier->setData(Name, OrdinalRole, sample.m_to);
+        outlier->setToolTip(Name, tr("Activate to jump to the message that ended this sample"));
+        item->addChild(outlier);
+    }
+    return item;
+}
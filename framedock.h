@@ -0,0 +1,41 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QDockWidget>
+
+#include "frameanalysis.h"
+
+QT_FORWARD_DECLARE_CLASS(QTreeWidget)
+QT_FORWARD_DECLARE_CLASS(QTreeWidgetItem)
+QT_FORWARD_DECLARE_CLASS(QLabel)
+
+// The FrameAnalysis of the current model: one entry per surface with the summary of every
+// metric, the worst samples below it. Activating a sample asks for its last message.
+class FrameDock : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    FrameDock(QWidget *parent = nullptr);
+
+    void setModel(const WaylandDebug::Model *model);
+    // runs in the background, on a snapshot of the messages
+    void analyze();
+
+signals:
+    void messageActivated(int ordinal);
+
+private:
+    void showResult(const QList<WaylandDebug::FrameAnalysis::Surface> &surfaces);
+    QTreeWidgetItem *metricItem(WaylandDebug::FrameAnalysis::Metric metric,
+                                const WaylandDebug::FrameAnalysis::Series &series);
+
+    static constexpr int OutlierCount = 10;
+
+    const WaylandDebug::Model *m_model = nullptr;
+    QTreeWidget *m_tree;
+    QLabel *m_status;
+    int m_run = 0; // results of older runs are dropped
+};
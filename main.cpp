@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "mainwindow.h"
+#include "waylanddebug.h"
 
 #include <QTimer>
 #include <QApplication>
@@ -17,16 +18,48 @@ int main(int argc, char **argv)
 
     QCommandLineParser clp;
     clp.addHelpOption();
-    clp.addPositionalArgument(u"logfile"_s, u"The path to the logfile"_s);
+    clp.addPositionalArgument(u"logfile"_s, u"The path to the logfile, - for stdin. Several logs are merged by time."_s,
+                              u"logfile..."_s);
+    QCommandLineOption followOption({ u"f"_s, u"follow"_s },
+                                    u"Keep reading what gets appended to the log"_s);
+    clp.addOption(followOption);
+    QCommandLineOption ringBufferOption(u"ring-buffer"_s,
+                                        u"Only keep the last <messages> messages"_s, u"messages"_s);
+    clp.addOption(ringBufferOption);
+    QCommandLineOption noCacheOption(u"no-cache"_s,
+                                     u"Neither read nor write the .wlacache sidecar of the log"_s);
+    clp.addOption(noCacheOption);
+    QCommandLineOption clockOffsetOption(u"clock-offset"_s,
+                                         u"Add <µs> to the timestamps of the n-th log, when merging logs from "
+                                         "different clocks (once per log)"_s, u"µs"_s);
+    clp.addOption(clockOffsetOption);
+    QCommandLineOption statsOption(u"stats"_s,
+                                   u"Show throughput, peak memory and filter/sort timings"_s);
+    clp.addOption(statsOption);
 
     QApplication a(argc, argv);
     clp.process(a);
     MainWindow w;
+    w.setUseTraceCache(!clp.isSet(noCacheOption));
+    w.setShowStats(clp.isSet(statsOption));
 
     const QStringList logfiles = clp.positionalArguments();
-    QTimer::singleShot(0, &w, [&w, logfiles] {
-        for (const auto &logfile : logfiles)
-            w.openFile(logfile);
+    const bool follow = clp.isSet(followOption);
+    const qsizetype ringBufferSize = clp.value(ringBufferOption).toLongLong();
+    const QStringList clockOffsets = clp.values(clockOffsetOption);
+    if ((logfiles.size() > 1) && follow) {
+        qWarning("Merged logs cannot be followed");
+        return 1;
+    }
+    QList<WaylandDebug::LogSource> sources;
+    for (qsizetype i = 0; i < logfiles.size(); ++i)
+        sources.append({ logfiles.at(i), { }, clockOffsets.value(i).toLongLong() });
+
+    QTimer::singleShot(0, &w, [&w, sources, follow, ringBufferSize] {
+        if (sources.size() == 1)
+            w.openFile(sources.constFirst().m_fileName, follow, ringBufferSize);
+        else if (sources.size() > 1)
+            w.openFiles(sources);
     });
 
     w.show();
@@ -5,22 +5,109 @@
 #include <QMenu>
 #include <QTableView>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QDockWidget>
 #include <QHeaderView>
 #include <QClipboard>
+#include <QStatusBar>
+#include <QScrollBar>
+#include <QRandomGenerator>
+#include <QMessageBox>
+#include <QToolButton>
+#include <QProgressBar>
+#include <QTimer>
+#include <cstdio>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QVBoxLayout>
 
 #include "mainwindow.h"
+#include "activitystrip.h"
 #include "extendeddelegate.h"
+#include "exception.h"
+#include "framedock.h"
+#include "perfcounters.h"
+#include "query.h"
 #include "waylanddebug.h"
 #include "ui_filter.h"
 
 using namespace Qt::StringLiterals;
 
+namespace {
+
+// same format as the time column
+QString formatTime(quint64 t)
+{
+    return u"%1'%2.%3"_s
+        .arg(t / 1000 / 1000)
+        .arg(t / 1000 % 1000, 3, 10, QChar('0'))
+        .arg(t % 1000, 3, 10, QChar('0'));
+}
+
+QString objectName(const WaylandDebug::AtomTable &atoms, const WaylandDebug::ObjectRef &object)
+{
+    return u"%1#%2 [%3]"_s.arg(atoms.string(object.m_class)).arg(object.m_instance).arg(object.m_generation);
+}
+
+// every message referring to the object, plus a summary of its lifetime for the status bar
+WaylandDebug::Filter *lifetimeFilter(const WaylandDebug::Model &model, const WaylandDebug::LifetimeIndex::Key &key,
+                                     QString &summary)
+{
+    const auto &atoms = model.atoms();
+    auto *filter = new WaylandDebug::Filter;
+    filter->m_objectMatch = { { atoms.string(key.m_connection), atoms.string(key.m_object.m_class),
+                                key.m_object.m_instance, key.m_object.m_generation } };
+
+    summary = objectName(atoms, key.m_object);
+    if (const auto *lifetime = model.lifetimeIndex().lifetime(key)) {
+        summary = MainWindow::tr("%1: %n message(s), alive from %2 until %3", nullptr, int(lifetime->m_messages.size()))
+                      .arg(summary,
+                           (lifetime->m_created >= 0) ? formatTime(lifetime->m_birth) : MainWindow::tr("before the log"),
+                           (lifetime->m_destroyed >= 0) ? formatTime(lifetime->m_death) : MainWindow::tr("the end"));
+    }
+    return filter;
+}
+
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_table(new QTableView(this))
     , m_filter(new Ui::Filter)
+    , m_filterTimer(new QTimer(this))
+    , m_filterProgress(new QProgressBar(this))
+    , m_loadProgress(new QProgressBar(this))
+    , m_loadCancel(new QToolButton(this))
+    , m_frameDock(new FrameDock(this))
+    , m_activity(new ActivityStrip(this))
+    , m_statsLabel(new QLabel(this))
 {
+    // don't start a new filter run on every key press
+    m_filterTimer->setSingleShot(true);
+    m_filterTimer->setInterval(150);
+    connect(m_filterTimer, &QTimer::timeout, this, &MainWindow::applyFilter);
+
+    m_filterProgress->setMaximumWidth(200);
+    m_filterProgress->setFormat(tr("Filtering %p%"));
+    m_filterProgress->hide();
+    statusBar()->addPermanentWidget(m_filterProgress);
+
+    m_loadProgress->setMaximumWidth(200);
+    m_loadProgress->setFormat(tr("Loading %p%"));
+    m_loadProgress->hide();
+    statusBar()->addPermanentWidget(m_loadProgress);
+    m_loadCancel->setText(tr("Cancel"));
+    m_loadCancel->hide();
+    connect(m_loadCancel, &QToolButton::clicked, this, [this]() {
+        if (m_loader)
+            m_loader->cancel();
+    });
+    statusBar()->addPermanentWidget(m_loadCancel);
+    m_statsLabel->hide();
+    statusBar()->addPermanentWidget(m_statsLabel);
+
     m_table->setCornerButtonEnabled(true);
     m_table->setShowGrid(true);
     m_table->setAlternatingRowColors(true);
@@ -28,9 +115,11 @@ MainWindow::MainWindow(QWidget *parent)
     m_table->setSelectionMode(QAbstractItemView::SingleSelection);
     m_table->setSortingEnabled(true);
     m_table->verticalHeader()->hide();
-    m_table->setItemDelegate(new ExtendedDelegate(WaylandDebug::Model::BackgroundTintRole,
-                                                  WaylandDebug::Model::BackgroundTintWidthRole,
-                                                  m_table));
+    // all rows are one line of text: never let the header measure millions of them
+    m_table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_table->verticalHeader()->setDefaultSectionSize(m_table->fontMetrics().height() + 6);
+    m_table->horizontalHeader()->setResizeContentsPrecision(0);
+    m_table->setItemDelegate(new ExtendedDelegate(WaylandDebug::Model::BackgroundTintRole, m_table));
     connect(m_table, &QTableView::customContextMenuRequested, [this](const QPoint &pos) {
         if (!m_model)
             return;
@@ -46,24 +135,24 @@ MainWindow::MainWindow(QWidget *parent)
             menu.addAction(tr("Set as Filter"), [this, pos]() {
                 auto idx = m_table->indexAt(pos);
                 if (idx.isValid() && m_model) {
-                    const auto *m = m_model->message(idx);
+                    const auto m = m_model->message(idx);
                     auto f = std::make_unique<WaylandDebug::Filter>();
                     switch (idx.column()) {
                     case WaylandDebug::Model::Column::Time:
-                        f->m_timeMin = f->m_timeMax = m->m_time;
+                        f->m_timeMin = f->m_timeMax = m.m_time;
                         break;
                     case WaylandDebug::Model::Column::Direction:
-                        f->m_directionMatch = m->m_direction;
+                        f->m_directionMatch = m.m_direction;
                         break;
                     case WaylandDebug::Model::Column::Object:
-                        f->m_classMatch = { m->m_object.m_class };
-                        f->m_instanceMatch = { m->m_object.m_instance };
+                        f->m_classMatch = { m_model->atoms().string(m.m_object.m_class) };
+                        f->m_instanceMatch = { m.m_object.m_instance };
                         break;
                     case WaylandDebug::Model::Column::Method:
-                        f->m_methodMatch = { m->m_method };
+                        f->m_methodMatch = { m_model->atoms().string(m.m_method) };
                         break;
                     case WaylandDebug::Model::Column::Arguments:
-                        f->m_argumentMatch = m->m_arguments;
+                        f->m_argumentMatch = m.m_arguments;
                         break;
                     }
                     if (f->isEmpty())
@@ -71,12 +160,26 @@ MainWindow::MainWindow(QWidget *parent)
                     setFilter(f.release());
                 }
             });
+            menu.addAction(tr("Follow Object"), [this, pos]() {
+                auto idx = m_table->indexAt(pos);
+                if (idx.isValid() && m_model) {
+                    const auto m = m_model->message(idx);
+                    followObject({ m.m_connection, m.m_object });
+                }
+            });
         }
         menu.exec(m_table->viewport()->mapToGlobal(pos));
     });
     m_table->setContextMenuPolicy(Qt::CustomContextMenu);
 
-    setCentralWidget(m_table);
+    auto *central = new QWidget(this);
+    auto *centralLayout = new QVBoxLayout(central);
+    centralLayout->setContentsMargins(0, 0, 0, 0);
+    centralLayout->setSpacing(0);
+    centralLayout->addWidget(m_activity);
+    centralLayout->addWidget(m_table);
+    setCentralWidget(central);
+    connect(m_activity, &ActivityStrip::timeRangeActivated, this, &MainWindow::showTimeRange);
 
     QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(tr("&Open..."), QKeySequence::Open, this, [this]() {
@@ -84,9 +187,24 @@ MainWindow::MainWindow(QWidget *parent)
         if (!file.isEmpty())
             openFile(file);
     });
+    fileMenu->addAction(tr("&Merge..."), this, [this]() {
+        const QStringList files = QFileDialog::getOpenFileNames(this, tr("Merge Log Files"));
+        QList<WaylandDebug::LogSource> sources;
+        for (const auto &file : files)
+            sources.append({ file });
+        if (!sources.isEmpty())
+            openFiles(sources);
+    });
     fileMenu->addSeparator();
     fileMenu->addAction(tr("&Quit"), QKeySequence::Quit, this, [this]() { close(); });
 
+    QMenu *toolsMenu = menuBar()->addMenu(tr("&Tools"));
+    toolsMenu->addAction(tr("&Leak Report..."), this, &MainWindow::showLeakReport);
+    toolsMenu->addAction(tr("Analyze &Frames"), this, [this]() {
+        m_frameDock->show();
+        m_frameDock->analyze();
+    });
+
     QDockWidget *dock = new QDockWidget(tr("Filter"), this);
     dock->setAllowedAreas(Qt::TopDockWidgetArea | Qt::BottomDockWidgetArea);
     dock->setFeatures(QDockWidget::DockWidgetMovable);
@@ -95,44 +213,322 @@ MainWindow::MainWindow(QWidget *parent)
     dock->setWidget(inner);
     addDockWidget(Qt::BottomDockWidgetArea, dock, Qt::Horizontal);
 
+    addDockWidget(Qt::RightDockWidgetArea, m_frameDock);
+    m_frameDock->hide();
+    connect(m_frameDock, &FrameDock::messageActivated, this, &MainWindow::showMessage);
+    toolsMenu->addAction(m_frameDock->toggleViewAction());
+
     connectFilter();
 }
 
 
 MainWindow::~MainWindow()
-{ }
-
-void MainWindow::openFile(const QString &fileName)
-{
-    WaylandDebug::Parser parser(fileName);
-    auto *model = parser.parse();
-    if (model) {
-        m_table->setModel(model);
-        m_model.reset(model);
-        setWindowFilePath(fileName);
-        m_table->resizeColumnsToContents();
-
-        if (auto *hh = m_table->horizontalHeader()) {
-            hh->setSectionResizeMode(WaylandDebug::Model::Time, QHeaderView::ResizeToContents);
-            hh->setSectionResizeMode(WaylandDebug::Model::Direction, QHeaderView::ResizeToContents);
-            hh->setSectionResizeMode(WaylandDebug::Model::Object, QHeaderView::Interactive);
-            hh->setSectionResizeMode(WaylandDebug::Model::Method, QHeaderView::Interactive);
-            hh->setSectionResizeMode(WaylandDebug::Model::Arguments, QHeaderView::Interactive);
-            hh->setSectionResizeMode(WaylandDebug::Model::TimeDelta, QHeaderView::Stretch);
+{
+    // stop feeding the model before it goes away
+    m_loader.reset();
+}
+
+void MainWindow::openFile(const QString &fileName, bool follow, qsizetype ringBufferSize)
+{
+    open({ WaylandDebug::LogSource { fileName } }, follow, ringBufferSize);
+}
+
+void MainWindow::openFiles(const QList<WaylandDebug::LogSource> &sources)
+{
+    open(sources, false, 0);
+}
+
+void MainWindow::open(const QList<WaylandDebug::LogSource> &sources, bool follow, qsizetype ringBufferSize)
+{
+    // the old loader still feeds the old model
+    m_loader.reset();
+
+    auto *model = new WaylandDebug::Model;
+    m_table->setModel(model);
+    m_model.reset(model);
+    m_frameDock->setModel(model);
+    m_activity->setModel(model);
+    connect(m_table->verticalScrollBar(), &QScrollBar::valueChanged, model,
+            [this, model, last = m_table->verticalScrollBar()->value()](int value) mutable {
+        // format the next page in scroll direction, before it gets painted
+        const int top = std::max(0, m_table->rowAt(0));
+        const int bottom = m_table->rowAt(m_table->viewport()->height() - 1);
+        const int page = ((bottom >= top) ? bottom - top : 0) + 1;
+        if (value >= last)
+            model->prefetch((bottom >= 0 ? bottom : top) + 1, (bottom >= 0 ? bottom : top) + page);
+        else
+            model->prefetch(top - page, top - 1);
+        last = value;
+    });
+    connect(model, &QAbstractItemModel::layoutChanged, this, &MainWindow::updateStats);
+    connect(model, &WaylandDebug::Model::filteringChanged, this, [this](bool running) {
+        if (!running)
+            updateStats();
+        m_filterProgress->setRange(0, 0);
+        m_filterProgress->setVisible(running);
+    });
+    connect(model, &WaylandDebug::Model::filterProgressChanged, this, [this](int value, int maximum) {
+        m_filterProgress->setRange(0, maximum);
+        m_filterProgress->setValue(value);
+    });
+    if (sources.size() == 1) {
+        setWindowTitle({ });
+        setWindowFilePath(sources.constFirst().m_fileName);
+    } else {
+        QStringList names;
+        for (const auto &source : sources)
+            names << QFileInfo(source.m_fileName).fileName();
+        setWindowFilePath({ });
+        setWindowTitle(names.join(u" + "_s));
+    }
+
+    if (auto *hh = m_table->horizontalHeader()) {
+        hh->setSectionResizeMode(WaylandDebug::Model::Time, QHeaderView::Interactive);
+        hh->setSectionResizeMode(WaylandDebug::Model::Direction, QHeaderView::Interactive);
+        hh->setSectionResizeMode(WaylandDebug::Model::Object, QHeaderView::Interactive);
+        hh->setSectionResizeMode(WaylandDebug::Model::Method, QHeaderView::Interactive);
+        hh->setSectionResizeMode(WaylandDebug::Model::Arguments, QHeaderView::Interactive);
+        hh->setSectionResizeMode(WaylandDebug::Model::TimeDelta, QHeaderView::Stretch);
+    }
+
+    m_loader = std::make_unique<WaylandDebug::Loader>(sources, model);
+    m_loadClock.start();
+    m_loadTime = 0;
+    m_bytesLoaded = 0;
+    m_loader->setFollow(follow);
+    m_loader->setRingBufferSize(ringBufferSize);
+    m_loader->setUseTraceCache(m_useTraceCache);
+    auto loadingDone = [this]() {
+        m_loadProgress->hide();
+        m_loadCancel->hide();
+    };
+
+    connect(m_loader.get(), &WaylandDebug::Loader::progressChanged,
+            this, [this, sized = false](qint64 bytesRead, qint64 bytesTotal) mutable {
+        m_bytesLoaded = bytesRead;
+        const bool following = m_loader && m_loader->isFollowing();
+        if (following) {
+            // nothing to show progress for
+        } else if (bytesTotal > 0) {
+            m_loadProgress->setRange(0, 1000);
+            m_loadProgress->setValue(int(bytesRead * 1000 / bytesTotal));
+        } else {
+            m_loadProgress->setRange(0, 0);
         }
+        // size the columns as soon as there is something to look at
+        if (!sized && m_model && m_model->rowCount({ })) {
+            resizeColumnsToSample();
+            sized = true;
+        }
+        const int messages = int(m_model->messages().size());
+        statusBar()->showMessage(following ? tr("Following: %n message(s)", nullptr, messages)
+                                           : tr("Loading: %n message(s)", nullptr, messages));
+    });
+    connect(m_loader.get(), &WaylandDebug::Loader::followingStarted, this, [this]() {
+        m_loadProgress->hide();
+        m_loadCancel->setText(tr("Stop"));
+        resizeColumnsToSample();
+        statusBar()->showMessage(tr("Following: %n message(s)", nullptr, int(m_model->messages().size())));
+    });
+    connect(m_loader.get(), &WaylandDebug::Loader::finished, this, [this, loadingDone](bool canceled) {
+        loadingDone();
+        resizeColumnsToSample();
+
+        const auto &arena = m_model->arena();
+        QString message = tr("%n message(s), argument arena: %1 used / %2 allocated in %3 blocks", nullptr,
+                             int(m_model->messages().size()))
+                              .arg(locale().formattedDataSize(arena.bytesUsed()),
+                                   locale().formattedDataSize(arena.bytesAllocated()))
+                              .arg(arena.blockCount());
+        if (canceled)
+            message = tr("Loading canceled") + u" – "_s + message;
+        statusBar()->showMessage(message);
+        m_loadTime = m_loadClock.nsecsElapsed();
+        updateStats();
+        if (m_showStats)
+            std::fprintf(stderr, "%s\n", qPrintable(stats()));
+        if (m_frameDock->isVisible())
+            m_frameDock->analyze();
+    });
+    connect(m_loader.get(), &WaylandDebug::Loader::failed, this, [this, loadingDone](const QString &errorString) {
+        loadingDone();
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, tr("Error"), errorString);
+    });
+
+    m_loadProgress->setValue(0);
+    m_loadProgress->show();
+    m_loadCancel->setText(tr("Cancel"));
+    m_loadCancel->show();
+    m_loader->start();
+}
+
+void MainWindow::followObject(const WaylandDebug::LifetimeIndex::Key &key)
+{
+    if (!m_model)
+        return;
+    QString summary;
+    setFilter(lifetimeFilter(*m_model, key, summary));
+    statusBar()->showMessage(summary);
+}
+
+void MainWindow::showLeakReport()
+{
+    if (!m_model)
+        return;
+    const auto &atoms = m_model->atoms();
+    const auto &lifetimes = m_model->lifetimeIndex();
+    const auto leaks = lifetimes.leaks();
+
+    auto *dialog = new QDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->setWindowTitle(tr("Leak Report"));
+    auto *layout = new QVBoxLayout(dialog);
+    auto *summary = new QLabel(tr("%n object(s) created, but never destroyed. "
+                                  "Double-click one to follow it.", nullptr, int(leaks.size())), dialog);
+    layout->addWidget(summary);
+
+    auto *tree = new QTreeWidget(dialog);
+    tree->setRootIsDecorated(false);
+    tree->setHeaderLabels({ tr("Object"), tr("Connection"), tr("Created"), tr("Messages") });
+    QList<QTreeWidgetItem *> items;
+    items.reserve(leaks.size());
+    for (const auto &key : leaks) {
+        const auto *lifetime = lifetimes.lifetime(key);
+        auto *item = new QTreeWidgetItem({ objectName(atoms, key.m_object), atoms.string(key.m_connection),
+                                           formatTime(lifetime->m_birth), QString::number(lifetime->m_messages.size()) });
+        item->setTextAlignment(3, Qt::AlignRight);
+        item->setData(0, Qt::UserRole, items.size());
+        items.append(item);
+    }
+    tree->addTopLevelItems(items);
+    for (int column = 0; column < tree->columnCount(); ++column)
+        tree->resizeColumnToContents(column);
+    layout->addWidget(tree);
+    connect(tree, &QTreeWidget::itemActivated, this, [this, leaks](QTreeWidgetItem *item) {
+        followObject(leaks.value(item->data(0, Qt::UserRole).toInt()));
+    });
+
+    auto *buttons = new QDialogButtonBox(QDialogButtonBox::Close, dialog);
+    connect(buttons, &QDialogButtonBox::rejected, dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    dialog->resize(600, 400);
+    dialog->show();
+}
+
+void MainWindow::showMessage(int ordinal)
+{
+    if (!m_model)
+        return;
+    const QModelIndex index = m_model->indexForOrdinal(ordinal, WaylandDebug::Model::Time);
+    if (!index.isValid()) {
+        statusBar()->showMessage(tr("Message %1 is hidden by the filter").arg(ordinal));
+        return;
+    }
+    m_table->setCurrentIndex(index);
+    m_table->scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+void MainWindow::showTimeRange(quint64 from, quint64 to)
+{
+    if (!m_model)
+        return;
+
+    // jump right away if the first message is visible already, the filter takes a moment
+    int first = 0;
+    int last = 0;
+    if (m_model->messageIndex().timeRange(m_model->messages(), from, to, first, last) && (first < last)) {
+        const QModelIndex index = m_model->indexForOrdinal(first, WaylandDebug::Model::Time);
+        if (index.isValid()) {
+            m_table->setCurrentIndex(index);
+            m_table->scrollTo(index, QAbstractItemView::PositionAtTop);
+        }
+    }
+    m_filter->timeMin->setText(QString::number(from));
+    m_filter->timeMax->setText(QString::number(to));
+    m_filterTimer->stop();
+    applyFilter();
+}
+
+void MainWindow::setShowStats(bool show)
+{
+    m_showStats = show;
+    m_statsLabel->setVisible(show);
+    updateStats();
+}
+
+QString MainWindow::stats() const
+{
+    using WaylandDebug::PerfCounters;
+    auto duration = [](qint64 ns) { return tr("%1 ms").arg(double(ns) / 1e6, 0, 'f', 1); };
+
+    QStringList parts;
+    if (m_model && (m_loadTime > 0)) {
+        const double seconds = double(m_loadTime) / 1e9;
+        parts << tr("%1 msg/s").arg(locale().toString(qint64(double(m_model->messages().size()) / seconds)))
+              << tr("%1/s").arg(locale().formattedDataSize(qint64(double(m_bytesLoaded) / seconds)));
+    }
+    for (auto counter : { PerfCounters::Filter, PerfCounters::Sort, PerfCounters::TimeDelta }) {
+        if (PerfCounters::count(counter))
+            parts << u"%1 %2"_s.arg(PerfCounters::name(counter), duration(PerfCounters::last(counter)));
+    }
+    if (const qint64 rss = PerfCounters::peakResidentSize())
+        parts << tr("peak RSS %1").arg(locale().formattedDataSize(rss));
+    return parts.join(u" · "_s);
+}
+
+void MainWindow::updateStats()
+{
+    if (m_showStats)
+        m_statsLabel->setText(stats());
+}
+
+void MainWindow::resizeColumnsToSample(int sampleSize)
+{
+    // resizeColumnsToContents() would measure every single row: only look at the first, the
+    // last and a few random ones
+    auto *model = m_table->model();
+    if (!model)
+        return;
+    const int rows = model->rowCount({ });
+
+    QList<int> sample;
+    for (int row = 0; row < std::min(rows, sampleSize); ++row)
+        sample << row << (rows - 1 - row);
+    if (rows > 2 * sampleSize) {
+        for (int i = 0; i < sampleSize; ++i)
+            sample << QRandomGenerator::global()->bounded(rows);
+    }
+
+    QStyleOptionViewItem option;
+    option.initFrom(m_table->viewport());
+    option.font = m_table->font();
+    option.fontMetrics = m_table->fontMetrics();
+
+    auto *hh = m_table->horizontalHeader();
+    const int maxWidth = std::max(100, m_table->viewport()->width() / 2);
+    for (int column = 0; column < model->columnCount({ }); ++column) {
+        int width = hh->sectionSizeHint(column);
+        for (int row : std::as_const(sample)) {
+            const QModelIndex idx = model->index(row, column);
+            width = std::max(width, m_table->itemDelegateForIndex(idx)->sizeHint(option, idx).width());
+        }
+        hh->resizeSection(column, std::min(width + (m_table->showGrid() ? 1 : 0), maxWidth));
     }
 }
 
 void MainWindow::connectFilter()
 {
     connect(m_filter->direction, &QComboBox::currentIndexChanged, this, &MainWindow::reFilter);
-    connect(m_filter->timeMin, &QSpinBox::valueChanged, this, &MainWindow::reFilter);
-    connect(m_filter->timeMax, &QSpinBox::valueChanged, this, &MainWindow::reFilter);
+    connect(m_filter->timeMin, &QLineEdit::textEdited, this, &MainWindow::reFilter);
+    connect(m_filter->timeMax, &QLineEdit::textEdited, this, &MainWindow::reFilter);
     connect(m_filter->classes, &QLineEdit::textEdited, this, &MainWindow::reFilter);
     connect(m_filter->instances, &QLineEdit::textEdited, this, &MainWindow::reFilter);
     connect(m_filter->methods, &QLineEdit::textEdited, this, &MainWindow::reFilter);
     connect(m_filter->arguments, &QLineEdit::textEdited, this, &MainWindow::reFilter);
     connect(m_filter->lifetime, &QLineEdit::textEdited, this, &MainWindow::reFilter);
+    connect(m_filter->query, &QLineEdit::textEdited, this, &MainWindow::reFilter);
+    connect(m_filter->toQuery, &QToolButton::clicked, this, &MainWindow::moveFieldsToQuery);
     connect(m_filter->clear, &QToolButton::clicked, this, &MainWindow::clearFilter);
 }
 
@@ -145,8 +541,8 @@ void MainWindow::setFilter(WaylandDebug::Filter *filter)
 {
     m_resettingFilter = true;
     m_filter->direction->setCurrentIndex(filter ? int(filter->m_directionMatch) : 0);
-    m_filter->timeMin->setValue(filter ? filter->m_timeMin : 0);
-    m_filter->timeMax->setValue(filter ? filter->m_timeMax : 0);
+    m_filter->timeMin->setText((filter && filter->m_timeMin) ? QString::number(filter->m_timeMin) : QString { });
+    m_filter->timeMax->setText((filter && filter->m_timeMax) ? QString::number(filter->m_timeMax) : QString { });
     m_filter->classes->setText(filter ? filter->m_classMatch.join(u' ') : QString { });
     QStringList sl;
     if (filter) {
@@ -157,9 +553,13 @@ void MainWindow::setFilter(WaylandDebug::Filter *filter)
     m_filter->methods->setText(filter ? filter->m_methodMatch.join(u' ') : QString { });
     m_filter->arguments->setText(filter ? filter->m_argumentMatch.join(u' ') : QString { });
     m_filter->lifetime->setText(filter ? (filter->m_createClassMatch + filter->m_destroyClassMatch).join(u' ') : QString { });
+    m_filter->query->setText(filter ? filter->m_query : QString { });
     m_resettingFilter = false;
-    m_model->setFilter(filter);
-    reFilter();
+    m_filterTimer->stop();
+    if (m_model)
+        m_model->setFilter(filter);
+    else
+        delete filter;
 }
 
 void MainWindow::reFilter()
@@ -168,7 +568,48 @@ void MainWindow::reFilter()
         return;
     if (m_resettingFilter)
         return;
+    m_filterTimer->start();
+}
+
+void MainWindow::applyFilter()
+{
+    if (!m_model)
+        return;
+
+    auto f = filterFromFields();
+    if (!f->m_query.isEmpty()) {
+        try {
+            WaylandDebug::Query::parse(f->m_query);
+        } catch (const Exception &e) {
+            // keep the current filter until the query is complete
+            statusBar()->showMessage(tr("Invalid query: %1").arg(e.errorString()), 5000);
+            return;
+        }
+    }
 
+    if (f->isEmpty())
+        f.reset();
+    m_model->setFilter(f.release());
+}
+
+void MainWindow::moveFieldsToQuery()
+{
+    QString query = filterFromFields()->toQuery();
+    const QString current = m_filter->query->text().trimmed();
+    if (!current.isEmpty())
+        query = query.isEmpty() ? current : u"%1 AND (%2)"_s.arg(query, current);
+
+    auto *f = new WaylandDebug::Filter;
+    f->m_query = query;
+    if (f->isEmpty()) {
+        delete f;
+        f = nullptr;
+    }
+    setFilter(f);
+}
+
+std::unique_ptr<WaylandDebug::Filter> MainWindow::filterFromFields() const
+{
     auto f = std::make_unique<WaylandDebug::Filter>();
 
     int directionIndex = m_filter->direction->currentIndex();
@@ -180,12 +621,9 @@ void MainWindow::reFilter()
         f->m_instanceMatch.append(iid.toUInt());
     f->m_methodMatch = m_filter->methods->text().simplified().split(u" "_s, Qt::SkipEmptyParts);
     f->m_argumentMatch = m_filter->arguments->text().simplified().split(u" "_s, Qt::SkipEmptyParts);
-    f->m_timeMin = m_filter->timeMin->value();
-    f->m_timeMax = m_filter->timeMax->value();
+    f->m_timeMin = m_filter->timeMin->text().trimmed().toULongLong();
+    f->m_timeMax = m_filter->timeMax->text().trimmed().toULongLong();
     f->m_createClassMatch = f->m_destroyClassMatch = m_filter->lifetime->text().simplified().split(u" "_s, Qt::SkipEmptyParts);
-
-
-    if (f->isEmpty())
-        f.reset();
-    m_model->setFilter(f.release());
+    f->m_query = m_filter->query->text().trimmed();
+    return f;
 }
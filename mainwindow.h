@@ -3,16 +3,21 @@
 
 #pragma once
 
+#include <QElapsedTimer>
 #include <QMainWindow>
 
+#include "waylanddebug.h"
+
 QT_FORWARD_DECLARE_CLASS(QTableView)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+QT_FORWARD_DECLARE_CLASS(QProgressBar)
+QT_FORWARD_DECLARE_CLASS(QToolButton)
+QT_FORWARD_DECLARE_CLASS(QLabel)
 
-namespace Ui {
-class Filter;
-}
+class FrameDock;
+class ActivityStrip;
 
-namespace WaylandDebug {
-class Model;
+namespace Ui {
 class Filter;
 }
 
@@ -24,16 +29,46 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow() override;
 
-    void openFile(const QString &fileName);
+    // follow keeps appending what gets written to the log, "-" is stdin
+    void openFile(const QString &fileName, bool follow = false, qsizetype ringBufferSize = 0);
+    // merges the logs by time into one view
+    void openFiles(const QList<WaylandDebug::LogSource> &sources);
+    void setUseTraceCache(bool use) { m_useTraceCache = use; }
+    // throughput, memory and filter/sort timings in the status bar and on stderr
+    void setShowStats(bool show);
 
 private:
+    void open(const QList<WaylandDebug::LogSource> &sources, bool follow, qsizetype ringBufferSize);
+    void resizeColumnsToSample(int sampleSize = 100);
     void connectFilter();
     void reFilter();
+    void applyFilter();
+    std::unique_ptr<WaylandDebug::Filter> filterFromFields() const;
+    void moveFieldsToQuery();
     void clearFilter();
     void setFilter(WaylandDebug::Filter *filter);
+    void followObject(const WaylandDebug::LifetimeIndex::Key &key);
+    void showLeakReport();
+    void showMessage(int ordinal);
+    void showTimeRange(quint64 from, quint64 to);
+    QString stats() const;
+    void updateStats();
 
     QTableView *m_table;
     std::unique_ptr<WaylandDebug::Model> m_model;
     std::unique_ptr<Ui::Filter> m_filter;
     bool m_resettingFilter = false;
+    bool m_useTraceCache = true;
+    QTimer *m_filterTimer;
+    QProgressBar *m_filterProgress;
+    QProgressBar *m_loadProgress;
+    QToolButton *m_loadCancel;
+    FrameDock *m_frameDock;
+    ActivityStrip *m_activity;
+    QLabel *m_statsLabel;
+    bool m_showStats = false;
+    QElapsedTimer m_loadClock;
+    qint64 m_loadTime = 0; // in ns
+    qint64 m_bytesLoaded = 0;
+    std::unique_ptr<WaylandDebug::Loader> m_loader; // declared after m_model, so it is destroyed first
 };
@@ -0,0 +1,90 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <array>
+#include <atomic>
+
+#include "perfcounters.h"
+
+#if defined(Q_OS_UNIX)
+#  include <sys/resource.h>
+#endif
+
+
+using namespace Qt::StringLiterals;
+
+namespace WaylandDebug {
+
+namespace {
+
+struct Counters
+{
+    std::atomic<qint64> m_count = 0;
+    std::atomic<qint64> m_total = 0;
+    std::atomic<qint64> m_last = 0;
+};
+
+std::array<Counters, PerfCounters::CounterCount> counters;
+
+} // namespace
+
+QString PerfCounters::name(Counter counter)
+{
+    switch (counter) {
+    case Parse:     return u"parse"_s;
+    case Filter:    return u"filter"_s;
+    case Sort:      return u"sort"_s;
+    case TimeDelta: return u"time delta"_s;
+    default:        return { };
+    }
+}
+
+void PerfCounters::add(Counter counter, qint64 nsecs)
+{
+    auto &c = counters[counter];
+    c.m_count.fetch_add(1, std::memory_order_relaxed);
+    c.m_total.fetch_add(nsecs, std::memory_order_relaxed);
+    c.m_last.store(nsecs, std::memory_order_relaxed);
+}
+
+void PerfCounters::reset()
+{
+    for (auto &c : counters) {
+        c.m_count = 0;
+        c.m_total = 0;
+        c.m_last = 0;
+    }
+}
+
+qint64 PerfCounters::count(Counter counter)
+{
+    return counters[counter].m_count.load(std::memory_order_relaxed);
+}
+
+qint64 PerfCounters::total(Counter counter)
+{
+    return counters[counter].m_total.load(std::memory_order_relaxed);
+}
+
+qint64 PerfCounters::last(Counter counter)
+{
+    return counters[counter].m_last.load(std::memory_order_relaxed);
+}
+
+qint64 PerfCounters::peakResidentSize()
+{
+#if defined(Q_OS_UNIX)
+    rusage usage { };
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#  if defined(Q_OS_DARWIN)
+    return qint64(usage.ru_maxrss); // already in bytes
+#  else
+    return qint64(usage.ru_maxrss) * 1024;
+#  endif
+#else
+    return 0;
+#endif
+}
+
+} // namespace WaylandDebug
@@ -0,0 +1,52 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+
+namespace WaylandDebug {
+
+// Wall clock time spent in the expensive steps, for --stats and wlanalyze-bench. The counters
+// are global and lock free, so they are cheap enough to be always on.
+class PerfCounters
+{
+public:
+    enum Counter {
+        Parse,
+        Filter,
+        Sort,
+        TimeDelta,
+
+        CounterCount
+    };
+    static QString name(Counter counter);
+
+    static void add(Counter counter, qint64 nsecs);
+    static void reset();
+    static qint64 count(Counter counter);
+    static qint64 total(Counter counter); // in ns
+    static qint64 last(Counter counter);  // in ns
+
+    // the high water mark of this process' resident memory in bytes, 0 if unknown
+    static qint64 peakResidentSize();
+
+    // adds the time until it goes out of scope
+    class Scope
+    {
+    public:
+        explicit Scope(Counter counter)
+            : m_counter(counter)
+        {
+            m_timer.start();
+        }
+        ~Scope() { add(m_counter, m_timer.nsecsElapsed()); }
+
+    private:
+        Counter m_counter;
+        QElapsedTimer m_timer;
+    };
+};
+
+} // namespace WaylandDebug
@@ -0,0 +1,891 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <numeric>
+
+#include <QHash>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include "query.h"
+#include "bitmapscan.h"
+#include "exception.h"
+
+
+using namespace Qt::StringLiterals;
+
+namespace WaylandDebug {
+
+namespace {
+
+using Postings = MessageIndex::Postings;
+
+Postings range(int first, int last)
+{
+    Postings result(std::max(0, last - first));
+    std::iota(result.begin(), result.end(), first);
+    return result;
+}
+
+Postings cut(const Postings &postings, int first, int last)
+{
+    const auto from = std::lower_bound(postings.cbegin(), postings.cend(), first);
+    const auto to = std::lower_bound(from, postings.cend(), last);
+    return postings.sliced(from - postings.cbegin(), to - from);
+}
+
+bool isIndexed(Query::Field field)
+{
+    switch (field) {
+    case Query::Class:
+    case Query::Instance:
+    case Query::Method:
+    case Query::Argument:
+    case Query::CreatedClass:
+    case Query::DestroyedClass:
+        return true;
+    default:
+        return false;
+    }
+}
+
+MessageIndex::Field indexField(Query::Field field)
+{
+    switch (field) {
+    case Query::Class:          return MessageIndex::Class;
+    case Query::Instance:       return MessageIndex::Instance;
+    case Query::CreatedClass:   return MessageIndex::CreatedClass;
+    case Query::DestroyedClass: return MessageIndex::DestroyedClass;
+    default:                    return MessageIndex::Method;
+    }
+}
+
+} // namespace
+
+
+// recursive descent, with the position for the error messages
+class Query::Parser
+{
+public:
+    explicit Parser(const QString &text)
+        : m_text(text)
+    { }
+
+    Node parse()
+    {
+        skipSpace();
+        if (atEnd())
+            return { };
+        Node node = parseOr();
+        skipSpace();
+        if (!atEnd())
+            fail("unbalanced ')'");
+        return node;
+    }
+
+private:
+    [[noreturn]] void fail(const char *what, qsizetype pos = -1) const
+    {
+        throw Exception("%1 at column %2").arg(QString::fromUtf8(what)).arg(((pos < 0) ? m_pos : pos) + 1);
+    }
+
+    bool atEnd() const { return m_pos >= m_text.size(); }
+    QChar peek() const { return m_text.at(m_pos); }
+    static bool isDelimiter(QChar c) { return c.isSpace() || (c == u'(') || (c == u')') || (c == u'"'); }
+
+    void skipSpace()
+    {
+        while (!atEnd() && peek().isSpace())
+            ++m_pos;
+    }
+
+    bool symbol(QStringView str)
+    {
+        if (!QStringView(m_text).sliced(m_pos).startsWith(str))
+            return false;
+        m_pos += str.size();
+        return true;
+    }
+
+    // AND, OR and NOT in any case, but only as whole words
+    bool keyword(QLatin1StringView word)
+    {
+        skipSpace();
+        const qsizetype end = m_pos + word.size();
+        if ((end > m_text.size()) || QStringView(m_text).sliced(m_pos, word.size()).compare(word, Qt::CaseInsensitive))
+            return false;
+        if ((end < m_text.size()) && !isDelimiter(m_text.at(end)))
+            return false;
+        m_pos = end;
+        return true;
+    }
+
+    bool isOr()
+    {
+        const qsizetype pos = m_pos;
+        skipSpace();
+        const bool result = keyword("OR"_L1) || symbol(u"||");
+        m_pos = pos;
+        return result;
+    }
+
+    static void append(Node &parent, Node &&child)
+    {
+        if (child.m_kind == parent.m_kind)
+            std::move(child.m_children.begin(), child.m_children.end(), std::back_inserter(parent.m_children));
+        else
+            parent.m_children.push_back(std::move(child));
+    }
+
+    Node parseOr()
+    {
+        Node first = parseAnd();
+        if (!isOr())
+            return first;
+        Node node;
+        node.m_kind = Kind::Or;
+        append(node, std::move(first));
+        while (isOr()) {
+            skipSpace();
+            if (!keyword("OR"_L1))
+                symbol(u"||");
+            append(node, parseAnd());
+        }
+        return node;
+    }
+
+    Node parseAnd()
+    {
+        Node node;
+        node.m_kind = Kind::And;
+        for (;;) {
+            append(node, parseUnary());
+            skipSpace();
+            if (atEnd() || (peek() == u')') || isOr())
+                break;
+            if (!keyword("AND"_L1))
+                symbol(u"&&");
+        }
+        if (node.m_children.size() == 1)
+            return std::move(node.m_children.front());
+        return node;
+    }
+
+    Node parseUnary()
+    {
+        skipSpace();
+        if (atEnd())
+            fail("expected a term");
+        if (keyword("NOT"_L1) || symbol(u"!")) {
+            Node node;
+            node.m_kind = Kind::Not;
+            node.m_children.push_back(parseUnary());
+            return node;
+        }
+        if (symbol(u"(")) {
+            Node node = parseOr();
+            skipSpace();
+            if (atEnd() || !symbol(u")"))
+                fail("expected ')'");
+            return node;
+        }
+        return parseTerm();
+    }
+
+    Node parseTerm()
+    {
+        static const QHash<QString, Field> fields = {
+            { u"time"_s, Time }, { u"connection"_s, Connection }, { u"conn"_s, Connection },
+            { u"queue"_s, Queue }, { u"direction"_s, Direction }, { u"dir"_s, Direction },
+            { u"class"_s, Class }, { u"instance"_s, Instance }, { u"id"_s, Instance },
+            { u"method"_s, Method }, { u"arg"_s, Argument }, { u"argument"_s, Argument },
+            { u"created"_s, CreatedClass }, { u"destroyed"_s, DestroyedClass },
+        };
+
+        const qsizetype start = m_pos;
+        while (!atEnd() && (peek().isLetter() || (peek() == u'_')))
+            ++m_pos;
+        if (atEnd() || (peek() != u':'))
+            fail("expected <field>:<value>", start);
+        const QString name = m_text.sliced(start, m_pos - start).toLower();
+        const auto it = fields.constFind(name);
+        if (it == fields.cend())
+            throw Exception("unknown field '%1' at column %2").arg(name).arg(start + 1);
+        ++m_pos;
+
+        Node node;
+        node.m_kind = Kind::Term;
+        node.m_field = *it;
+        if (node.m_field == Time) {
+            parseTime(node);
+            return node;
+        }
+        do {
+            const qsizetype valueStart = m_pos;
+            const QString value = parseValue();
+            if (node.m_field == Instance) {
+                bool ok = false;
+                node.m_instances.append(value.toUInt(&ok));
+                if (!ok)
+                    fail("expected an instance id", valueStart);
+            } else if (node.m_field == Direction) {
+                if (value == u"request")
+                    node.m_directions.append(quint8(Direction::ToCompositor));
+                else if (value == u"event")
+                    node.m_directions.append(quint8(Direction::FromCompositor));
+                else
+                    fail("expected request or event", valueStart);
+            } else {
+                node.m_values.append(value);
+            }
+        } while (symbol(u","));
+        return node;
+    }
+
+    QString parseValue()
+    {
+        if (!atEnd() && (peek() == u'"')) {
+            const qsizetype start = m_pos++;
+            QString value;
+            for (;;) {
+                if (atEnd())
+                    fail("unterminated string", start);
+                QChar c = m_text.at(m_pos++);
+                if (c == u'"')
+                    break;
+                if ((c == u'\\') && !atEnd())
+                    c = m_text.at(m_pos++);
+                value.append(c);
+            }
+            return value;
+        }
+        const qsizetype start = m_pos;
+        while (!atEnd() && !isDelimiter(peek()) && (peek() != u','))
+            ++m_pos;
+        if (m_pos == start)
+            fail("expected a value");
+        return m_text.sliced(start, m_pos - start);
+    }
+
+    quint64 parseNumber()
+    {
+        const qsizetype start = m_pos;
+        while (!atEnd() && peek().isDigit())
+            ++m_pos;
+        bool ok = false;
+        const quint64 number = m_text.sliced(start, m_pos - start).toULongLong(&ok);
+        if (!ok)
+            fail("expected a time in µs", start);
+        return number;
+    }
+
+    void parseTime(Node &node)
+    {
+        if (symbol(u">=")) {
+            node.m_timeMin = parseNumber();
+        } else if (symbol(u">")) {
+            const quint64 time = parseNumber();
+            if (time < std::numeric_limits<quint64>::max()) {
+                node.m_timeMin = time + 1;
+            } else { // nothing is later than that
+                node.m_timeMin = 1;
+                node.m_timeMax = 0;
+            }
+        } else if (symbol(u"<=")) {
+            node.m_timeMax = parseNumber();
+        } else if (symbol(u"<")) {
+            const quint64 time = parseNumber();
+            if (time) {
+                node.m_timeMax = time - 1;
+            } else { // nothing is earlier than that
+                node.m_timeMin = 1;
+                node.m_timeMax = 0;
+            }
+        } else {
+            symbol(u"=");
+            const bool hasMin = !atEnd() && peek().isDigit();
+            const quint64 min = hasMin ? parseNumber() : 0;
+            if (symbol(u"..")) {
+                node.m_timeMin = min;
+                if (!atEnd() && peek().isDigit())
+                    node.m_timeMax = parseNumber();
+                else if (!hasMin)
+                    fail("expected a time in µs");
+            } else if (hasMin) {
+                node.m_timeMin = node.m_timeMax = min;
+            } else {
+                fail("expected a time in µs");
+            }
+        }
+        if (!atEnd() && !isDelimiter(peek()))
+            fail("unexpected character");
+    }
+
+    const QString &m_text;
+    qsizetype m_pos = 0;
+};
+
+
+QString Query::fieldName(Field field)
+{
+    switch (field) {
+    case Time:           return u"time"_s;
+    case Connection:     return u"connection"_s;
+    case Queue:          return u"queue"_s;
+    case Direction:      return u"direction"_s;
+    case Class:          return u"class"_s;
+    case Instance:       return u"instance"_s;
+    case Method:         return u"method"_s;
+    case Argument:       return u"arg"_s;
+    case CreatedClass:   return u"created"_s;
+    case DestroyedClass: return u"destroyed"_s;
+    default:             return { };
+    }
+}
+
+Query Query::parse(const QString &text)
+{
+    Query query;
+    query.m_root = Parser(text).parse();
+    return query;
+}
+
+Query Query::nothing()
+{
+    Query query;
+    query.m_root.m_constant = false;
+    return query;
+}
+
+QString Query::quoted(const QString &value)
+{
+    const bool plain = !value.isEmpty() && std::none_of(value.cbegin(), value.cend(), [](QChar c) {
+        return c.isSpace() || (c == u',') || (c == u'(') || (c == u')') || (c == u'"') || (c == u'\\');
+    });
+    if (plain)
+        return value;
+    QString result = value;
+    result.replace(u'\\', u"\\\\"_s).replace(u'"', u"\\\""_s);
+    return u'"' + result + u'"';
+}
+
+bool Query::isEmpty() const
+{
+    return (m_root.m_kind == Kind::Constant) && m_root.m_constant;
+}
+
+bool Query::uses(Field field) const
+{
+    return uses(m_root, field);
+}
+
+bool Query::uses(const Node &node, Field field)
+{
+    if (node.m_kind == Kind::Term)
+        return node.m_field == field;
+    return std::any_of(node.m_children.cbegin(), node.m_children.cend(), [field](const Node &child) {
+        return uses(child, field);
+    });
+}
+
+QString Query::toString() const
+{
+    return toString(m_root, Kind::Or);
+}
+
+QString Query::toString(const Node &node, Kind parent)
+{
+    switch (node.m_kind) {
+    case Kind::Constant:
+        return node.m_constant ? QString { } : u"NOT time:>=0"_s;
+    case Kind::Term: {
+        QStringList values;
+        if (node.m_field == Time) {
+            if (node.m_timeMin == node.m_timeMax)
+                values << QString::number(node.m_timeMin);
+            else if (node.m_timeMax == std::numeric_limits<quint64>::max())
+                values << u">="_s + QString::number(node.m_timeMin);
+            else if (!node.m_timeMin)
+                values << u"<="_s + QString::number(node.m_timeMax);
+            else
+                values << u"%1..%2"_s.arg(node.m_timeMin).arg(node.m_timeMax);
+        }
+        for (uint instance : node.m_instances)
+            values << QString::number(instance);
+        for (quint8 direction : node.m_directions)
+            values << ((direction == quint8(Direction::ToCompositor)) ? u"request"_s : u"event"_s);
+        for (const auto &value : node.m_values)
+            values << quoted(value);
+        return fieldName(node.m_field) + u':' + values.join(u',');
+    }
+    case Kind::Not:
+        return u"NOT "_s + toString(node.m_children.front(), Kind::Not);
+    case Kind::And:
+    case Kind::Or: {
+        QStringList children;
+        for (const auto &child : node.m_children)
+            children << toString(child, node.m_kind);
+        const QString str = children.join((node.m_kind == Kind::And) ? u" AND "_s : u" OR "_s);
+        // NOT binds stronger than AND, which binds stronger than OR
+        const bool inner = (parent == Kind::Not) || ((parent == Kind::And) && (node.m_kind == Kind::Or));
+        return inner ? (u'(' + str + u')') : str;
+    }
+    }
+    return { };
+}
+
+bool Query::isScan(const Node &node)
+{
+    return (node.m_kind == Kind::Term)
+           && ((node.m_field == Direction) || (node.m_field == Connection) || (node.m_field == Queue));
+}
+
+int Query::cost(const Node &node)
+{
+    // of a single row: arguments have to be split up, creations and destructions looked up
+    if (node.m_kind != Kind::Term)
+        return 3;
+    if (node.m_field == Argument)
+        return 2;
+    if ((node.m_field == CreatedClass) || (node.m_field == DestroyedClass))
+        return 1;
+    return 0;
+}
+
+void Query::compile(const AtomTable &atoms, const ArgumentCache *arguments, const MessageIndex *index,
+                    const MessageStore *store)
+{
+    m_argumentCache = arguments;
+    m_index = index;
+    m_rows = store ? store->size() : 0;
+    m_plan = plan(m_root, atoms);
+    estimate(m_plan, store);
+}
+
+Query::Node Query::plan(const Node &node, const AtomTable &atoms)
+{
+    auto constant = [](bool value) {
+        Node result;
+        result.m_constant = value;
+        return result;
+    };
+
+    switch (node.m_kind) {
+    case Kind::Constant:
+        return node;
+
+    case Kind::Term: {
+        Node term = node;
+        switch (node.m_field) {
+        case Time:
+            if (term.m_timeMin > term.m_timeMax)
+                return constant(false);
+            break;
+        case Argument:
+            for (const auto &value : node.m_values)
+                term.m_bytes.append(value.toUtf8());
+            break;
+        case Instance:
+        case Direction:
+            break;
+        default:
+            // names that are not in the log can never match
+            for (const auto &value : node.m_values) {
+                const Atom atom = atoms.find(value);
+                if ((atom != AtomTable::NoAtom) && !term.m_atoms.contains(atom))
+                    term.m_atoms.append(atom);
+            }
+            if (term.m_atoms.isEmpty())
+                return constant(false);
+            break;
+        }
+        return term;
+    }
+
+    case Kind::Not: {
+        Node child = plan(node.m_children.front(), atoms);
+        if (child.m_kind == Kind::Constant)
+            return constant(!child.m_constant);
+        if (child.m_kind == Kind::Not)
+            return std::move(child.m_children.front());
+        Node result;
+        result.m_kind = Kind::Not;
+        result.m_children.push_back(std::move(child));
+        return result;
+    }
+
+    case Kind::And:
+    case Kind::Or: {
+        const bool isAnd = (node.m_kind == Kind::And);
+        Node result;
+        result.m_kind = node.m_kind;
+        for (const auto &c : node.m_children) {
+            Node child = plan(c, atoms);
+            if (child.m_kind == Kind::Constant) {
+                if (child.m_constant != isAnd) // false in an AND, true in an OR
+                    return child;
+                continue;
+            }
+            if (child.m_kind == node.m_kind)
+                std::move(child.m_children.begin(), child.m_children.end(), std::back_inserter(result.m_children));
+            else
+                result.m_children.push_back(std::move(child));
+        }
+
+        // terms on the same field merge: time windows narrow in an AND, value lists grow in an OR
+        auto &children = result.m_children;
+        for (size_t i = 0; i < children.size(); ++i) {
+            Node &term = children[i];
+            if ((term.m_kind != Kind::Term) || (isAnd != (term.m_field == Time)))
+                continue;
+            for (size_t j = i + 1; j < children.size(); ) {
+                const Node &other = children[j];
+                if ((other.m_kind != Kind::Term) || (other.m_field != term.m_field)) {
+                    ++j;
+                    continue;
+                }
+                if (isAnd) {
+                    term.m_timeMin = std::max(term.m_timeMin, other.m_timeMin);
+                    term.m_timeMax = std::min(term.m_timeMax, other.m_timeMax);
+                } else {
+                    term.m_values.append(other.m_values);
+                    term.m_instances.append(other.m_instances);
+                    term.m_directions.append(other.m_directions);
+                    term.m_atoms.append(other.m_atoms);
+                    term.m_bytes.append(other.m_bytes);
+                }
+                children.erase(children.begin() + qsizetype(j));
+            }
+            if (isAnd && (term.m_timeMin > term.m_timeMax))
+                return constant(false);
+        }
+
+        if (children.empty())
+            return constant(isAnd);
+        if (children.size() == 1)
+            return std::move(children.front());
+        return result;
+    }
+    }
+    return node;
+}
+
+void Query::estimate(Node &node, const MessageStore *store) const
+{
+    switch (node.m_kind) {
+    case Kind::Constant:
+        node.m_estimate = node.m_constant ? m_rows : 0;
+        break;
+
+    case Kind::Term: {
+        node.m_estimate = m_rows;
+        int first = 0;
+        int last = 0;
+        if ((node.m_field == Time) && store && timeRange(node, *store, first, last)) {
+            node.m_estimate = last - first;
+        } else if (isIndexed(node.m_field) && m_index) {
+            qsizetype matches = 0;
+            if (node.m_field == Argument) {
+                for (const auto &bytes : node.m_bytes)
+                    matches += m_index->argumentPostings(bytes).size();
+            } else if (node.m_field == Instance) {
+                for (uint instance : node.m_instances)
+                    matches += m_index->postings(MessageIndex::Instance, instance).size();
+            } else {
+                for (Atom atom : node.m_atoms)
+                    matches += m_index->postings(indexField(node.m_field), atom).size();
+            }
+            node.m_estimate = std::min(matches, m_rows);
+        }
+        break;
+    }
+
+    case Kind::Not:
+        estimate(node.m_children.front(), store);
+        node.m_estimate = m_rows;
+        break;
+
+    case Kind::And:
+    case Kind::Or: {
+        for (auto &child : node.m_children)
+            estimate(child, store);
+        if (node.m_kind == Kind::And) {
+            // the most selective first, so the intersections only get cheaper. Without an
+            // index all estimates are the same and the cheapest check goes first.
+            std::stable_sort(node.m_children.begin(), node.m_children.end(), [](const Node &n1, const Node &n2) {
+                return (n1.m_estimate != n2.m_estimate) ? (n1.m_estimate < n2.m_estimate) : (cost(n1) < cost(n2));
+            });
+            node.m_estimate = node.m_children.front().m_estimate;
+        } else {
+            qsizetype matches = 0;
+            for (const auto &child : node.m_children)
+                matches += child.m_estimate;
+            node.m_estimate = std::min(matches, m_rows);
+        }
+        break;
+    }
+    }
+}
+
+bool Query::timeRange(const Node &node, const MessageStore &store, int &first, int &last) const
+{
+    // MessageIndex::timeRange() takes 0 as no limit: only ask it whether the log is in time order
+    if (!m_index || !m_index->timeRange(store, 0, 0, first, last))
+        return false;
+    const auto begin = store.m_time.cbegin();
+    const auto from = std::lower_bound(begin, store.m_time.cend(), node.m_timeMin);
+    const auto to = std::upper_bound(from, store.m_time.cend(), node.m_timeMax);
+    first = int(from - begin);
+    last = int(to - begin);
+    return true;
+}
+
+bool Query::match(const MessageStore &store, qsizetype i) const
+{
+    if ((i < 0) || (i >= store.size()))
+        return false;
+    return match(m_plan, store, i);
+}
+
+bool Query::match(const Node &node, const MessageStore &store, qsizetype i) const
+{
+    auto anyClass = [&node](std::span<const ObjectRef> objects) {
+        return std::any_of(objects.begin(), objects.end(), [&node](const ObjectRef &o) {
+            return node.m_atoms.contains(o.m_class);
+        });
+    };
+
+    switch (node.m_kind) {
+    case Kind::Constant:
+        return node.m_constant;
+    case Kind::And:
+        return std::all_of(node.m_children.cbegin(), node.m_children.cend(), [&](const Node &child) {
+            return match(child, store, i);
+        });
+    case Kind::Or:
+        return std::any_of(node.m_children.cbegin(), node.m_children.cend(), [&](const Node &child) {
+            return match(child, store, i);
+        });
+    case Kind::Not:
+        return !match(node.m_children.front(), store, i);
+    case Kind::Term:
+        break;
+    }
+
+    switch (node.m_field) {
+    case Time: {
+        const quint64 time = store.m_time.at(i);
+        return (time >= node.m_timeMin) && (time <= node.m_timeMax);
+    }
+    case Connection:     return node.m_atoms.contains(store.m_connection.at(i));
+    case Queue:          return node.m_atoms.contains(store.m_queue.at(i));
+    case Direction:      return node.m_directions.contains(quint8(store.m_direction.at(i)));
+    case Class:          return node.m_atoms.contains(store.m_object.at(i).m_class);
+    case Instance:       return node.m_instances.contains(store.m_object.at(i).m_instance);
+    case Method:         return node.m_atoms.contains(store.m_method.at(i));
+    case CreatedClass:   return anyClass(store.created(i));
+    case DestroyedClass: return anyClass(store.destroyed(i));
+    case Argument: {
+        const auto args = m_argumentCache ? m_argumentCache->texts(store, i) : store.argumentList(i);
+        return std::any_of(args.cbegin(), args.cend(), [&node](QByteArrayView arg) {
+            return std::any_of(node.m_bytes.cbegin(), node.m_bytes.cend(),
+                               [arg](const QByteArray &bytes) { return QByteArrayView(bytes) == arg; });
+        });
+    }
+    default:
+        return false;
+    }
+}
+
+Postings Query::evaluate(const MessageStore &store, int first, int last, const Postings *within) const
+{
+    first = std::max(first, 0);
+    last = std::min(last, int(store.size()));
+    if (first >= last)
+        return { };
+    return evaluate(m_plan, store, first, last, within);
+}
+
+Postings Query::evaluate(const Node &node, const MessageStore &store, int first, int last,
+                         const Postings *within) const
+{
+    switch (node.m_kind) {
+    case Kind::Constant:
+        if (!node.m_constant)
+            return { };
+        return within ? cut(*within, first, last) : range(first, last);
+
+    case Kind::Term:
+        return evaluateTerm(node, store, first, last, within);
+
+    case Kind::And:
+        return evaluateAnd(node, store, first, last, within);
+
+    case Kind::Or: {
+        QList<Postings> lists;
+        for (const auto &child : node.m_children)
+            lists.append(evaluate(child, store, first, last, within));
+        return MessageIndex::unite(lists);
+    }
+
+    case Kind::Not: {
+        const Postings base = within ? cut(*within, first, last) : range(first, last);
+        const Postings excluded = evaluate(node.m_children.front(), store, first, last, &base);
+        Postings result;
+        result.reserve(base.size() - excluded.size());
+        std::set_difference(base.cbegin(), base.cend(), excluded.cbegin(), excluded.cend(),
+                            std::back_inserter(result));
+        return result;
+    }
+    }
+    return { };
+}
+
+Postings Query::evaluateTerm(const Node &node, const MessageStore &store, int first, int last,
+                             const Postings *within) const
+{
+    if (isScan(node))
+        return scan({ &node }, store, first, last, within);
+
+    if (node.m_field == Time) {
+        int timeFirst = 0;
+        int timeLast = 0;
+        if (!timeRange(node, store, timeFirst, timeLast))
+            return filtered(node, store, first, last, within);
+        timeFirst = std::max(timeFirst, first);
+        timeLast = std::min(timeLast, last);
+        if (timeFirst >= timeLast)
+            return { };
+        return within ? cut(*within, timeFirst, timeLast) : range(timeFirst, timeLast);
+    }
+
+    if (!m_index)
+        return filtered(node, store, first, last, within);
+
+    QList<Postings> lists;
+    if (node.m_field == Argument) {
+        for (const auto &bytes : node.m_bytes)
+            lists.append(m_index->argumentPostings(bytes));
+    } else if (node.m_field == Instance) {
+        for (uint instance : node.m_instances)
+            lists.append(m_index->postings(MessageIndex::Instance, instance));
+    } else {
+        for (Atom atom : node.m_atoms)
+            lists.append(m_index->postings(indexField(node.m_field), atom));
+    }
+    const Postings postings = cut(MessageIndex::unite(lists), first, last);
+    return within ? MessageIndex::intersect(postings, *within) : postings;
+}
+
+Postings Query::evaluateAnd(const Node &node, const MessageStore &store, int first, int last,
+                            const Postings *within) const
+{
+    // time windows just narrow the range for everything else, connection, queue and direction
+    // go into one scan at the end
+    std::vector<const Node *> children;
+    std::vector<const Node *> scans;
+    for (const auto &child : node.m_children) {
+        int timeFirst = 0;
+        int timeLast = 0;
+        if ((child.m_kind == Kind::Term) && (child.m_field == Time) && timeRange(child, store, timeFirst, timeLast)) {
+            first = std::max(first, timeFirst);
+            last = std::min(last, timeLast);
+        } else if (isScan(child)) {
+            scans.push_back(&child);
+        } else {
+            children.push_back(&child);
+        }
+    }
+    if (first >= last)
+        return { };
+
+    Postings candidates;
+    bool hasCandidates = false;
+    if (within) {
+        candidates = cut(*within, first, last);
+        hasCandidates = true;
+    }
+    for (const Node *child : children) {
+        if (hasCandidates && candidates.isEmpty())
+            return candidates;
+        if (hasCandidates && (candidates.size() * 8 <= child->m_estimate)) {
+            // only a few left: cheaper to check them one by one
+            candidates.removeIf([&](int o) { return !match(*child, store, o); });
+        } else {
+            candidates = evaluate(*child, store, first, last, hasCandidates ? &candidates : nullptr);
+            hasCandidates = true;
+        }
+    }
+    if (!scans.empty() && (!hasCandidates || !candidates.isEmpty())) {
+        candidates = scan(scans, store, first, last, hasCandidates ? &candidates : nullptr);
+        hasCandidates = true;
+    }
+    return hasCandidates ? candidates : range(first, last);
+}
+
+Postings Query::scan(const std::vector<const Node *> &terms, const MessageStore &store, int first, int last,
+                     const Postings *within) const
+{
+    auto matchAll = [&](int o) {
+        return std::all_of(terms.cbegin(), terms.cend(), [&](const Node *term) { return match(*term, store, o); });
+    };
+
+    const qsizetype rows = last - first;
+    if (within && (within->size() * 8 <= rows)) {
+        Postings result = cut(*within, first, last);
+        result.removeIf([&](int o) { return !matchAll(o); });
+        return result;
+    }
+
+    static constexpr qsizetype ChunkRows = 64 * 1024; // a multiple of 64
+
+    BitmapScan::Bitmap bits(BitmapScan::words(rows));
+    QList<qsizetype> chunks;
+    for (qsizetype from = 0; from < rows; from += ChunkRows)
+        chunks.append(from);
+
+    QtConcurrent::blockingMap(chunks, [&](qsizetype from) {
+        const qsizetype offset = first + from;
+        const qsizetype count = std::min(ChunkRows, rows - from);
+        quint64 *chunkBits = bits.data() + from / 64;
+        bool intersect = false;
+
+        for (const Node *term : terms) {
+            if (term->m_field == Direction) {
+                static_assert(sizeof(WaylandDebug::Direction) == sizeof(quint8));
+                BitmapScan::matchBytes(reinterpret_cast<const quint8 *>(store.m_direction.constData()) + offset, count,
+                                       std::span<const quint8>(term->m_directions.constData(), size_t(term->m_directions.size())),
+                                       chunkBits, intersect);
+            } else {
+                const auto &column = (term->m_field == Connection) ? store.m_connection : store.m_queue;
+                BitmapScan::matchAtoms(column.constData() + offset, count,
+                                       std::span<const Atom>(term->m_atoms.constData(), size_t(term->m_atoms.size())),
+                                       chunkBits, intersect);
+            }
+            intersect = true;
+        }
+    });
+
+    Postings result;
+    if (within) {
+        result = cut(*within, first, last);
+        result.removeIf([&bits, first](int o) { return !BitmapScan::test(bits, o - first); });
+    } else {
+        result = BitmapScan::toOrdinals(bits.constData(), rows);
+        if (first) {
+            for (int &o : result)
+                o += first;
+        }
+    }
+    return result;
+}
+
+Postings Query::filtered(const Node &node, const MessageStore &store, int first, int last,
+                         const Postings *within) const
+{
+    Postings result = within ? cut(*within, first, last) : range(first, last);
+    result.removeIf([&](int o) { return !match(node, store, o); });
+    return result;
+}
+
+} // namespace WaylandDebug
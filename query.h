@@ -0,0 +1,119 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "waylanddebug.h"
+
+namespace WaylandDebug {
+
+// Filter expressions with boolean logic, e.g.
+//     (method:commit OR method:attach) AND NOT queue:default AND time:>1200000
+// Terms are <field>:<value>, a comma separated list of values means any of them. Time also
+// takes >, >=, <, <= and a..b ranges. Terms next to each other are ANDed, AND binds stronger
+// than OR and NOT (or !) stronger than both. Values with spaces, commas or parentheses need
+// "quotes".
+//
+// compile() turns the parsed expression into a plan: unknown names fold into constants, ORs of
+// one field become one term with several values and the children of every AND are ordered by
+// their estimated number of matches. evaluate() then resolves the indexed fields through the
+// MessageIndex postings, a time window through the time order of the log and connection,
+// queue and direction through a single bitmap scan over their columns. Once only a few
+// candidates are left, the remaining terms are checked row by row instead.
+class Query
+{
+public:
+    enum Field : quint8 {
+        Time,
+        Connection,
+        Queue,
+        Direction,
+        Class,
+        Instance,
+        Method,
+        Argument,
+        CreatedClass,
+        DestroyedClass,
+
+        FieldCount
+    };
+    static QString fieldName(Field field);
+
+    // an empty query matches everything. Syntax errors throw an Exception with the column.
+    static Query parse(const QString &text);
+    // a query that does not match anything, e.g. in place of one that did not parse
+    static Query nothing();
+    // value as it has to be written in a query
+    static QString quoted(const QString &value);
+
+    bool isEmpty() const;
+    bool uses(Field field) const;
+    // the parsed expression with explicit ANDs and only the necessary parentheses
+    QString toString() const;
+
+    void compile(const AtomTable &atoms, const ArgumentCache *arguments = nullptr,
+                 const MessageIndex *index = nullptr, const MessageStore *store = nullptr);
+    // only valid after compile() with index and store: the ascending ordinals in [first, last)
+    // that match, ANDed with within if given
+    MessageIndex::Postings evaluate(const MessageStore &store, int first, int last,
+                                    const MessageIndex::Postings *within = nullptr) const;
+    bool match(const MessageStore &store, qsizetype i) const;
+
+private:
+    enum class Kind : quint8 { Constant, Term, And, Or, Not };
+
+    struct Node
+    {
+        Kind m_kind = Kind::Constant;
+        bool m_constant = true;
+        std::vector<Node> m_children;
+
+        Field m_field = Time;
+        QStringList m_values;    // names and arguments, as written
+        QList<uint> m_instances;
+        QList<quint8> m_directions;
+        quint64 m_timeMin = 0;   // inclusive
+        quint64 m_timeMax = std::numeric_limits<quint64>::max();
+
+        // filled in by compile()
+        QList<Atom> m_atoms;
+        QList<QByteArray> m_bytes;
+        qsizetype m_estimate = 0; // upper bound of the matches
+    };
+
+    class Parser;
+
+    static bool isScan(const Node &node);
+    static bool uses(const Node &node, Field field);
+    static QString toString(const Node &node, Kind parent);
+    static int cost(const Node &node);
+    static Node plan(const Node &node, const AtomTable &atoms);
+    void estimate(Node &node, const MessageStore *store) const;
+    bool match(const Node &node, const MessageStore &store, qsizetype i) const;
+    MessageIndex::Postings evaluate(const Node &node, const MessageStore &store, int first, int last,
+                                    const MessageIndex::Postings *within) const;
+    MessageIndex::Postings evaluateTerm(const Node &node, const MessageStore &store, int first, int last,
+                                        const MessageIndex::Postings *within) const;
+    MessageIndex::Postings evaluateAnd(const Node &node, const MessageStore &store, int first, int last,
+                                       const MessageIndex::Postings *within) const;
+    MessageIndex::Postings scan(const std::vector<const Node *> &terms, const MessageStore &store,
+                                int first, int last, const MessageIndex::Postings *within) const;
+    MessageIndex::Postings filtered(const Node &node, const MessageStore &store, int first, int last,
+                                    const MessageIndex::Postings *within) const;
+    bool timeRange(const Node &node, const MessageStore &store, int &first, int &last) const;
+
+    Node m_root;
+    Node m_plan;
+    const ArgumentCache *m_argumentCache = nullptr;
+    const MessageIndex *m_index = nullptr;
+    qsizetype m_rows = 0;
+};
+
+} // namespace WaylandDebug
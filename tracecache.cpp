@@ -0,0 +1,499 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+
+#include "tracecache.h"
+#include "exception.h"
+
+using namespace Qt::StringLiterals;
+
+
+namespace WaylandDebug {
+
+namespace {
+
+constexpr char Magic[8] = { 'W', 'L', 'A', 'C', 'A', 'C', 'H', 'E' };
+constexpr quint32 Version = 1;
+constexpr quint32 ByteOrderMark = 0x01020304; // caches are not portable between byte orders
+constexpr qint64 HashedSize = 1024 * 1024; // at the head and at the tail of the log
+
+// every section starts 8 byte aligned
+enum class Section : quint32 {
+    Atoms,            // count, then length + UTF-8 for every atom
+    Times,            // quint64[rows]
+    Directions,       // quint8[rows]
+    Connections,      // Atom[rows]
+    Queues,           // Atom[rows]
+    Objects,          // PackedRef[rows]
+    Methods,          // Atom[rows]
+    ArgumentOffsets,  // quint64[rows + 1] into ArgumentData
+    ArgumentData,
+    CreatedOffsets,   // quint32[rows + 1] into CreatedPool
+    CreatedPool,      // PackedRef[]
+    DestroyedOffsets, // quint32[rows + 1] into DestroyedPool
+    DestroyedPool,    // PackedRef[]
+    Postings,         // per field: count, then key + count + ordinals for every list
+
+    Count
+};
+
+enum HeaderFlags : quint32 {
+    TimeOrdered = 0x01,
+};
+
+// ObjectRef without the padding
+struct PackedRef
+{
+    quint32 m_class;
+    quint32 m_instance;
+    quint32 m_generation;
+};
+
+struct Header
+{
+    char m_magic[8];
+    quint32 m_version;
+    quint32 m_byteOrder;
+    quint64 m_logSize;
+    qint64 m_logModified; // ms since the epoch
+    quint8 m_logHash[20];
+    quint32 m_flags;
+    quint64 m_rows;
+    struct {
+        quint64 m_offset;
+        quint64 m_size;
+    } m_sections[int(Section::Count)];
+};
+static_assert(sizeof(Header) == 64 + 16 * int(Section::Count));
+
+QByteArray logHash(const QString &logFileName, qint64 size)
+{
+    QFile log(logFileName);
+    if (!log.open(QIODevice::ReadOnly))
+        return { };
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(log.read(HashedSize));
+    if (size > HashedSize) {
+        log.seek(std::max(HashedSize, size - HashedSize));
+        hash.addData(log.read(HashedSize));
+    }
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(&size), sizeof(size)));
+    return hash.result();
+}
+
+QString privateFileName(const QFileInfo &log)
+{
+    const QByteArray key = QCryptographicHash::hash(log.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/traces/"_s
+           + QString::fromLatin1(key.toHex()) + u".wlacache"_s;
+}
+
+// QIODevice::write() is slow for millions of tiny arguments: collect them first
+class Writer
+{
+public:
+    explicit Writer(QIODevice *device)
+        : m_device(device)
+    {
+        m_buffer.reserve(BufferSize);
+    }
+
+    void write(const void *data, qsizetype size)
+    {
+        if (m_buffer.size() + size > BufferSize)
+            flush();
+        if (size >= BufferSize)
+            writeToDevice(data, size);
+        else
+            m_buffer.append(static_cast<const char *>(data), size);
+        m_pos += size;
+    }
+    template <typename T> void write(const T &value) { write(&value, sizeof(T)); }
+    template <typename T> void write(const QList<T> &list) { write(list.constData(), list.size() * qsizetype(sizeof(T))); }
+
+    void align()
+    {
+        static const char zeros[8] = { };
+        write(zeros, (8 - m_pos % 8) % 8);
+    }
+    qint64 pos() const { return m_pos; }
+
+    void flush()
+    {
+        writeToDevice(m_buffer.constData(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+private:
+    static constexpr qsizetype BufferSize = 4 * 1024 * 1024;
+
+    void writeToDevice(const void *data, qsizetype size)
+    {
+        if (size && (m_device->write(static_cast<const char *>(data), size) != size))
+            throw Exception("Could not write the trace cache: %1").arg(m_device->errorString());
+    }
+
+    QIODevice *m_device;
+    QByteArray m_buffer;
+    qint64 m_pos = 0;
+};
+
+// all the reads are bounds checked: a broken cache is just not used
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size, const Header &header)
+        : m_data(reinterpret_cast<const char *>(data))
+        , m_size(size)
+        , m_header(header)
+    { }
+
+    QByteArrayView section(Section s) const
+    {
+        const auto &sec = m_header.m_sections[int(s)];
+        if ((sec.m_offset > quint64(m_size)) || (sec.m_size > quint64(m_size) - sec.m_offset))
+            return { };
+        return QByteArrayView(m_data + sec.m_offset, qsizetype(sec.m_size));
+    }
+
+    template <typename T> bool column(Section s, qsizetype count, QList<T> &list) const
+    {
+        const QByteArrayView data = section(s);
+        if (data.size() != count * qsizetype(sizeof(T)))
+            return false;
+        list.resize(count);
+        if (count)
+            std::memcpy(list.data(), data.data(), size_t(data.size()));
+        return true;
+    }
+
+    // the classes are atoms, so they have to be in [0, atomCount)
+    bool refs(Section s, qsizetype count, quint32 atomCount, QList<ObjectRef> &list) const
+    {
+        QList<PackedRef> packed;
+        if (!column(s, count, packed))
+            return false;
+        list.clear();
+        list.reserve(count);
+        for (const auto &p : std::as_const(packed)) {
+            if (p.m_class >= atomCount)
+                return false;
+            list.append(ObjectRef(Atom(p.m_class), p.m_instance, p.m_generation));
+        }
+        return true;
+    }
+
+private:
+    const char *m_data;
+    qint64 m_size;
+    const Header &m_header;
+};
+
+// a cursor over the variable sized sections
+class Cursor
+{
+public:
+    explicit Cursor(QByteArrayView data)
+        : m_data(data)
+    { }
+
+    bool read(void *to, qsizetype size)
+    {
+        if ((size < 0) || (size > m_data.size() - m_pos))
+            return false;
+        std::memcpy(to, m_data.data() + m_pos, size_t(size));
+        m_pos += size;
+        return true;
+    }
+    template <typename T> bool read(T &value) { return read(&value, sizeof(T)); }
+
+private:
+    QByteArrayView m_data;
+    qsizetype m_pos = 0;
+};
+
+bool atomsValid(const QList<Atom> &atoms, quint32 atomCount)
+{
+    return std::all_of(atoms.cbegin(), atoms.cend(), [atomCount](Atom a) { return a < atomCount; });
+}
+
+bool directionsValid(const QList<Direction> &directions)
+{
+    return std::all_of(directions.cbegin(), directions.cend(), [](Direction d) {
+        return quint8(d) <= quint8(Direction::Unknown);
+    });
+}
+
+// strictly ascending ordinals in [0, rows): the intersections rely on that
+bool postingsValid(const MessageIndex::Postings &list, qsizetype rows)
+{
+    if (list.isEmpty() || (list.constFirst() < 0) || (list.constLast() >= rows))
+        return false;
+    return std::adjacent_find(list.cbegin(), list.cend(), std::greater_equal<int>()) == list.cend();
+}
+
+bool offsetsValid(const QList<quint32> &offsets, qsizetype poolSize)
+{
+    if (offsets.isEmpty() || offsets.constFirst() || (offsets.constLast() != poolSize))
+        return false;
+    return std::is_sorted(offsets.cbegin(), offsets.cend());
+}
+
+bool loadFrom(const QString &cacheFileName, const QFileInfo &log, TraceCache::Content &content)
+{
+    auto file = std::make_shared<QFile>(cacheFileName);
+    if (!file->open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = file->size();
+    if (size < qint64(sizeof(Header)))
+        return false;
+    uchar *mapped = file->map(0, size);
+    if (!mapped)
+        return false;
+    // the mapping goes away together with the last argument that points into it
+    std::shared_ptr<char[]> mapping(reinterpret_cast<char *>(mapped), [file](char *p) {
+        file->unmap(reinterpret_cast<uchar *>(p));
+    });
+
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+    if ((std::memcmp(header.m_magic, Magic, sizeof(Magic)) != 0) || (header.m_version != Version)
+        || (header.m_byteOrder != ByteOrderMark) || (header.m_logSize != quint64(log.size()))) {
+        return false;
+    }
+    if (header.m_logModified != log.lastModified().toMSecsSinceEpoch()) {
+        // touched or copied: only the content counts
+        const QByteArray hash = logHash(log.filePath(), log.size());
+        if ((hash.size() != sizeof(header.m_logHash))
+            || std::memcmp(hash.constData(), header.m_logHash, sizeof(header.m_logHash))) {
+            return false;
+        }
+    }
+
+    const Reader reader(mapped, size, header);
+    const qsizetype rows = qsizetype(header.m_rows);
+    MessageStore ms;
+
+    Cursor atoms(reader.section(Section::Atoms));
+    quint32 atomCount = 0;
+    if (!atoms.read(atomCount) || (atomCount > AtomTable::NoAtom))
+        return false;
+    QStringList atomStrings;
+    atomStrings.reserve(atomCount);
+    for (quint32 a = 0; a < atomCount; ++a) {
+        quint32 length = 0;
+        QByteArray utf8;
+        if (!atoms.read(length) || (length > 0xffff))
+            return false;
+        utf8.resize(length);
+        if (!atoms.read(utf8.data(), length))
+            return false;
+        atomStrings.append(QString::fromUtf8(utf8));
+    }
+    // the model interns them in this order: the empty atom has to come first and a duplicate
+    // would shift all the atoms after it
+    if (atomStrings.isEmpty() || !atomStrings.constFirst().isEmpty()
+        || (QSet<QString>(atomStrings.cbegin(), atomStrings.cend()).size() != atomStrings.size())) {
+        return false;
+    }
+
+    if (!reader.column(Section::Times, rows, ms.m_time)
+        || !reader.column(Section::Directions, rows, ms.m_direction) || !directionsValid(ms.m_direction)
+        || !reader.column(Section::Connections, rows, ms.m_connection) || !atomsValid(ms.m_connection, atomCount)
+        || !reader.column(Section::Queues, rows, ms.m_queue) || !atomsValid(ms.m_queue, atomCount)
+        || !reader.refs(Section::Objects, rows, atomCount, ms.m_object)
+        || !reader.column(Section::Methods, rows, ms.m_method) || !atomsValid(ms.m_method, atomCount)) {
+        return false;
+    }
+
+    // the arguments stay in the mapping
+    QList<quint64> argumentOffsets;
+    const QByteArrayView argumentData = reader.section(Section::ArgumentData);
+    if (!reader.column(Section::ArgumentOffsets, rows + 1, argumentOffsets)
+        || argumentOffsets.constFirst() || (argumentOffsets.constLast() != quint64(argumentData.size()))
+        || !std::is_sorted(argumentOffsets.cbegin(), argumentOffsets.cend())) {
+        return false;
+    }
+    ms.m_arguments.reserve(rows);
+    for (qsizetype i = 0; i < rows; ++i) {
+        const qsizetype length = qsizetype(argumentOffsets.at(i + 1) - argumentOffsets.at(i));
+        ms.m_arguments.append(length ? argumentData.sliced(qsizetype(argumentOffsets.at(i)), length)
+                                     : QByteArrayView { });
+    }
+    ms.m_arena.adopt(mapping, argumentData.size());
+
+    if (!reader.column(Section::CreatedOffsets, rows + 1, ms.m_createdOffsets)
+        || !reader.refs(Section::CreatedPool, reader.section(Section::CreatedPool).size() / qsizetype(sizeof(PackedRef)),
+                        atomCount, ms.m_createdPool)
+        || !offsetsValid(ms.m_createdOffsets, ms.m_createdPool.size())
+        || !reader.column(Section::DestroyedOffsets, rows + 1, ms.m_destroyedOffsets)
+        || !reader.refs(Section::DestroyedPool, reader.section(Section::DestroyedPool).size() / qsizetype(sizeof(PackedRef)),
+                        atomCount, ms.m_destroyedPool)
+        || !offsetsValid(ms.m_destroyedOffsets, ms.m_destroyedPool.size())) {
+        return false;
+    }
+
+    MessageIndex index;
+    Cursor postings(reader.section(Section::Postings));
+    for (auto &lists : index.m_postings) {
+        quint32 keys = 0;
+        if (!postings.read(keys))
+            return false;
+        lists.reserve(keys);
+        for (quint32 k = 0; k < keys; ++k) {
+            quint32 key = 0;
+            quint32 count = 0;
+            MessageIndex::Postings list;
+            if (!postings.read(key) || !postings.read(count) || !count)
+                return false;
+            list.resize(count);
+            if (!postings.read(list.data(), qsizetype(count) * qsizetype(sizeof(int)))
+                || !postingsValid(list, rows)) {
+                return false;
+            }
+            lists.insert(key, list);
+        }
+    }
+    index.m_rows = rows;
+    index.m_timeOrdered = header.m_flags & TimeOrdered;
+
+    content.m_atoms = atomStrings;
+    content.m_messages = ms;
+    content.m_index = index;
+    return true;
+}
+
+} // namespace
+
+
+QString TraceCache::fileName(const QString &logFileName)
+{
+    const QFileInfo log(logFileName);
+    if (QFileInfo(log.absolutePath()).isWritable())
+        return log.absoluteFilePath() + u".wlacache"_s;
+    return privateFileName(log);
+}
+
+bool TraceCache::load(const QString &logFileName, Content &content)
+{
+    const QFileInfo log(logFileName);
+    if (!log.isFile())
+        return false;
+    return loadFrom(log.absoluteFilePath() + u".wlacache"_s, log, content)
+           || loadFrom(privateFileName(log), log, content);
+}
+
+void TraceCache::save(const QString &logFileName, const Content &content)
+{
+    const QFileInfo log(logFileName);
+    const MessageStore &ms = content.m_messages;
+    const qsizetype rows = ms.size();
+
+    // the model's index may be missing a few rows
+    MessageIndex rebuilt;
+    const MessageIndex *index = &content.m_index;
+    if (index->m_rows != rows) {
+        rebuilt.update(ms);
+        index = &rebuilt;
+    }
+
+    Header header { };
+    std::memcpy(header.m_magic, Magic, sizeof(Magic));
+    header.m_version = Version;
+    header.m_byteOrder = ByteOrderMark;
+    header.m_logSize = quint64(log.size());
+    header.m_logModified = log.lastModified().toMSecsSinceEpoch();
+    const QByteArray hash = logHash(logFileName, log.size());
+    if (hash.size() != sizeof(header.m_logHash))
+        throw Exception("Could not read %1").arg(logFileName);
+    std::memcpy(header.m_logHash, hash.constData(), sizeof(header.m_logHash));
+    header.m_flags = index->m_timeOrdered ? TimeOrdered : 0;
+    header.m_rows = quint64(rows);
+
+    const QString cacheFileName = fileName(logFileName);
+    QDir().mkpath(QFileInfo(cacheFileName).absolutePath());
+    QSaveFile file(cacheFileName);
+    if (!file.open(QIODevice::WriteOnly))
+        throw Exception("Could not write the trace cache %1: %2").arg(cacheFileName, file.errorString());
+
+    Writer w(&file);
+    w.write(header); // placeholder, the section table is only known at the end
+
+    auto section = [&](Section s, auto &&writeContent) {
+        w.align();
+        auto &sec = header.m_sections[int(s)];
+        sec.m_offset = quint64(w.pos());
+        writeContent();
+        sec.m_size = quint64(w.pos()) - sec.m_offset;
+    };
+    auto writeRefs = [&w](const QList<ObjectRef> &refs) {
+        for (const auto &o : refs)
+            w.write(PackedRef { o.m_class, o.m_instance, o.m_generation });
+    };
+
+    section(Section::Atoms, [&]() {
+        w.write(quint32(content.m_atoms.size()));
+        for (const auto &str : content.m_atoms) {
+            const QByteArray utf8 = str.toUtf8();
+            w.write(quint32(utf8.size()));
+            w.write(utf8.constData(), utf8.size());
+        }
+    });
+    section(Section::Times, [&]() { w.write(ms.m_time); });
+    section(Section::Directions, [&]() { w.write(ms.m_direction); });
+    section(Section::Connections, [&]() { w.write(ms.m_connection); });
+    section(Section::Queues, [&]() { w.write(ms.m_queue); });
+    section(Section::Objects, [&]() { writeRefs(ms.m_object); });
+    section(Section::Methods, [&]() { w.write(ms.m_method); });
+    section(Section::ArgumentOffsets, [&]() {
+        quint64 offset = 0;
+        w.write(offset);
+        for (qsizetype i = 0; i < rows; ++i) {
+            offset += quint64(ms.arguments(i).size());
+            w.write(offset);
+        }
+    });
+    section(Section::ArgumentData, [&]() {
+        for (qsizetype i = 0; i < rows; ++i)
+            w.write(ms.arguments(i).data(), ms.arguments(i).size());
+    });
+    section(Section::CreatedOffsets, [&]() { w.write(ms.m_createdOffsets); });
+    section(Section::CreatedPool, [&]() { writeRefs(ms.m_createdPool); });
+    section(Section::DestroyedOffsets, [&]() { w.write(ms.m_destroyedOffsets); });
+    section(Section::DestroyedPool, [&]() { writeRefs(ms.m_destroyedPool); });
+    section(Section::Postings, [&]() {
+        for (const auto &lists : index->m_postings) {
+            // sorted keys: the same log always gives the same cache
+            QList<uint> keys = lists.keys();
+            std::sort(keys.begin(), keys.end());
+            w.write(quint32(keys.size()));
+            for (uint key : std::as_const(keys)) {
+                const auto &list = *lists.constFind(key);
+                w.write(quint32(key));
+                w.write(quint32(list.size()));
+                w.write(list);
+            }
+        }
+    });
+    w.flush();
+
+    if (!file.seek(0) || (file.write(reinterpret_cast<const char *>(&header), sizeof(Header)) != sizeof(Header))
+        || !file.commit()) {
+        throw Exception("Could not write the trace cache %1: %2").arg(cacheFileName, file.errorString());
+    }
+}
+
+} // namespace WaylandDebug
@@ -0,0 +1,38 @@
+// Copyright (C) 2025 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+#include "waylanddebug.h"
+
+namespace WaylandDebug {
+
+// A binary sidecar with everything the parser and the indexer produced for a log: the atoms,
+// the message columns, the raw arguments and the postings lists. Reopening the log only maps
+// the sidecar, the arguments are even used straight from the mapping.
+// The sidecar is tied to the size of the log and a hash over its head and tail, so it can be
+// handed over together with the log. The modification time just saves the hashing when it
+// matches.
+class TraceCache
+{
+public:
+    struct Content
+    {
+        QStringList m_atoms;
+        MessageStore m_messages;
+        MessageIndex m_index;
+    };
+
+    // next to the log, or in the user's cache directory if that is not writable
+    static QString fileName(const QString &logFileName);
+
+    // false if there is no cache for the log as it is right now, or if it is unusable
+    static bool load(const QString &logFileName, Content &content);
+    // throws an Exception on errors
+    static void save(const QString &logFileName, const Content &content);
+};
+
+} // namespace WaylandDebug
@@ -2,68 +2,602 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <string_view>
+#include <tuple>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <cstdio>
+#include <queue>
 
 #include <QIODevice>
+#include <QMutex>
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QScopeGuard>
 #include <QRegularExpression>
 #include <QColor>
-#include <QtConcurrent/QtConcurrentFilter>
+#include <QThread>
+#include <QThreadPool>
+#include <QPromise>
+#include <QVarLengthArray>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+
+// Q_OS_UNIX is only known after the first Qt header
+#if defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <unistd.h>
+#endif
 
 #include "waylanddebug.h"
+#include "backgroundtint.h"
+#include "bitmapscan.h"
+#include "decompressor.h"
 #include "exception.h"
+#include "perfcounters.h"
+#include "query.h"
+#include "tracecache.h"
 
 
 using namespace Qt::StringLiterals;
 
 namespace WaylandDebug {
 
-ObjectRef::ObjectRef(const QString &class_, uint instance, uint generation)
+AtomTable::AtomTable()
+{
+    m_strings.append(QString { });
+    m_atoms.insert(QString { }, EmptyAtom);
+}
+
+Atom AtomTable::intern(const QString &str)
+{
+    auto it = m_atoms.constFind(str);
+    if (it != m_atoms.cend())
+        return it.value();
+    if (m_strings.size() >= NoAtom)
+        throw Exception("too many distinct class, method, connection and queue names");
+    Atom atom = Atom(m_strings.size());
+    m_strings.append(str);
+    m_atoms.insert(str, atom);
+    return atom;
+}
+
+Atom AtomTable::find(const QString &str) const
+{
+    return m_atoms.value(str, NoAtom);
+}
+
+QList<uint> AtomTable::ranks() const
+{
+    QList<Atom> sorted(m_strings.size());
+    std::iota(sorted.begin(), sorted.end(), Atom(0));
+    std::sort(sorted.begin(), sorted.end(), [this](Atom a1, Atom a2) {
+        return m_strings.at(a1).compare(m_strings.at(a2)) < 0;
+    });
+    QList<uint> ranks(m_strings.size());
+    for (qsizetype i = 0; i < sorted.size(); ++i)
+        ranks[sorted.at(i)] = uint(i);
+    return ranks;
+}
+
+ObjectRef::ObjectRef(Atom class_, uint instance, uint generation)
     : m_class(class_)
     , m_instance(instance)
     , m_generation(generation)
 { }
 
 
-Model::~Model()
+Arena::Arena(const Arena &other)
+    : m_blocks(other.m_blocks)
+    , m_bytesUsed(other.m_bytesUsed)
+    , m_bytesAllocated(other.m_bytesAllocated)
+{ }
+
+Arena::Arena(Arena &&other) noexcept
+    : m_blocks(std::move(other.m_blocks))
+    , m_current(std::exchange(other.m_current, nullptr))
+    , m_left(std::exchange(other.m_left, 0))
+    , m_bytesUsed(std::exchange(other.m_bytesUsed, 0))
+    , m_bytesAllocated(std::exchange(other.m_bytesAllocated, 0))
+{ }
+
+Arena &Arena::operator=(const Arena &other)
+{
+    if (this != &other) {
+        m_blocks = other.m_blocks;
+        m_current = nullptr; // the tail of the last block belongs to other
+        m_left = 0;
+        m_bytesUsed = other.m_bytesUsed;
+        m_bytesAllocated = other.m_bytesAllocated;
+    }
+    return *this;
+}
+
+Arena &Arena::operator=(Arena &&other) noexcept
+{
+    if (this != &other) {
+        m_blocks = std::move(other.m_blocks);
+        other.m_blocks.clear();
+        m_current = std::exchange(other.m_current, nullptr);
+        m_left = std::exchange(other.m_left, 0);
+        m_bytesUsed = std::exchange(other.m_bytesUsed, 0);
+        m_bytesAllocated = std::exchange(other.m_bytesAllocated, 0);
+    }
+    return *this;
+}
+
+char *Arena::allocate(qsizetype size)
+{
+    if (size > m_left) {
+        const qsizetype blockSize = std::max(size, BlockSize);
+        // no make_shared: that would zero-initialize the block
+        m_blocks.append(std::shared_ptr<char[]>(new char[size_t(blockSize)]));
+        m_current = m_blocks.constLast().get();
+        m_left = blockSize;
+        m_bytesAllocated += blockSize;
+    }
+    char *p = m_current;
+    m_current += size;
+    m_left -= size;
+    m_bytesUsed += size;
+    return p;
+}
+
+QByteArrayView Arena::store(QByteArrayView data)
+{
+    if (data.isEmpty())
+        return { };
+    char *p = allocate(data.size());
+    std::memcpy(p, data.data(), size_t(data.size()));
+    return QByteArrayView(p, data.size());
+}
+
+void Arena::adopt(const Arena &other)
+{
+    // keep allocating into our own current block
+    m_blocks.append(other.m_blocks);
+    m_bytesUsed += other.m_bytesUsed;
+    m_bytesAllocated += other.m_bytesAllocated;
+}
+
+void Arena::adopt(std::shared_ptr<char[]> block, qsizetype size)
+{
+    m_blocks.append(std::move(block));
+    m_bytesUsed += size;
+    m_bytesAllocated += size;
+}
+
+void Arena::clear()
+{
+    *this = Arena();
+}
+
+
+MessageStore::MessageStore()
+    : m_createdOffsets({ 0 })
+    , m_destroyedOffsets({ 0 })
+{ }
+
+void MessageStore::clear()
+{
+    *this = MessageStore();
+}
+
+void MessageStore::append(const MessageStore &other)
+{
+    auto appendOffsets = [](auto &offsets, const auto &otherOffsets) {
+        const auto base = offsets.constLast();
+        offsets.reserve(offsets.size() + otherOffsets.size() - 1);
+        for (qsizetype i = 1; i < otherOffsets.size(); ++i)
+            offsets.append(base + otherOffsets.at(i));
+    };
+
+    m_time.append(other.m_time);
+    m_direction.append(other.m_direction);
+    m_connection.append(other.m_connection);
+    m_queue.append(other.m_queue);
+    m_object.append(other.m_object);
+    m_method.append(other.m_method);
+    m_arena.adopt(other.m_arena);
+    m_arguments.append(other.m_arguments);
+    appendOffsets(m_createdOffsets, other.m_createdOffsets);
+    m_createdPool.append(other.m_createdPool);
+    appendOffsets(m_destroyedOffsets, other.m_destroyedOffsets);
+    m_destroyedPool.append(other.m_destroyedPool);
+}
+
+MessageStore MessageStore::mid(qsizetype from) const
+{
+    from = std::clamp<qsizetype>(from, 0, size());
+    MessageStore result;
+    auto copyOffsets = [from, this](QList<quint32> &offsets, const QList<quint32> &otherOffsets) {
+        const quint32 base = otherOffsets.at(from);
+        offsets.reserve(size() - from + 1);
+        for (qsizetype i = from + 1; i < otherOffsets.size(); ++i)
+            offsets.append(otherOffsets.at(i) - base);
+    };
+
+    result.m_time = m_time.mid(from);
+    result.m_direction = m_direction.mid(from);
+    result.m_connection = m_connection.mid(from);
+    result.m_queue = m_queue.mid(from);
+    result.m_object = m_object.mid(from);
+    result.m_method = m_method.mid(from);
+    result.m_arguments.reserve(size() - from);
+    for (qsizetype i = from; i < size(); ++i)
+        result.m_arguments.append(result.m_arena.store(m_arguments.at(i)));
+    copyOffsets(result.m_createdOffsets, m_createdOffsets);
+    result.m_createdPool = m_createdPool.mid(m_createdOffsets.at(from));
+    copyOffsets(result.m_destroyedOffsets, m_destroyedOffsets);
+    result.m_destroyedPool = m_destroyedPool.mid(m_destroyedOffsets.at(from));
+    return result;
+}
+
+MessageStore::ArgumentList MessageStore::argumentList(qsizetype i) const
+{
+    return splitArguments(arguments(i));
+}
+
+MessageStore::ArgumentList MessageStore::splitArguments(QByteArrayView arguments)
+{
+    ArgumentList list;
+    while (true) {
+        auto sep = arguments.indexOf(", ");
+        list.append(arguments.first(sep < 0 ? arguments.size() : sep));
+        if (sep < 0)
+            break;
+        arguments = arguments.sliced(sep + 2);
+    }
+    return list;
+}
+
+std::span<const ObjectRef> MessageStore::created(qsizetype i) const
+{
+    const auto from = m_createdOffsets.at(i);
+    return { m_createdPool.constData() + from, size_t(m_createdOffsets.at(i + 1) - from) };
+}
+
+std::span<const ObjectRef> MessageStore::destroyed(qsizetype i) const
+{
+    const auto from = m_destroyedOffsets.at(i);
+    return { m_destroyedPool.constData() + from, size_t(m_destroyedOffsets.at(i + 1) - from) };
+}
+
+Message MessageStore::message(qsizetype i) const
+{
+    Message m;
+    m.m_direction = m_direction.at(i);
+    m.m_connection = m_connection.at(i);
+    m.m_queue = m_queue.at(i);
+    m.m_time = m_time.at(i);
+    m.m_object = m_object.at(i);
+    m.m_method = m_method.at(i);
+    for (const auto &arg : argumentList(i))
+        m.m_arguments.append(QString::fromUtf8(arg));
+    for (const auto &o : created(i))
+        m.m_created.append(o);
+    for (const auto &o : destroyed(i))
+        m.m_destroyed.append(o);
+    return m;
+}
+
+
+TimeDeltaStatistics TimeDeltaStatistics::compute(std::span<const qint64> deltas)
+{
+    static constexpr qsizetype ExactLimit = 1024 * 1024;
+    static constexpr qsizetype RangeSize = 256 * 1024;
+
+    // 16 linear sub-buckets per power of two
+    static constexpr int SubBuckets = 16;
+    static constexpr int Buckets = SubBuckets + (64 - 4) * SubBuckets;
+    auto bucketOf = [](quint64 v) {
+        if (v < SubBuckets)
+            return int(v);
+        const int e = int(std::bit_width(v)) - 1;
+        return SubBuckets + (e - 4) * SubBuckets + int((v >> (e - 4)) & (SubBuckets - 1));
+    };
+    auto bucketMiddle = [](int b) {
+        if (b < SubBuckets)
+            return quint64(b);
+        const int e = (b - SubBuckets) / SubBuckets + 4;
+        const quint64 lower = quint64(SubBuckets + (b - SubBuckets) % SubBuckets) << (e - 4);
+        return lower + ((quint64(1) << (e - 4)) / 2);
+    };
+
+    TimeDeltaStatistics stats;
+    const qsizetype count = qsizetype(deltas.size());
+    if (!count)
+        return stats;
+
+    const bool exact = (count <= ExactLimit);
+    QList<quint64> absolute(exact ? count : 0);
+
+    struct Range
+    {
+        qsizetype m_from;
+        qsizetype m_to;
+        quint64 m_smallest = std::numeric_limits<quint64>::max();
+        quint64 m_biggest = 0;
+        QList<quint32> m_histogram;
+    };
+    std::vector<Range> ranges;
+    for (qsizetype from = 0; from < count; from += RangeSize)
+        ranges.push_back({ from, std::min(from + RangeSize, count) });
+
+    QtConcurrent::blockingMap(ranges, [&](Range &r) {
+        if (!exact)
+            r.m_histogram.fill(0, Buckets);
+        for (qsizetype i = r.m_from; i < r.m_to; ++i) {
+            const quint64 v = quint64(std::abs(deltas[i]));
+            r.m_smallest = std::min(r.m_smallest, v);
+            r.m_biggest = std::max(r.m_biggest, v);
+            if (exact)
+                absolute[i] = v;
+            else
+                ++r.m_histogram[bucketOf(v)];
+        }
+    });
+
+    stats.m_smallest = std::numeric_limits<quint64>::max();
+    for (const auto &r : ranges) {
+        stats.m_smallest = std::min(stats.m_smallest, r.m_smallest);
+        stats.m_biggest = std::max(stats.m_biggest, r.m_biggest);
+    }
+
+    const qsizetype medianRank = count / 2;
+    const qsizetype p90Rank = std::max(medianRank, count * 9 / 10);
+    const qsizetype p99Rank = std::max(p90Rank, count * 99 / 100);
+
+    if (exact) {
+        // each selection only has to look at what is above the previous one
+        auto select = [&absolute](qsizetype from, qsizetype rank) {
+            std::nth_element(absolute.begin() + from, absolute.begin() + rank, absolute.end());
+            return absolute.at(rank);
+        };
+        stats.m_median = select(0, medianRank);
+        stats.m_p90 = select(medianRank, p90Rank);
+        stats.m_p99 = select(p90Rank, p99Rank);
+    } else {
+        QList<quint64> histogram(Buckets, 0);
+        for (const auto &r : ranges) {
+            for (int b = 0; b < Buckets; ++b)
+                histogram[b] += r.m_histogram.at(b);
+        }
+        auto quantile = [&](qsizetype rank) {
+            quint64 seen = 0;
+            for (int b = 0; b < Buckets; ++b) {
+                seen += histogram.at(b);
+                if (seen > quint64(rank))
+                    return std::clamp(bucketMiddle(b), stats.m_smallest, stats.m_biggest);
+            }
+            return stats.m_biggest;
+        };
+        stats.m_median = quantile(medianRank);
+        stats.m_p90 = quantile(p90Rank);
+        stats.m_p99 = quantile(p99Rank);
+    }
+    return stats;
+}
+
+void TimeDeltaStatistics::extend(std::span<const qint64> deltas)
+{
+    for (qint64 delta : deltas) {
+        const quint64 v = quint64(std::abs(delta));
+        m_smallest = std::min(m_smallest, v);
+        m_biggest = std::max(m_biggest, v);
+    }
+}
+
+double TimeDeltaStatistics::percent(qint64 delta) const
+{
+    const quint64 v = quint64(std::abs(delta));
+    if (m_biggest <= m_smallest)
+        return 0.5;
+    if (v >= m_biggest)
+        return 1;
+
+    const std::pair<quint64, double> knots[] = {
+        { m_smallest, 0 }, { m_median, 0.5 }, { m_p90, 0.75 }, { m_p99, 0.9 }, { m_biggest, 1 }
+    };
+
+    for (size_t i = 1; i < std::size(knots); ++i) {
+        const auto [lower, lowerPercent] = knots[i - 1];
+        const auto [upper, upperPercent] = knots[i];
+        if ((v > upper) && (i < std::size(knots) - 1))
+            continue;
+        if ((upper <= lower) || (v <= lower))
+            return lowerPercent;
+        // scale log between the two knots
+        const double f = std::log(double(std::min(v, upper) - lower + 1)) / std::log(double(upper - lower + 1));
+        return lowerPercent + (upperPercent - lowerPercent) * f;
+    }
+    return 0.5;
+}
+
+namespace {
+
+// std::stable_sort on chunks in parallel, followed by rounds of parallel pairwise merges
+template <typename Less> void parallelStableSort(QList<int> &list, Less less)
+{
+    const qsizetype threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    const qsizetype chunkSize = std::max<qsizetype>(64 * 1024, list.size() / threads + 1);
+    if (list.size() <= chunkSize) {
+        std::stable_sort(list.begin(), list.end(), less);
+        return;
+    }
+
+    int *data = list.data();
+    QList<std::pair<qsizetype, qsizetype>> ranges; // first, last
+    for (qsizetype from = 0; from < list.size(); from += chunkSize)
+        ranges.append({ from, std::min(from + chunkSize, list.size()) });
+
+    QtConcurrent::blockingMap(ranges, [data, &less](const std::pair<qsizetype, qsizetype> &r) {
+        std::stable_sort(data + r.first, data + r.second, less);
+    });
+    while (ranges.size() > 1) {
+        QList<std::tuple<qsizetype, qsizetype, qsizetype>> merges; // first, middle, last
+        QList<std::pair<qsizetype, qsizetype>> merged;
+        for (qsizetype i = 0; i + 1 < ranges.size(); i += 2) {
+            merges.append({ ranges.at(i).first, ranges.at(i).second, ranges.at(i + 1).second });
+            merged.append({ ranges.at(i).first, ranges.at(i + 1).second });
+        }
+        if (ranges.size() % 2)
+            merged.append(ranges.constLast());
+
+        QtConcurrent::blockingMap(merges, [data, &less](const std::tuple<qsizetype, qsizetype, qsizetype> &m) {
+            std::inplace_merge(data + std::get<0>(m), data + std::get<1>(m), data + std::get<2>(m), less);
+        });
+        ranges = merged;
+    }
+}
+
+} // namespace
+
+QList<int> Model::computeSortOrder(int column, const MessageStore &ms, const QList<uint> &ranks,
+                                   const ArgumentCache *arguments, bool parallel)
+{
+    QList<int> order(ms.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    // equal cells stay in ordinal order, so descending is just this list reversed
+    auto sortBy = [&order, parallel](auto less) {
+        if (parallel)
+            parallelStableSort(order, less);
+        else
+            std::stable_sort(order.begin(), order.end(), less);
+    };
+
+    // atoms are numbered in order of appearance: compare their alphabetical ranks instead
+    switch (column) {
+    case Time:
+        if (!std::is_sorted(ms.m_time.cbegin(), ms.m_time.cend()))
+            sortBy([&ms](int o1, int o2) { return ms.m_time.at(o1) < ms.m_time.at(o2); });
+        break;
+    case Connection:
+        sortBy([&](int o1, int o2) { return ranks.at(ms.m_connection.at(o1)) < ranks.at(ms.m_connection.at(o2)); });
+        break;
+    case Queue:
+        sortBy([&](int o1, int o2) { return ranks.at(ms.m_queue.at(o1)) < ranks.at(ms.m_queue.at(o2)); });
+        break;
+    case Direction:
+        sortBy([&ms](int o1, int o2) { return ms.m_direction.at(o1) < ms.m_direction.at(o2); });
+        break;
+    case Object:
+        sortBy([&](int o1, int o2) {
+            const ObjectRef &r1 = ms.m_object.at(o1);
+            const ObjectRef &r2 = ms.m_object.at(o2);
+            return std::tuple(ranks.at(r1.m_class), r1.m_instance, r1.m_generation)
+                   < std::tuple(ranks.at(r2.m_class), r2.m_instance, r2.m_generation);
+        });
+        break;
+    case Method:
+        sortBy([&](int o1, int o2) { return ranks.at(ms.m_method.at(o1)) < ranks.at(ms.m_method.at(o2)); });
+        break;
+    case Arguments:
+        sortBy([&ms, arguments](int o1, int o2) {
+            const auto args1 = arguments ? arguments->texts(ms, o1) : ms.argumentList(o1);
+            const auto args2 = arguments ? arguments->texts(ms, o2) : ms.argumentList(o2);
+            return std::lexicographical_compare(args1.cbegin(), args1.cend(), args2.cbegin(), args2.cend(),
+                                                [](QByteArrayView a1, QByteArrayView a2) {
+                return std::string_view(a1.data(), size_t(a1.size()))
+                       < std::string_view(a2.data(), size_t(a2.size()));
+            });
+        });
+        break;
+    default:
+        Q_ASSERT(false);
+        break;
+    }
+    return order;
+}
+
+QList<int> Model::sortOrder(int column)
+{
+    QList<int> &order = m_sortOrders[column];
+    if ((order.size() != m_messages.size()) && m_sortJobs[column].isValid()) {
+        order = m_sortJobs[column].result();
+        m_sortJobs[column] = { };
+    }
+    if (order.size() != m_messages.size()) {
+        if (column == Arguments)
+            m_argumentCache.decodeAll(m_messages);
+        order = computeSortOrder(column, m_messages, m_atoms.ranks(), &m_argumentCache, true);
+    }
+    return order;
+}
+
+void Model::precomputeSortOrders()
 {
-    qDeleteAll(m_messages);
+    // the columns users switch between all the time get sorted in the background right after
+    // loading, one job per column. Arguments are expensive to compare and rarely sorted on.
+    // Rows are only ever appended or the store replaced: the same size means the same rows.
+    if (m_sortJobsRows == m_messages.size())
+        return;
+    m_sortJobsRows = m_messages.size();
+    const MessageStore store = m_messages;
+    const QList<uint> ranks = m_atoms.ranks();
+    for (int column : { Connection, Queue, Direction, Object, Method }) {
+        m_sortOrders[column].clear();
+        m_sortJobs[column] = QtConcurrent::run([column, store, ranks]() {
+            return computeSortOrder(column, store, ranks, nullptr, false);
+        });
+    }
+    m_sortOrders[Time].clear();
+    m_sortOrders[Arguments].clear();
 }
 
 void Model::sort(int column, Qt::SortOrder order)
 {
+    PerfCounters::Scope timing(PerfCounters::Sort);
+
+    // a running filter job works on the old order: restart it afterwards
+    auto restartFilter = qScopeGuard([this, pendingFilter = suspendFiltering()]() {
+        if (pendingFilter)
+            startFiltering(pendingFilter);
+    });
+
+    m_sortColumn = column;
+    m_sortOrder = order;
+
     emit layoutAboutToBeChanged({ }, VerticalSortHint);
     const QModelIndexList before = persistentIndexList();
 
-    m_sorted = m_messages;
     if ((column >= 0) && (column < Count)) {
-        std::sort(m_sorted.begin(), m_sorted.end(), [this, column, order](const Message *m1, const Message *m2) {
-            if (order == Qt::DescendingOrder)
-                std::swap(m1, m2);
-
-            switch (column) {
-            case Time: return (m1->m_time < m2->m_time);
-            case Connection: return m1->m_connection.compare(m2->m_connection) < 0;
-            case Queue: return m1->m_queue.compare(m2->m_queue) < 0;
-            case Direction: return (m1->m_direction < m2->m_direction);
-            case Object: return (m1->m_object < m2->m_object);
-            case Method: return m1->m_method.compare(m2->m_method) < 0;
-            case Arguments: return (m1->m_arguments < m2->m_arguments);
-            case TimeDelta: return m_filteredTimeDeltas.at(m_filteredIndex.value(m1))
-                     < m_filteredTimeDeltas.at(m_filteredIndex.value(m2));
-            default:   Q_ASSERT(false); break;
-            }
-
-            return false;
-        });
+        QList<int> ascending;
+        if (column == TimeDelta) {
+            // depends on the current filter and order, so there is nothing to cache
+            ascending.resize(m_messages.size());
+            std::iota(ascending.begin(), ascending.end(), 0);
+            parallelStableSort(ascending, [this](int o1, int o2) { return timeDelta(o1) < timeDelta(o2); });
+        } else {
+            ascending = sortOrder(column);
+        }
+        if (order == Qt::DescendingOrder)
+            std::reverse(ascending.begin(), ascending.end());
+        m_sorted = ascending;
+    } else {
+        m_sorted.resize(m_messages.size());
+        std::iota(m_sorted.begin(), m_sorted.end(), 0);
     }
-    
+
+    rebuildSortedPosition();
+
     // we were filtered before, but we don't want to re-filter: the solution is to
     // keep the old filtered lots, but use the order from m_sorted
     if (m_filter) {
-        m_filtered = QtConcurrent::blockingFiltered(m_sorted, [this](const Message *m) {
-            return m_filteredIndex.contains(m);
+        QList<int> filtered;
+        filtered.reserve(m_filtered.size());
+        std::copy_if(m_sorted.cbegin(), m_sorted.cend(), std::back_inserter(filtered), [this](int o) {
+            return m_filteredRow.at(o) >= 0;
         });
+        m_filtered = filtered;
     } else {
         m_filtered = m_sorted;
     }
@@ -74,7 +608,7 @@ void Model::sort(int column, Qt::SortOrder order)
     QModelIndexList after;
     after.reserve(before.size());
     for (const QModelIndex &idx : before)
-        after.append(index(message(idx), idx.column()));
+        after.append(indexForOrdinal(ordinal(idx), idx.column()));
     changePersistentIndexList(before, after);
     emit layoutChanged({ }, VerticalSortHint);
 }
@@ -94,21 +628,36 @@ QVariant Model::data(const QModelIndex &index, int role) const
     if (!index.isValid())
         return QVariant();
 
-    auto timeDeltaPercent = [this](qint64 td) {
-        qint64 diff = std::abs(td) - m_medianTimeDelta;
-        if (diff < 0) {
-            // scale log between smallest and median
-            return 0.5 * std::log(double(-diff + 1))
-                   / std::log(double(m_medianTimeDelta - m_smallestTimeDelta + 1));
-        } else if (diff > 0) {
-            // scale log between median and biggest
-            return 0.5 + 0.5 * std::log(double(diff + 1))
-                             / std::log(double(m_biggestTimeDelta - m_medianTimeDelta + 1));
-        } else {
-            return 0.5;
+    // scrolling asks for the same few hundred cells over and over again
+    int slot = -1;
+    switch (role) {
+    case Qt::DisplayRole:         slot = 0; break;
+    case BackgroundTintRole:      slot = 1; break;
+    default:                      return cellData(index, role);
+    }
+    const quint64 key = (quint64(index.row()) << 8) | quint64(index.column() << 2) | quint64(slot);
+    if (const QVariant *cached = m_cellCache.object(key))
+        return *cached;
+    QVariant value = cellData(index, role);
+    m_cellCache.insert(key, new QVariant(value));
+    return value;
+}
+
+void Model::prefetch(int firstRow, int lastRow) const
+{
+    firstRow = std::max(firstRow, 0);
+    lastRow = std::min(lastRow, rowCount({ }) - 1);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = 0; column < Count; ++column) {
+            const QModelIndex idx = index(row, column);
+            data(idx, Qt::DisplayRole);
+            data(idx, BackgroundTintRole);
         }
-    };
+    }
+}
 
+QVariant Model::cellData(const QModelIndex &index, int role) const
+{
     auto formatTime = [](qint64 t) {
         return u"%1'%2.%3"_s
             .arg(t / 1000 / 1000)
@@ -130,47 +679,55 @@ QVariant Model::data(const QModelIndex &index, int role) const
         return c;
     };
 
-    const Message *m = m_filtered.at(index.row());
+    const MessageStore &ms = m_messages;
+    const int o = m_filtered.at(index.row());
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
-        case Time:       return formatTime(m->m_time);
-        case Connection: return m->m_connection;
-        case Queue:      return m->m_queue;
+        case Time:       return formatTime(ms.m_time.at(o));
+        case Connection: return m_atoms.string(ms.m_connection.at(o));
+        case Queue:      return m_atoms.string(ms.m_queue.at(o));
         case Direction: {
-            switch (m->m_direction) {
+            switch (ms.m_direction.at(o)) {
             case Direction::Any:            return tr("Any");
             case Direction::ToCompositor:   return tr("To Compositor");
             case Direction::FromCompositor: return tr("From Compositor");
             default: return QVariant();
             }
         }
-        case Object:     return u"%1#%2 [%3]"_s.arg(m->m_object.m_class).arg(m->m_object.m_instance).arg(m->m_object.m_generation);
-        case Method:     return m->m_method;
-        case Arguments:  return m->m_arguments.join(u", ");
-        case TimeDelta:  return formatTime(m_filteredTimeDeltas.at(index.row()));
+        case Object: {
+            const ObjectRef &obj = ms.m_object.at(o);
+            return u"%1#%2 [%3]"_s.arg(m_atoms.string(obj.m_class)).arg(obj.m_instance).arg(obj.m_generation);
+        }
+        case Method:     return m_atoms.string(ms.m_method.at(o));
+        case Arguments:  return QString::fromUtf8(ms.arguments(o));
+        case TimeDelta:  return formatTime(m_filteredTimeDeltas.value(index.row()));
         default:         return QVariant();
         }
+    } else if (role == Qt::ToolTipRole) {
+        if (index.column() == Arguments) {
+            QStringList lines;
+            for (const auto &arg : m_argumentCache.arguments(ms, o))
+                lines << u"%1: %2"_s.arg(Argument::typeName(arg.m_type), QString::fromUtf8(arg.m_text));
+            return lines.join(u'\n');
+        }
     } else if (role == BackgroundTintRole) {
+        auto tint = [](const QColor &color, double width = 1) {
+            return color.isValid() ? QVariant::fromValue(BackgroundTint { color, width }) : QVariant();
+        };
+
         switch (index.column()) {
-        case Connection: return m->m_connection.isEmpty() ? QColor{} : shadeColor(qHash(m->m_connection), 0.2f);
-        case Queue:      return m->m_queue.isEmpty() ? QColor{} : shadeColor(qHash(m->m_queue), 0.4f);
+        case Connection: return (ms.m_connection.at(o) == AtomTable::EmptyAtom) ? QVariant() : tint(shadeColor(qHash(m_atoms.string(ms.m_connection.at(o))), 0.2f));
+        case Queue:      return (ms.m_queue.at(o) == AtomTable::EmptyAtom) ? QVariant() : tint(shadeColor(qHash(m_atoms.string(ms.m_queue.at(o))), 0.4f));
         case Direction:
-            if (m->m_direction == Direction::ToCompositor)
-                return QColor(0, 255, 0, 128);
-            else if (m->m_direction == Direction::FromCompositor)
-                return QColor(0, 0, 255, 128);
+            if (ms.m_direction.at(o) == Direction::ToCompositor)
+                return tint(QColor(0, 255, 0, 128));
+            else if (ms.m_direction.at(o) == Direction::FromCompositor)
+                return tint(QColor(0, 0, 255, 128));
             break;
         case TimeDelta: {
-            auto tdp = timeDeltaPercent(m_filteredTimeDeltas.at(index.row()));
+            auto tdp = m_timeDeltaStatistics.percent(m_filteredTimeDeltas.value(index.row()));
             // 0: green -> 0.5: yellow -> 1: red
-            return QColor::fromHsvF(0.33f - 0.33f * tdp, 1.f, 1.f, 0.5f);
-        }
-        }
-    } else if (role == BackgroundTintWidthRole) {
-        switch (index.column()) {
-        case TimeDelta: {
-            return timeDeltaPercent(m_filteredTimeDeltas.at(index.row()));
-            break;
+            return tint(QColor::fromHsvF(0.33f - 0.33f * tdp, 1.f, 1.f, 0.5f), tdp);
         }
         }
     }
@@ -194,29 +751,67 @@ QVariant Model::headerData(int section, Qt::Orientation orientation, int role) c
     }
 }
 
-const Message *Model::message(const QModelIndex &index) const
+int Model::ordinal(const QModelIndex &index) const
+{
+    return index.isValid() ? int(index.internalId()) : -1;
+}
+
+Message Model::message(const QModelIndex &index) const
 {
-    return index.isValid() ? static_cast<const Message *>(index.internalPointer()) : nullptr;
+    return index.isValid() ? m_messages.message(ordinal(index)) : Message { };
 }
 
 QModelIndex Model::index(int row, int column, const QModelIndex &parent) const
 {
     if (!parent.isValid() && (row >= 0) && (column >= 0) && (row < rowCount({ })) && (column < columnCount({ })))
-        return createIndex(row, column, m_filtered.at(row));
+        return createIndex(row, column, quintptr(m_filtered.at(row)));
     return { };
 }
 
-QModelIndex Model::index(const Message *message, int column) const
+QModelIndex Model::indexForOrdinal(int ordinal, int column) const
 {
-    int row = m_filteredIndex.value(message, -1);
+    const int row = ((ordinal >= 0) && (ordinal < m_filteredRow.size())) ? m_filteredRow.at(ordinal) : -1;
     if (row >= 0)
-        return createIndex(row, column, message);
+        return createIndex(row, column, quintptr(ordinal));
     return { };
 }
 
+Model::Model()
+{
+    connect(&m_filterWatcher, &QFutureWatcherBase::finished,
+            this, &Model::filteringFinished);
+    connect(&m_filterWatcher, &QFutureWatcherBase::progressRangeChanged,
+            this, [this](int minimum, int maximum) {
+        emit filterProgressChanged(m_filterWatcher.progressValue() - minimum, maximum - minimum);
+    });
+    connect(&m_filterWatcher, &QFutureWatcherBase::progressValueChanged,
+            this, [this](int value) {
+        emit filterProgressChanged(value - m_filterWatcher.progressMinimum(),
+                                   m_filterWatcher.progressMaximum() - m_filterWatcher.progressMinimum());
+    });
+}
+
+Model::~Model()
+{
+    if (m_filterJob)
+        m_filterJob->m_canceled = true;
+    m_filterWatcher.cancel();
+    m_filterWatcher.waitForFinished();
+    for (auto &job : m_sortJobs)
+        job.waitForFinished();
+}
+
 void Model::init()
 {
-    m_sorted = m_filtered = m_messages;
+    m_argumentCache.clear();
+    m_index.update(m_messages); // nothing to do for a restored index
+    m_lifetimes.update(m_messages);
+    m_sorted.resize(m_messages.size());
+    std::iota(m_sorted.begin(), m_sorted.end(), 0);
+    rebuildSortedPosition();
+    m_sortJobsRows = -1;
+    precomputeSortOrders();
+    m_filtered = m_sorted;
     rebuildFilteredIndex();
     recalculateTimeDelta();
 }
@@ -224,281 +819,2245 @@ void Model::init()
 
 void Model::setFilter(Filter *filter)
 {
-    if (m_filter.get() == filter)
+    std::shared_ptr<Filter> f(filter);
+    auto isSame = [](const std::shared_ptr<Filter> &f1, const std::shared_ptr<Filter> &f2) {
+        if (!f1 || !f2)
+            return !f1 && !f2;
+        return (f1 == f2) || (f1->isSubsetOf(*f2) && f2->isSubsetOf(*f1));
+    };
+
+    if (isFiltering() ? isSame(f, m_pendingFilter) : isSame(f, m_filter))
         return;
+    startFiltering(f);
+}
 
-    beginResetModel();
-    m_filter.reset(filter);
-    if (!filter) {
-        m_filtered = m_sorted;
-    } else {
-        m_filtered = QtConcurrent::blockingFiltered(m_sorted, [filter](const Message *m) {
-            return filter->match(m);
-        });
-    }
-    recalculateTimeDelta();
-    rebuildFilteredIndex();
-    endResetModel();
+bool Model::isFiltering() const
+{
+    return m_filterWatcher.isRunning();
 }
 
-void Model::recalculateTimeDelta()
+// everything a filter job looks at is an (implicitly shared) copy, so the GUI thread is free
+// to modify the model in the meantime. The arguments are decoded and indexed on copies as well:
+// the model takes those over once the job got through these steps.
+struct Model::FilterJob
 {
-    m_filteredTimeDeltas.resize(m_filtered.size());
-    m_smallestTimeDelta = 0;
-    m_biggestTimeDelta = 0;
-    m_medianTimeDelta = 0;
+    std::shared_ptr<Filter> m_filter;
+    AtomTable m_atoms;
+    MessageStore m_store;
+    ArgumentCache m_arguments;
+    MessageIndex m_index;
+    LifetimeIndex m_lifetimes;
+    QList<int> m_sorted;
+    QList<int> m_sortedPosition;
+    bool m_sortedByOrdinal = true;
+    QList<int> m_filtered;
+    QList<int> m_filteredRow;
+    bool m_narrowed = false;
+    bool m_widened = false;
 
-    if (m_filtered.isEmpty())
-        return;
+    // set by cancelFiltering(), so decoding and indexing stop between two blocks of rows
+    std::atomic_bool m_canceled = false;
+    // set by the job, only read once it has finished
+    bool m_decoded = false;
+    bool m_indexed = false;
+
+    void run(QPromise<QList<int>> &promise);
+    QList<int> inSortOrder(const QList<int> &ordinals) const;
+    template <typename Accept>
+    static QList<int> filtered(QPromise<QList<int>> &promise, const QList<int> &ordinals, const Accept &accept);
+};
+
+void Model::FilterJob::run(QPromise<QList<int>> &promise)
+{
+    const Filter *filter = m_filter.get();
 
-    m_smallestTimeDelta = std::numeric_limits<qint64>::max();
-    qint64 last = m_filtered.constFirst()->m_time;
-    for (qsizetype i = 0; i < m_filtered.size(); ++i) {
-        qint64 now = qint64(m_filtered.at(i)->m_time);
-        auto delta = now - last;
-        m_filteredTimeDeltas[i] = delta;
-        quint64 absDelta = std::abs(delta);
-        if (absDelta < m_smallestTimeDelta)
-            m_smallestTimeDelta = absDelta;
-        if (absDelta > m_biggestTimeDelta)
-            m_biggestTimeDelta = absDelta;
-        last = now;
+    if (m_filter->usesArguments()) {
+        if (!m_arguments.isComplete(m_store)) {
+            m_arguments.decodeAll(m_store, &m_canceled);
+            m_decoded = true;
+        }
+        if (promise.isCanceled() || !m_arguments.isComplete(m_store))
+            return;
+        if (!m_index.hasArguments(m_store)) {
+            m_index.updateArguments(m_store, m_arguments, &m_canceled);
+            m_indexed = true;
+        }
+        if (promise.isCanceled())
+            return;
     }
+    m_filter->compile(m_atoms, &m_arguments, &m_index, &m_store, &m_lifetimes);
+    if (promise.isCanceled())
+        return;
 
-    auto tdcopy = m_filteredTimeDeltas;
-    std::sort(tdcopy.begin(), tdcopy.end(), [](qint64 a, qint64 b) { return std::abs(a) < std::abs(b); });
-    m_medianTimeDelta = std::abs(tdcopy.at(tdcopy.size() / 2));
+    // a narrower filter only has to re-check the rows that are visible right now, a wider one
+    // only the hidden ones
+    const MessageStore &store = m_store;
+    QList<int> result;
+    const auto *candidates = filter->candidates();
+    if (candidates && !filter->hasUnindexedCriteria()) {
+        // the postings lists already are the exact answer
+        result = inSortOrder(*candidates);
+    } else if (candidates && (!m_narrowed || (candidates->size() < m_filtered.size()))) {
+        result = filtered(promise, inSortOrder(*candidates), [&store, filter](int o) {
+            return filter->matchUnindexed(store, o);
+        });
+    } else if (m_narrowed) {
+        result = filtered(promise, m_filtered, [&store, filter](int o) {
+            return filter->match(store, o);
+        });
+    } else if (m_widened) {
+        const QList<int> &visible = m_filteredRow;
+        result = filtered(promise, m_sorted, [&store, filter, &visible](int o) {
+            return (visible.at(o) >= 0) || filter->match(store, o);
+        });
+    } else {
+        result = filtered(promise, m_sorted, [&store, filter](int o) {
+            return filter->match(store, o);
+        });
+    }
+    if (!promise.isCanceled())
+        promise.addResult(std::move(result));
 }
 
-void Model::rebuildFilteredIndex()
+QList<int> Model::FilterJob::inSortOrder(const QList<int> &ordinals) const
 {
-    m_filteredIndex.clear();
-    for (auto i = 0; i < m_filtered.size(); ++i)
-        m_filteredIndex[m_filtered.at(i)] = i;
+    // ordinals are ascending, which is what m_sorted looks like until the user sorts
+    if (m_sortedByOrdinal)
+        return ordinals;
+    QList<int> result = ordinals;
+    std::sort(result.begin(), result.end(), [this](int o1, int o2) {
+        return m_sortedPosition.at(o1) < m_sortedPosition.at(o2);
+    });
+    return result;
 }
 
-qsizetype ObjectRegistry::findInstance(uint instance)
+template <typename Accept>
+QList<int> Model::FilterJob::filtered(QPromise<QList<int>> &promise, const QList<int> &ordinals,
+                                      const Accept &accept)
 {
-    for (qsizetype i = 0; i < m_objects.size(); ++i) {
-        if (m_objects.at(i).m_instance == instance)
-            return i;
-    }
-    return -1;
-};
+    // in blocks, so a cancel takes effect right away and the progress can be reported
+    struct Block
+    {
+        qsizetype m_from;
+        qsizetype m_to;
+        QList<int> m_accepted;
+    };
+    constexpr qsizetype BlockSize = 16 * 1024;
+    std::vector<Block> blocks;
+    for (qsizetype from = 0; from < ordinals.size(); from += BlockSize)
+        blocks.push_back({ from, std::min(from + BlockSize, ordinals.size()), { } });
 
-ObjectRef ObjectRegistry::resolve(const QString &class_, uint instance)
-{
-    auto idx = findInstance(instance);
-    ObjectRef o;
-    if (idx < 0) {
-        bool found = false;
-        if (!class_.isEmpty()) {
-            for (qsizetype i = m_graveyard.size() - 1; i >= 0; --i) {
-                if ((m_graveyard.at(i).m_instance == instance) && (m_graveyard.at(i).m_class == class_)) {
-                    o = m_graveyard.at(i);
-                    qWarning().nospace() << "Found object " << o.m_class << "#" << o.m_instance << " in the graveyard";
-                    found = true;
-                    break;
-                }
-            }
-        }
-        if (!found) {
-            throw Exception("resolve failed to find an instance of %#%2")
-                .arg(class_).arg(instance);
+    promise.setProgressRange(0, int(blocks.size()));
+    std::atomic_int done = 0;
+    // the calling thread works on the blocks as well, so this cannot starve the thread pool
+    QtConcurrent::blockingMap(blocks, [&](Block &block) {
+        if (promise.isCanceled())
+            return;
+        for (qsizetype i = block.m_from; i < block.m_to; ++i) {
+            if (accept(ordinals.at(i)))
+                block.m_accepted.append(ordinals.at(i));
         }
-    } else {
-        o = m_objects.at(idx);
-    }
-    if (!class_.isEmpty() && (o.m_class != class_)) {
-        throw Exception("resolve found object %1#%2, but it should have been of class %3")
-            .arg(o.m_class).arg(instance).arg(class_);
-    }
-    return o;
+        promise.setProgressValue(++done);
+    });
+
+    QList<int> result;
+    if (promise.isCanceled())
+        return result;
+    qsizetype size = 0;
+    for (const auto &block : blocks)
+        size += block.m_accepted.size();
+    result.reserve(size);
+    for (const auto &block : blocks)
+        result.append(block.m_accepted);
+    return result;
 }
 
-ObjectRef ObjectRegistry::create(const QString &class_, uint instance)
+void Model::startFiltering(const std::shared_ptr<Filter> &filter)
 {
-    auto idx = findInstance(instance);
-    if (idx >= 0) {
-        throw Exception("trying to create an already existing object: %1#%2 (found: %3#%4)")
-            .arg(class_).arg(instance)
-            .arg(m_objects.at(idx).m_class).arg(m_objects.at(idx).m_instance);
+    // the running job stops at its next check. Waiting for it keeps what it decoded and
+    // indexed, so every keystroke in the filter continues from there instead of starting over.
+    const bool wasFiltering = isFiltering();
+    suspendFiltering();
+    m_filterClock.start();
+
+    m_pendingFilter = filter;
+    m_pendingNarrowed = filter && (!m_filter || filter->isSubsetOf(*m_filter));
+    m_pendingWidened = !m_pendingNarrowed && m_filter && (!filter || m_filter->isSubsetOf(*filter));
+
+    if (!filter) {
+        // nothing to check: everything becomes visible
+        applyFilterResult(m_sorted);
+        if (wasFiltering)
+            emit filteringChanged(false);
+        return;
     }
-    uint generation = 1; 
-    auto genKey = std::make_pair(class_, instance);
-    auto genIt = m_generations.find(genKey);
-    if (genIt != m_generations.end())
-        generation = ++genIt.value();
-    else
-        m_generations.insert(genKey, generation);
-       
-    ObjectRef o(class_, instance, generation);
-    m_objects << o;
-    return o;
-}
 
-ObjectRef ObjectRegistry::destroy(uint instance)
-{
-    auto idx = findInstance(instance);
-    if (idx < 0)
-        throw Exception("destroy for unknown object #%1").arg(instance);
-    auto o = m_objects.takeAt(idx);
-    m_graveyard << o;
-    return o;
+    // decoding the arguments, updating the index and compiling the filter happen in the job
+    // as well: on a big log, each of them takes long enough to block the GUI
+    auto job = std::make_shared<FilterJob>();
+    job->m_filter = filter;
+    job->m_atoms = m_atoms;
+    job->m_store = m_messages;
+    job->m_arguments = m_argumentCache;
+    job->m_index = m_index;
+    job->m_lifetimes = m_lifetimes;
+    job->m_sorted = m_sorted;
+    job->m_sortedPosition = m_sortedPosition;
+    job->m_sortedByOrdinal = m_sortedByOrdinal;
+    job->m_filtered = m_filtered;
+    job->m_filteredRow = m_filteredRow;
+    job->m_narrowed = m_pendingNarrowed;
+    job->m_widened = m_pendingWidened;
+    m_filterJob = job;
+
+    m_filterWatcher.setFuture(QtConcurrent::run([job](QPromise<QList<int>> &promise) {
+        job->run(promise);
+    }));
+    if (!wasFiltering)
+        emit filteringChanged(true);
 }
 
-ObjectRef ObjectRegistry::destroyIfExists(uint instance)
+void Model::adoptFilterJob(const FilterJob &job)
 {
-    auto idx = findInstance(instance);
-    if (idx >= 0)
-        return m_objects.takeAt(idx);
-    return { };
+    // only called before the model changes again, so the copies are still up to date
+    if (job.m_decoded)
+        m_argumentCache = job.m_arguments;
+    if (job.m_indexed)
+        m_index = job.m_index;
 }
 
-Parser::Parser(const QString &fileName)
-    : m_device(new QFile(fileName))
-    , m_ownsDevice(true)
+void Model::rebuildSortedPosition()
 {
-    m_device->open(QIODevice::ReadOnly);
+    m_sortedPosition.resize(m_sorted.size());
+    for (int i = 0; i < m_sorted.size(); ++i)
+        m_sortedPosition[m_sorted.at(i)] = i;
+    m_sortedByOrdinal = std::is_sorted(m_sorted.cbegin(), m_sorted.cend());
 }
 
-Parser::Parser(QIODevice *device)
-    : m_device(device)
+std::shared_ptr<Filter> Model::suspendFiltering()
 {
+    std::shared_ptr<Filter> pendingFilter;
+    if (isFiltering()) {
+        pendingFilter = m_pendingFilter;
+        const auto job = m_filterJob;
+        cancelFiltering();
+        m_filterWatcher.waitForFinished();
+        // keep what the job got through: a live capture could otherwise append faster than
+        // the restarted jobs decode the arguments
+        if (job)
+            adoptFilterJob(*job);
+    }
+    return pendingFilter;
 }
 
-Parser::~Parser()
+void Model::appendMessages(const MessageStore &messages, const QStringList &newAtoms)
+{
+    for (const auto &str : newAtoms)
+        m_atoms.intern(str);
+    if (messages.isEmpty())
+        return;
+
+    // a running filter job does not know about the new rows: restart it afterwards
+    auto restartFilter = qScopeGuard([this, pendingFilter = suspendFiltering()]() {
+        if (pendingFilter)
+            startFiltering(pendingFilter);
+    });
+
+    const int first = int(m_messages.size());
+    m_messages.append(messages);
+    const int last = int(m_messages.size());
+    m_index.update(m_messages);
+    m_lifetimes.update(m_messages);
+
+    // names that show up for the first time may be part of the filter
+    if (m_filter && !newAtoms.isEmpty())
+        m_filter->compile(m_atoms, &m_argumentCache, nullptr, nullptr, &m_lifetimes);
+
+    QList<int> visible;
+    for (int o = first; o < last; ++o) {
+        m_sortedPosition.append(int(m_sorted.size()));
+        m_sorted.append(o);
+        if (!m_filter || m_filter->match(m_messages, o))
+            visible.append(o);
+    }
+    m_filteredRow.resize(last, -1);
+    if (visible.isEmpty())
+        return;
+
+    const int row = int(m_filtered.size());
+    beginInsertRows({ }, row, row + int(visible.size()) - 1);
+    m_filtered.append(visible);
+    m_filteredTimeDeltas.resize(m_filtered.size());
+    const auto &time = m_messages.m_time;
+    for (int r = row; r < m_filtered.size(); ++r) {
+        m_filteredRow[m_filtered.at(r)] = r;
+        m_filteredTimeDeltas[r] = r ? qint64(time.at(m_filtered.at(r))) - qint64(time.at(m_filtered.at(r - 1))) : 0;
+    }
+    endInsertRows();
+
+    // the tint of the existing rows depends on the statistics as well. A live capture appends
+    // a few rows at a time: only redo the quantiles once the view has grown noticeably.
+    const TimeDeltaStatistics before = m_timeDeltaStatistics;
+    if (m_filtered.size() >= m_statisticsRows + m_statisticsRows / 16) {
+        m_timeDeltaStatistics = TimeDeltaStatistics::compute(m_filteredTimeDeltas);
+        m_statisticsRows = m_filtered.size();
+    } else {
+        m_timeDeltaStatistics.extend(std::span<const qint64>(m_filteredTimeDeltas).subspan(size_t(row)));
+    }
+    if (row && (m_timeDeltaStatistics != before)) {
+        m_cellCache.clear();
+        emit dataChanged(index(0, TimeDelta), index(row - 1, TimeDelta), { BackgroundTintRole });
+    }
+}
+
+void Model::setMessages(const QStringList &atoms, const MessageStore &messages, const MessageIndex &index)
+{
+    // the current filter gets re-applied to the new rows from scratch
+    auto restartFilter = qScopeGuard([this, pendingFilter = suspendFiltering()]() {
+        if (auto filter = pendingFilter ? pendingFilter : std::exchange(m_filter, nullptr))
+            startFiltering(filter);
+    });
+
+    beginResetModel();
+    m_atoms = { };
+    for (const auto &str : atoms)
+        m_atoms.intern(str);
+    m_messages = messages;
+    m_index = index;
+    m_lifetimes.clear();
+    init();
+    endResetModel();
+}
+
+void Model::finishLoading()
+{
+    precomputeSortOrders();
+    if (m_sortColumn >= 0)
+        sort(m_sortColumn, m_sortOrder);
+}
+
+void Model::removeFirstMessages(qsizetype count)
+{
+    count = std::min(count, m_messages.size());
+    if (count <= 0)
+        return;
+
+    auto restartFilter = qScopeGuard([this, pendingFilter = suspendFiltering()]() {
+        if (pendingFilter)
+            startFiltering(pendingFilter);
+    });
+
+    // the oldest messages are at the top, unless sorted otherwise: remove their rows in runs
+    QList<int> remaining;
+    remaining.reserve(m_filtered.size());
+    std::copy_if(m_filtered.cbegin(), m_filtered.cend(), std::back_inserter(remaining), [count](int o) {
+        return o >= count;
+    });
+    const bool reset = (remaining.size() != m_filtered.size())
+                       && !applyFilteredIncrementally(remaining, true);
+    if (reset)
+        beginResetModel();
+
+    // copy the survivors into a fresh arena, so the memory of the dropped ones is released,
+    // and shift all ordinals down
+    m_messages = m_messages.mid(count);
+    m_filtered = remaining;
+    for (int &o : m_filtered)
+        o -= int(count);
+    m_sorted.removeIf([count](int o) { return o < count; });
+    for (int &o : m_sorted)
+        o -= int(count);
+    rebuildSortedPosition();
+    rebuildFilteredIndex();
+    recalculateTimeDelta();
+
+    m_argumentCache.clear();
+    m_index.clear();
+    m_index.update(m_messages);
+    m_lifetimes.clear();
+    m_lifetimes.update(m_messages);
+    for (int column = 0; column < Count; ++column) {
+        m_sortOrders[column].clear();
+        m_sortJobs[column] = { }; // a job still running works on its own copy
+    }
+    m_sortJobsRows = -1;
+    if (m_filter)
+        m_filter->compile(m_atoms, &m_argumentCache, nullptr, nullptr, &m_lifetimes);
+
+    if (reset) {
+        endResetModel();
+    } else {
+        const QModelIndexList before = persistentIndexList();
+        QModelIndexList after;
+        after.reserve(before.size());
+        for (const QModelIndex &idx : before)
+            after.append(indexForOrdinal(ordinal(idx) - int(count), idx.column()));
+        changePersistentIndexList(before, after);
+    }
+}
+
+void Model::cancelFiltering()
+{
+    if (m_filterJob)
+        m_filterJob->m_canceled = true;
+    if (m_filterWatcher.isRunning())
+        m_filterWatcher.cancel();
+    m_pendingFilter.reset();
+    m_filterJob.reset();
+}
+
+void Model::filteringFinished()
+{
+    if (m_filterWatcher.isCanceled() || !m_filterJob)
+        return;
+
+    adoptFilterJob(*std::exchange(m_filterJob, nullptr));
+    // the filter was compiled against the job's copies: point it to the model's own ones
+    m_pendingFilter->compile(m_atoms, &m_argumentCache, nullptr, nullptr, &m_lifetimes);
+    applyFilterResult(m_filterWatcher.result());
+    emit filteringChanged(false);
+}
+
+void Model::applyFilterResult(const QList<int> &filtered)
+{
+    if (m_filterClock.isValid()) {
+        PerfCounters::add(PerfCounters::Filter, m_filterClock.nsecsElapsed());
+        m_filterClock.invalidate();
+    }
+    // swap in the result in one go
+    m_filter = std::move(m_pendingFilter);
+
+    if ((!m_pendingNarrowed && !m_pendingWidened) || !applyFilteredIncrementally(filtered, m_pendingNarrowed)) {
+        beginResetModel();
+        m_filtered = filtered;
+        recalculateTimeDelta();
+        rebuildFilteredIndex();
+        endResetModel();
+    }
+}
+
+bool Model::applyFilteredIncrementally(const QList<int> &filtered, bool narrowed)
+{
+    // filtered is a subsequence of m_filtered when narrowed and a supersequence otherwise.
+    // Find the runs of rows that differ, in the coordinates of the longer list.
+    const QList<int> &longer = narrowed ? m_filtered : filtered;
+    const QList<int> &shorter = narrowed ? filtered : m_filtered;
+
+    QList<std::pair<qsizetype, qsizetype>> runs; // first, count
+    for (qsizetype i = 0, j = 0; i < longer.size(); ) {
+        if ((j < shorter.size()) && (longer.at(i) == shorter.at(j))) {
+            ++i;
+            ++j;
+            continue;
+        }
+        const qsizetype first = i;
+        while ((i < longer.size()) && !((j < shorter.size()) && (longer.at(i) == shorter.at(j))))
+            ++i;
+        runs.append({ first, i - first });
+    }
+
+    // every run shifts the rest of the list: give up on fragmented changes to big views
+    static constexpr qsizetype MaxIncrementalCost = 64 * 1024 * 1024;
+    if (runs.size() * longer.size() > MaxIncrementalCost)
+        return false;
+
+    // cached cells are by row, and every run shifts the rows behind it
+    m_cellCache.clear();
+
+    if (narrowed) {
+        for (auto it = runs.crbegin(); it != runs.crend(); ++it) {
+            beginRemoveRows({ }, int(it->first), int(it->first + it->second - 1));
+            m_filtered.remove(it->first, it->second);
+            endRemoveRows();
+        }
+    } else {
+        for (const auto &[first, count] : std::as_const(runs)) {
+            beginInsertRows({ }, int(first), int(first + count - 1));
+            m_filtered.insert(first, count, 0);
+            std::copy(filtered.cbegin() + first, filtered.cbegin() + first + count, m_filtered.begin() + first);
+            endInsertRows();
+        }
+    }
+    Q_ASSERT(m_filtered == filtered);
+
+    recalculateTimeDelta();
+    rebuildFilteredIndex();
+    if (!m_filtered.isEmpty())
+        emit dataChanged(index(0, TimeDelta), index(rowCount({ }) - 1, TimeDelta));
+    return true;
+}
+
+void Model::recalculateTimeDelta()
+{
+    PerfCounters::Scope timing(PerfCounters::TimeDelta);
+    const qsizetype count = m_filtered.size();
+    m_filteredTimeDeltas.resize(count);
+
+    QList<std::pair<qsizetype, qsizetype>> ranges;
+    for (qsizetype from = 0; from < count; from += 256 * 1024)
+        ranges.append({ from, std::min<qsizetype>(from + 256 * 1024, count) });
+
+    QtConcurrent::blockingMap(ranges, [this](const std::pair<qsizetype, qsizetype> &r) {
+        const auto &time = m_messages.m_time;
+        for (qsizetype i = r.first; i < r.second; ++i) {
+            m_filteredTimeDeltas[i] = i ? qint64(time.at(m_filtered.at(i))) - qint64(time.at(m_filtered.at(i - 1)))
+                                        : 0;
+        }
+    });
+    m_timeDeltaStatistics = TimeDeltaStatistics::compute(m_filteredTimeDeltas);
+    m_statisticsRows = count;
+}
+
+void Model::rebuildFilteredIndex()
+{
+    m_cellCache.clear();
+
+    m_filteredRow.fill(-1, m_messages.size());
+    for (auto i = 0; i < m_filtered.size(); ++i)
+        m_filteredRow[m_filtered.at(i)] = i;
+}
+
+qint64 Model::timeDelta(int ordinal) const
+{
+    // hidden messages have no delta
+    const int row = m_filteredRow.at(ordinal);
+    return (row >= 0) ? m_filteredTimeDeltas.at(row) : 0;
+}
+
+Argument::Type Argument::typeOf(QByteArrayView text)
+{
+    // the formats written by wl_closure_print()
+    if (text.isEmpty())
+        return Type::Unknown;
+    if (text == "nil")
+        return Type::Nil;
+    const char c = text.at(0);
+    if (c == '"')
+        return Type::String;
+    if (text.startsWith("new id "))
+        return Type::NewId;
+    if (text.startsWith("fd "))
+        return Type::Fd;
+    if (text.startsWith("array"))
+        return Type::Array;
+    if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+        bool fixed = false;
+        for (qsizetype i = 1; i < text.size(); ++i) {
+            const char d = text.at(i);
+            if (d == '.')
+                fixed = true;
+            else if ((d < '0') || (d > '9'))
+                return Type::Unknown;
+        }
+        return fixed ? Type::Fixed : ((c == '-') ? Type::Int : Type::UInt);
+    }
+    if ((text.indexOf('#') > 0) || (text.indexOf('@') > 0))
+        return Type::Object;
+    return Type::Unknown;
+}
+
+Argument Argument::decode(QByteArrayView text, Type type)
+{
+    Argument a;
+    a.m_type = type;
+    a.m_text = text;
+
+    auto decodeObject = [&a](QByteArrayView ref) {
+        auto p = ref.indexOf('#');
+        if (p < 0)
+            p = ref.indexOf('@');
+        if (p >= 0) {
+            a.m_string = ref.first(p);
+            a.m_value = ref.sliced(p + 1).toUInt();
+        }
+    };
+
+    switch (type) {
+    case Type::Int:
+        a.m_value = text.toLongLong();
+        break;
+    case Type::UInt:
+        a.m_value = qint64(text.toULongLong());
+        break;
+    case Type::Fixed:
+        a.m_fixed = text.toDouble();
+        break;
+    case Type::String:
+        if ((text.size() >= 2) && text.endsWith('"'))
+            a.m_string = text.sliced(1, text.size() - 2);
+        break;
+    case Type::Object:
+        decodeObject(text);
+        break;
+    case Type::NewId:
+        decodeObject(text.sliced(7));
+        break;
+    case Type::Array: {
+        auto open = text.indexOf('[');
+        if ((open > 0) && text.endsWith(']'))
+            a.m_value = text.sliced(open + 1, text.size() - open - 2).toLongLong();
+        break;
+    }
+    case Type::Fd:
+        a.m_value = text.sliced(3).toLongLong();
+        break;
+    default:
+        break;
+    }
+    return a;
+}
+
+QString Argument::typeName(Type type)
+{
+    switch (type) {
+    case Type::Int:    return u"int"_s;
+    case Type::UInt:   return u"uint"_s;
+    case Type::Fixed:  return u"fixed"_s;
+    case Type::String: return u"string"_s;
+    case Type::Object: return u"object"_s;
+    case Type::NewId:  return u"new_id"_s;
+    case Type::Array:  return u"array"_s;
+    case Type::Fd:     return u"fd"_s;
+    case Type::Nil:    return u"nil"_s;
+    default:           return u"unknown"_s;
+    }
+}
+
+
+ArgumentCache::ArgumentCache(const ArgumentCache &other)
+    : m_offsets(other.m_offsets)
+    , m_tokens(other.m_tokens)
+    , m_rows(other.m_rows)
+{ }
+
+ArgumentCache &ArgumentCache::operator=(const ArgumentCache &other)
+{
+    if (this != &other) {
+        m_offsets = other.m_offsets;
+        m_tokens = other.m_tokens;
+        m_rows = other.m_rows;
+        m_recent.clear();
+    }
+    return *this;
+}
+
+void ArgumentCache::clear()
+{
+    m_offsets = { 0 };
+    m_tokens.clear();
+    m_rows = 0;
+    m_recent.clear();
+}
+
+void ArgumentCache::decodeAll(const MessageStore &store, const std::atomic_bool *canceled)
+{
+    if (isComplete(store))
+        return;
+
+    struct Range
+    {
+        qsizetype m_from;
+        qsizetype m_to;
+        QList<quint32> m_counts;
+        QList<Token> m_tokens;
+        bool m_done = false;
+    };
+
+    // only the rows appended since the last call need to be decoded
+    const qsizetype first = m_rows;
+    const qsizetype rows = store.size() - first;
+    const qsizetype threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    const qsizetype rangeSize = std::max<qsizetype>(16 * 1024, rows / (threads * 4) + 1);
+
+    std::vector<Range> ranges;
+    for (qsizetype from = first; from < store.size(); from += rangeSize)
+        ranges.push_back({ from, std::min(from + rangeSize, store.size()), { }, { } });
+
+    QtConcurrent::blockingMap(ranges, [&store, canceled](Range &r) {
+        if (canceled && canceled->load(std::memory_order_relaxed))
+            return;
+        r.m_counts.reserve(r.m_to - r.m_from);
+        for (qsizetype i = r.m_from; i < r.m_to; ++i) {
+            const QByteArrayView raw = store.arguments(i);
+            quint32 count = 0;
+            if (raw.size() <= 0xffff) {
+                for (const auto &text : MessageStore::splitArguments(raw)) {
+                    r.m_tokens.append({ quint16(text.data() ? text.data() - raw.data() : 0),
+                                        quint16(text.size()), Argument::typeOf(text) });
+                    ++count;
+                }
+            }
+            r.m_counts.append(count);
+        }
+        r.m_done = true;
+    });
+
+    // when canceled, the ranges up to the first one that was skipped are kept
+    m_offsets.reserve(store.size() + 1);
+    for (const auto &r : ranges) {
+        if (!r.m_done)
+            break;
+        for (auto count : r.m_counts)
+            m_offsets.append(m_offsets.constLast() + count);
+        m_tokens.append(r.m_tokens);
+        m_rows = r.m_to;
+    }
+    m_recent.clear();
+}
+
+bool ArgumentCache::hasTokens(qsizetype i) const
+{
+    return (i < m_rows) && (m_offsets.at(i + 1) > m_offsets.at(i));
+}
+
+MessageStore::ArgumentList ArgumentCache::texts(const MessageStore &store, qsizetype i) const
+{
+    const QByteArrayView raw = store.arguments(i);
+    if (!hasTokens(i))
+        return MessageStore::splitArguments(raw);
+
+    MessageStore::ArgumentList list;
+    for (auto t = m_offsets.at(i); t < m_offsets.at(i + 1); ++t) {
+        const Token &token = m_tokens.at(t);
+        list.append(raw.sliced(token.m_offset, token.m_size));
+    }
+    return list;
+}
+
+ArgumentCache::Arguments ArgumentCache::arguments(const MessageStore &store, qsizetype i) const
+{
+    const QByteArrayView raw = store.arguments(i);
+    Arguments result;
+
+    if (hasTokens(i)) {
+        for (auto t = m_offsets.at(i); t < m_offsets.at(i + 1); ++t) {
+            const Token &token = m_tokens.at(t);
+            result.append(Argument::decode(raw.sliced(token.m_offset, token.m_size), token.m_type));
+        }
+        return result;
+    }
+    if (const Arguments *cached = m_recent.object(i))
+        return *cached;
+
+    for (const auto &text : MessageStore::splitArguments(raw))
+        result.append(Argument::decode(text));
+    m_recent.insert(i, new Arguments(result));
+    return result;
+}
+
+
+void MessageIndex::clear()
+{
+    for (auto &postings : m_postings)
+        postings.clear();
+    m_argumentPostings.clear();
+    m_rows = 0;
+    m_argumentRows = 0;
+    m_timeOrdered = true;
+}
+
+void MessageIndex::update(const MessageStore &store)
+{
+    // ordinals only ever get appended, so the lists stay sorted
+    for (qsizetype i = m_rows; i < store.size(); ++i) {
+        const int o = int(i);
+        if (i && (store.m_time.at(i) < store.m_time.at(i - 1)))
+            m_timeOrdered = false;
+
+        const ObjectRef &object = store.m_object.at(i);
+        m_postings[Class][object.m_class].append(o);
+        m_postings[Instance][object.m_instance].append(o);
+        m_postings[Method][store.m_method.at(i)].append(o);
+
+        // a message can create or destroy the same class more than once
+        auto appendOnce = [o](Postings &postings) {
+            if (postings.isEmpty() || (postings.constLast() != o))
+                postings.append(o);
+        };
+        for (const auto &created : store.created(i))
+            appendOnce(m_postings[CreatedClass][created.m_class]);
+        for (const auto &destroyed : store.destroyed(i))
+            appendOnce(m_postings[DestroyedClass][destroyed.m_class]);
+    }
+    m_rows = store.size();
+}
+
+void MessageIndex::updateArguments(const MessageStore &store, const ArgumentCache &cache,
+                                   const std::atomic_bool *canceled)
+{
+    for (qsizetype i = m_argumentRows; i < store.size(); ++i) {
+        // the rows indexed so far are kept when canceled
+        if (canceled && !(i % (16 * 1024)) && canceled->load(std::memory_order_relaxed)) {
+            m_argumentRows = i;
+            return;
+        }
+        const int o = int(i);
+        for (const auto &text : cache.texts(store, i)) {
+            auto &postings = m_argumentPostings[text];
+            if (postings.isEmpty() || (postings.constLast() != o))
+                postings.append(o);
+        }
+    }
+    m_argumentRows = store.size();
+}
+
+bool MessageIndex::timeRange(const MessageStore &store, quint64 min, quint64 max, int &first, int &last) const
+{
+    if (!m_timeOrdered || (m_rows != store.size()))
+        return false;
+
+    const auto begin = store.m_time.cbegin();
+    const auto end = store.m_time.cend();
+    const auto from = min ? std::lower_bound(begin, end, min) : begin;
+    const auto to = max ? std::upper_bound(from, end, max) : end;
+    first = int(from - begin);
+    last = int(to - begin);
+    return true;
+}
+
+MessageIndex::Postings MessageIndex::unite(const QList<Postings> &lists)
+{
+    Postings result;
+    for (const auto &postings : lists) {
+        if (result.isEmpty()) {
+            result = postings;
+        } else if (!postings.isEmpty()) {
+            Postings merged;
+            merged.reserve(result.size() + postings.size());
+            std::set_union(result.cbegin(), result.cend(), postings.cbegin(), postings.cend(),
+                           std::back_inserter(merged));
+            result = std::move(merged);
+        }
+    }
+    return result;
+}
+
+MessageIndex::Postings MessageIndex::intersect(const Postings &p1, const Postings &p2)
+{
+    // walk the shorter list and gallop through the longer one
+    const Postings &shorter = (p1.size() <= p2.size()) ? p1 : p2;
+    const Postings &longer = (p1.size() <= p2.size()) ? p2 : p1;
+
+    Postings result;
+    auto it = longer.cbegin();
+    for (int o : shorter) {
+        qsizetype step = 1;
+        auto bound = it;
+        while ((bound != longer.cend()) && (*bound < o)) {
+            it = bound;
+            bound = ((longer.cend() - bound) > step) ? bound + step : longer.cend();
+            step *= 2;
+        }
+        it = std::lower_bound(it, bound, o);
+        if (it == longer.cend())
+            break;
+        if (*it == o)
+            result.append(o);
+    }
+    return result;
+}
+
+
+void LifetimeIndex::clear()
+{
+    *this = LifetimeIndex();
+}
+
+void LifetimeIndex::update(const MessageStore &store)
+{
+    for (qsizetype i = m_rows; i < store.size(); ++i) {
+        const int o = int(i);
+        const quint64 time = store.m_time.at(i);
+        const Atom connection = store.m_connection.at(i);
+
+        auto refer = [&](const ObjectRef &object) -> Lifetime & {
+            Lifetime &lifetime = m_lifetimes[Key { connection, object }];
+            if (lifetime.m_messages.isEmpty())
+                lifetime.m_birth = time;
+            if (lifetime.m_messages.isEmpty() || (lifetime.m_messages.constLast() != o))
+                lifetime.m_messages.append(o);
+            if (lifetime.m_destroyed < 0)
+                lifetime.m_death = time;
+            return lifetime;
+        };
+
+        for (const ObjectRef &created : store.created(i)) {
+            const auto id = std::make_pair(connection, created.m_instance);
+            auto it = m_alive.find(id);
+            if (it != m_alive.end()) {
+                // server side ids are reused without a destructor: the old object is gone now
+                Lifetime &previous = m_lifetimes[Key { connection, it.value() }];
+                if (previous.m_destroyed < 0) {
+                    previous.m_destroyed = o;
+                    previous.m_death = time;
+                }
+            }
+            Lifetime &lifetime = refer(created);
+            lifetime.m_created = o;
+            lifetime.m_birth = time;
+            m_alive.insert(id, created);
+        }
+
+        // objects that predate the log are only ever seen as targets
+        const ObjectRef &object = store.m_object.at(i);
+        refer(object);
+        const auto objectId = std::make_pair(connection, object.m_instance);
+        if (!m_alive.contains(objectId))
+            m_alive.insert(objectId, object);
+
+        // arguments only name class#instance (or class@instance in older libwayland versions):
+        // the generation is the one alive right now. new_id arguments were already taken care
+        // of as created objects.
+        const QByteArrayView arguments = store.arguments(i);
+        if (arguments.contains('#') || arguments.contains('@')) {
+            for (const auto &text : MessageStore::splitArguments(arguments)) {
+                if (Argument::typeOf(text) != Argument::Type::Object)
+                    continue;
+                const Argument argument = Argument::decode(text, Argument::Type::Object);
+                auto it = m_alive.constFind(std::make_pair(connection, uint(argument.m_value)));
+                if (it != m_alive.cend())
+                    refer(it.value());
+            }
+        }
+
+        for (const ObjectRef &destroyed : store.destroyed(i)) {
+            Lifetime &lifetime = refer(destroyed);
+            lifetime.m_destroyed = o;
+            lifetime.m_death = time;
+            const auto id = std::make_pair(connection, destroyed.m_instance);
+            if (m_alive.value(id) == destroyed)
+                m_alive.remove(id);
+        }
+    }
+    m_rows = store.size();
+}
+
+const LifetimeIndex::Lifetime *LifetimeIndex::lifetime(const Key &key) const
+{
+    auto it = m_lifetimes.constFind(key);
+    return (it != m_lifetimes.cend()) ? &it.value() : nullptr;
+}
+
+bool LifetimeIndex::refersTo(const Key &key, int ordinal) const
+{
+    const Lifetime *l = lifetime(key);
+    return l && std::binary_search(l->m_messages.cbegin(), l->m_messages.cend(), ordinal);
+}
+
+QList<LifetimeIndex::Key> LifetimeIndex::leaks() const
+{
+    QList<Key> result;
+    for (auto it = m_lifetimes.cbegin(); it != m_lifetimes.cend(); ++it) {
+        if ((it->m_created >= 0) && (it->m_destroyed < 0))
+            result.append(it.key());
+    }
+    std::sort(result.begin(), result.end(), [this](const Key &k1, const Key &k2) {
+        return lifetime(k1)->m_created < lifetime(k2)->m_created;
+    });
+    return result;
+}
+
+
+ObjectRegistry::ObjectRegistry(const AtomTable *atoms)
+    : m_atoms(atoms)
+{ }
+
+QString ObjectRegistry::className(Atom class_) const
+{
+    return (m_atoms && (class_ < m_atoms->size())) ? m_atoms->string(class_) : QString::number(class_);
+}
+
+const ObjectRef *ObjectRegistry::find(uint instance) const
+{
+    if (instance < DenseInstanceLimit) {
+        if ((instance < m_denseObjects.size()) && m_denseObjects.at(instance).m_instance)
+            return &m_denseObjects.at(instance);
+        return nullptr;
+    }
+    auto it = m_sparseObjects.constFind(instance);
+    return (it != m_sparseObjects.cend()) ? &it.value() : nullptr;
+}
+
+void ObjectRegistry::insert(const ObjectRef &o)
+{
+    if (o.m_instance < DenseInstanceLimit) {
+        if (o.m_instance >= m_denseObjects.size())
+            m_denseObjects.resize(std::max<qsizetype>(o.m_instance + 1, m_denseObjects.size() * 2));
+        m_denseObjects[o.m_instance] = o;
+    } else {
+        m_sparseObjects.insert(o.m_instance, o);
+    }
+}
+
+ObjectRef ObjectRegistry::take(uint instance)
+{
+    if (instance < DenseInstanceLimit)
+        return std::exchange(m_denseObjects[instance], { });
+    return m_sparseObjects.take(instance);
+}
+
+ObjectRef ObjectRegistry::resolve(Atom class_, uint instance)
+{
+    const ObjectRef *found = find(instance);
+    ObjectRef o;
+    if (!found) {
+        auto it = (class_ == AtomTable::EmptyAtom) ? m_graveyard.cend()
+                                                   : m_graveyard.constFind(std::make_pair(class_, instance));
+        if (it == m_graveyard.cend()) {
+            throw Exception("resolve failed to find an instance of %#%2")
+                .arg(className(class_)).arg(instance);
+        }
+        o = it.value();
+        qWarning().nospace() << "Found object " << className(o.m_class) << "#" << o.m_instance << " in the graveyard";
+    } else {
+        o = *found;
+    }
+    if ((class_ != AtomTable::EmptyAtom) && (o.m_class != class_)) {
+        throw Exception("resolve found object %1#%2, but it should have been of class %3")
+            .arg(className(o.m_class)).arg(instance).arg(className(class_));
+    }
+    return o;
+}
+
+ObjectRef ObjectRegistry::create(Atom class_, uint instance)
+{
+    if (const ObjectRef *found = find(instance)) {
+        throw Exception("trying to create an already existing object: %1#%2 (found: %3#%4)")
+            .arg(className(class_)).arg(instance)
+            .arg(className(found->m_class)).arg(found->m_instance);
+    }
+    uint generation = 1; 
+    auto genKey = std::make_pair(class_, instance);
+    auto genIt = m_generations.find(genKey);
+    if (genIt != m_generations.end())
+        generation = ++genIt.value();
+    else
+        m_generations.insert(genKey, generation);
+       
+    ObjectRef o(class_, instance, generation);
+    insert(o);
+    return o;
+}
+
+ObjectRef ObjectRegistry::destroy(uint instance)
+{
+    if (!find(instance))
+        throw Exception("destroy for unknown object #%1").arg(instance);
+    auto o = take(instance);
+    m_graveyard.insert(std::make_pair(o.m_class, o.m_instance), o);
+    return o;
+}
+
+ObjectRef ObjectRegistry::destroyIfExists(uint instance)
+{
+    if (find(instance))
+        return take(instance);
+    return { };
+}
+
+Parser::Parser(const QString &fileName)
+    : m_device(new QFile(fileName))
+    , m_ownsDevice(true)
+{
+    m_device->open(QIODevice::ReadOnly);
+}
+
+Parser::Parser(QIODevice *device)
+    : m_device(device)
+{
+}
+
+Parser::~Parser()
 {
     if (m_ownsDevice)
         delete m_device;
 };
 
-Model *Parser::parse()
+Model *Parser::parse()
+{
+    auto model = std::make_unique<Model>();
+    parse([&model](const Batch &batch) {
+        // the model's AtomTable ends up as a copy of ours
+        for (const auto &str : batch.m_newAtoms)
+            model->m_atoms.intern(str);
+        model->m_messages.append(batch.m_messages);
+    });
+    model->init();
+    return model.release();
+}
+
+bool Parser::parse(const BatchHandler &handler, const std::atomic_bool *canceled)
+{
+    PerfCounters::Scope timing(PerfCounters::Parse);
+    m_connectionRegistry = { };
+    m_atoms = { };
+    m_publishedAtoms = m_atoms.size();
+    m_batch.clear();
+    m_tail.clear();
+    m_lineNumber = 0;
+    m_bytesRead = 0;
+
+    auto isCanceled = [canceled]() { return canceled && canceled->load(std::memory_order_relaxed); };
+
+    try {
+        if (!m_device)
+            throw Exception("No Wayland log provided");
+        if (!m_device->isReadable())
+            throw Exception("Wayland log is not readable");
+
+        // compressed logs are decoded on a thread of their own, while we already parse
+        std::unique_ptr<DecompressingDevice> decompressor;
+        QIODevice *device = m_device;
+        const auto format = DecompressingDevice::detect(m_device);
+        m_compressed = (format != DecompressingDevice::Format::None);
+        if (m_compressed) {
+            if (!DecompressingDevice::isSupported(format)) {
+                throw Exception("%1 compressed logs are not supported by this build")
+                    .arg(DecompressingDevice::formatName(format));
+            }
+            decompressor = std::make_unique<DecompressingDevice>(m_device, format);
+            decompressor->open(QIODevice::ReadOnly);
+            device = decompressor.get();
+        }
+        // there is no following a compressed stream
+        const bool follow = m_follow && !m_compressed;
+
+        // WAYLAND_DEBUG output is (almost) plain ASCII: tokenize straight from the mapped file,
+        // or in blocks of complete lines as raw bytes for devices we cannot map
+        auto *file = decompressor ? nullptr : qobject_cast<QFile *>(m_device);
+        const qint64 fileSize = (file && !file->isSequential()) ? file->size() : 0;
+
+        // unless following, the arguments point right into the mapping, which then lives as
+        // long as any of the messages does. That needs a QFile of its own, as closing a file
+        // also unmaps it.
+        std::shared_ptr<char[]> mapping;
+        if ((fileSize > 0) && !follow && !file->fileName().isEmpty()) {
+            auto mappedFile = std::make_shared<QFile>(file->fileName());
+            uchar *p = (mappedFile->open(QIODevice::ReadOnly) && (mappedFile->size() == fileSize))
+                           ? mappedFile->map(0, fileSize) : nullptr;
+            if (p) {
+                mapping = std::shared_ptr<char[]>(reinterpret_cast<char *>(p), [mappedFile](char *p) {
+                    mappedFile->unmap(reinterpret_cast<uchar *>(p));
+                });
+            }
+        }
+        uchar *mapped = mapping ? reinterpret_cast<uchar *>(mapping.get())
+                                : ((fileSize > 0) ? file->map(0, fileSize) : nullptr);
+
+        static constexpr qint64 FirstSliceSize = 4 * 1024 * 1024;
+        static constexpr qint64 SliceSize = 64 * 1024 * 1024;
+
+        if (mapped) {
+            auto unmap = qScopeGuard([file, mapped, owned = bool(mapping)]() {
+                if (!owned)
+                    file->unmap(mapped);
+            });
+            const char *data = reinterpret_cast<const char *>(mapped);
+
+            // a file that is still being written to most likely ends in the middle of a line
+            qint64 complete = fileSize;
+            if (follow) {
+                while ((complete > 0) && (data[complete - 1] != '\n'))
+                    --complete;
+                m_tail = QByteArray(data + complete, fileSize - complete);
+            }
+
+            qint64 sliceSize = FirstSliceSize;
+            for (qint64 pos = 0; (pos < complete) && !isCanceled(); sliceSize = SliceSize) {
+                qint64 end = std::min(pos + sliceSize, complete);
+                if (end < complete) {
+                    const void *eol = std::memchr(data + end, '\n', size_t(complete - end));
+                    end = eol ? (static_cast<const char *>(eol) - data + 1) : complete;
+                }
+                parseBuffer(QByteArrayView(data + pos, end - pos), m_lineNumber, mapping);
+                pos = end;
+                m_bytesRead = (pos == complete) ? fileSize : pos;
+                publish(handler, m_bytesRead, fileSize);
+            }
+            // continue behind what we have seen when following
+            file->seek(fileSize);
+        } else {
+            const qint64 total = decompressor ? decompressor->sourceSize()
+                                              : (m_device->isSequential() ? 0 : m_device->size());
+            // progress is about the compressed bytes, if there are any
+            auto progress = [&](qint64 parsed) {
+                return decompressor ? decompressor->sourceBytesRead() : parsed;
+            };
+            qint64 blockSize = FirstSliceSize;
+            QByteArray buffer;
+            while (!device->atEnd() && !isCanceled()) {
+                const QByteArray block = device->read(blockSize);
+                if (block.isEmpty())
+                    break;
+                buffer.append(block);
+                m_bytesRead += block.size();
+                blockSize = SliceSize / 4;
+                auto eol = buffer.lastIndexOf('\n');
+                if (eol >= 0) {
+                    parseBuffer(QByteArrayView(buffer).first(eol + 1), m_lineNumber);
+                    buffer.remove(0, eol + 1);
+                    publish(handler, progress(m_bytesRead - buffer.size()), total);
+                }
+            }
+            if (decompressor && !decompressor->error().isEmpty())
+                throw Exception(decompressor->error());
+            if (follow) {
+                m_tail = buffer;
+            } else if (!isCanceled()) {
+                parseBuffer(buffer, m_lineNumber);
+                publish(handler, progress(m_bytesRead), total);
+            }
+        }
+        return !isCanceled();
+    } catch (const Exception &e) {
+        throw Exception("Wayland log parse error at line %1: %2")
+            .arg(m_lineNumber).arg(e.errorString());
+    }
+}
+
+void Parser::feed(QByteArrayView data, const BatchHandler &handler)
+{
+    m_tail.append(data);
+    m_bytesRead += data.size();
+    const auto eol = m_tail.lastIndexOf('\n');
+    if (eol < 0)
+        return;
+
+    try {
+        parseBuffer(QByteArrayView(m_tail).first(eol + 1), m_lineNumber);
+    } catch (const Exception &e) {
+        m_tail.clear();
+        throw Exception("Wayland log parse error at line %1: %2")
+            .arg(m_lineNumber).arg(e.errorString());
+    }
+    m_tail.remove(0, eol + 1);
+    publish(handler, m_bytesRead - m_tail.size(), 0);
+}
+
+void Parser::publish(const BatchHandler &handler, qint64 bytesRead, qint64 bytesTotal)
+{
+    Batch batch;
+    batch.m_messages = m_batch; // shallow: the arena blocks move over to the batch
+    m_batch.clear();
+    for (qsizetype a = m_publishedAtoms; a < m_atoms.size(); ++a)
+        batch.m_newAtoms.append(m_atoms.string(Atom(a)));
+    m_publishedAtoms = m_atoms.size();
+    batch.m_bytesRead = bytesRead;
+    batch.m_bytesTotal = bytesTotal;
+    handler(batch);
+}
+
+void Parser::parseBuffer(QByteArrayView data, uint &lineNumber, const std::shared_ptr<char[]> &mapping)
+{
+    if (data.isEmpty())
+        return;
+
+    // stage 1: cut the data into newline-aligned chunks and tokenize them in parallel.
+    // Everything that depends on the order of the messages (the object registries) is left
+    // for the sequential replay in stage 2.
+
+    const qsizetype threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    const qsizetype chunkSize = std::max<qsizetype>(1024 * 1024, data.size() / (threads * 4) + 1);
+
+    QList<ParsedChunk> chunks;
+    const char *pos = data.data();
+    const char *end = pos + data.size();
+    while (pos < end) {
+        const char *chunkEnd = pos + std::min<qsizetype>(chunkSize, end - pos);
+        if (chunkEnd < end) {
+            const char *eol = static_cast<const char *>(std::memchr(chunkEnd, '\n', size_t(end - chunkEnd)));
+            chunkEnd = eol ? eol + 1 : end;
+        }
+        ParsedChunk chunk;
+        chunk.m_data = QByteArrayView(pos, chunkEnd - pos);
+        chunk.m_mapped = bool(mapping);
+        chunks << chunk;
+        pos = chunkEnd;
+    }
+
+    QtConcurrent::blockingMap(chunks, &Parser::parseChunk);
+    // every batch that refers to the mapping keeps it alive
+    if (mapping && !chunks.isEmpty())
+        chunks.first().m_messages.m_arena.adopt(mapping, data.size());
+
+    // stage 2: replay the registry updates in file order
+    uint chunkLine = lineNumber;
+    QList<Atom> atomMap;
+    for (auto &chunk : chunks) {
+        if (chunk.m_atoms.m_overflow)
+            throw Exception("too many distinct class, method, connection and queue names");
+        atomMap.resize(chunk.m_atoms.m_strings.size());
+        for (qsizetype i = 0; i < atomMap.size(); ++i)
+            atomMap[i] = m_atoms.intern(QString::fromUtf8(chunk.m_atoms.m_strings.at(i)));
+
+        MessageStore &store = chunk.m_messages;
+        for (auto &a : store.m_connection)
+            a = atomMap.at(a);
+        for (auto &a : store.m_queue)
+            a = atomMap.at(a);
+        for (auto &a : store.m_method)
+            a = atomMap.at(a);
+        for (auto &o : store.m_object)
+            o.m_class = atomMap.at(o.m_class);
+        for (auto &o : store.m_createdPool)
+            o.m_class = atomMap.at(o.m_class);
+
+        for (qsizetype i = 0; i < store.size(); ++i) {
+            lineNumber = chunkLine + chunk.m_lineNumbers.at(i);
+            replayMessage(store, i);
+        }
+        chunkLine += chunk.m_lineCount;
+
+        m_batch.append(store);
+        store.clear();
+    }
+    lineNumber = chunkLine;
+}
+
+void Parser::parseChunk(ParsedChunk &chunk)
+{
+    const char *pos = chunk.m_data.data();
+    const char *end = pos + chunk.m_data.size();
+
+    while (pos < end) {
+        const char *eol = static_cast<const char *>(std::memchr(pos, '\n', size_t(end - pos)));
+        if (!eol)
+            eol = end;
+        QByteArrayView line(pos, eol - pos);
+        if (line.endsWith('\r'))
+            line.chop(1);
+        pos = eol + 1;
+
+        ++chunk.m_lineCount;
+        if (parseLine(line, chunk))
+            chunk.m_lineNumbers << chunk.m_lineCount;
+    }
+}
+
+bool Parser::tokenizeLine(QByteArrayView line, LineTokens &t)
 {
-    m_connectionRegistry = { };
+    // hand-written scanner for the same grammar as the regexp in tokenizeLineRegex():
+    //   [<connection> ]'['msec.usec'] '[{queue}] [->] object#instance.method(args)
+    // identifiers are plain ASCII, just like \w and \d in a regexp without Unicode properties
 
-    uint lineNumber = 0;
-    try {
-        if (!m_device)
-            throw Exception("No Wayland log provided");
-        if (!m_device->isReadable())
-            throw Exception("Wayland log is not readable");
+    const qsizetype end = line.size();
+    qsizetype pos = 0;
 
-        auto model = std::make_unique<Model>();
+    auto peek = [&](qsizetype p) { return (p < end) ? line.at(p) : '\0'; };
+    auto isDigit = [](char c) { return (c >= '0') && (c <= '9'); };
+    auto isWord = [&](char c) {
+        return isDigit(c) || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_');
+    };
+    auto skipWhile = [&](auto pred) {
+        qsizetype from = pos;
+        while ((pos < end) && pred(line.at(pos)))
+            ++pos;
+        return line.sliced(from, pos - from);
+    };
+    auto skipSpaces = [&]() { return skipWhile([](char c) { return c == ' '; }).size(); };
 
-        QTextStream ts(m_device);
-        QString line;
-        while (ts.readLineInto(&line)) {
-            ++lineNumber;
-            if (auto *m = parseLine(line))
-                model->m_messages << m;
-        }
+    t = { };
 
-        model->init();
-        return model.release();
-    } catch (const Exception &e) {
-        throw Exception("Wayland log parse error at line %1: %2")
-            .arg(lineNumber).arg(e.errorString());
+    if (peek(pos) == '<') {
+        ++pos;
+        t.m_connection = skipWhile([](char c) { return c != '>'; });
+        if (t.m_connection.isEmpty() || (peek(pos) != '>') || (peek(pos + 1) != ' '))
+            return false;
+        pos += 2;
     }
-};
-
+    if (peek(pos) != '[')
+        return false;
+    ++pos;
+    skipSpaces();
+    t.m_msec = skipWhile(isDigit);
+    if (t.m_msec.isEmpty() || (peek(pos) != '.'))
+        return false;
+    ++pos;
+    t.m_usec = skipWhile(isDigit);
+    if (t.m_usec.isEmpty() || (peek(pos) != ']'))
+        return false;
+    ++pos;
+    if (!skipSpaces())
+        return false;
+    if (peek(pos) == '{') {
+        ++pos;
+        t.m_queue = skipWhile([](char c) { return c != '}'; });
+        if (t.m_queue.isEmpty() || (peek(pos) != '}'))
+            return false;
+        ++pos;
+    }
+    skipSpaces();
+    if ((peek(pos) == '-') && (peek(pos + 1) == '>')) {
+        t.m_send = true;
+        pos += 2;
+    }
+    skipSpaces();
+    t.m_object = skipWhile(isWord);
+    if (t.m_object.isEmpty() || ((peek(pos) != '#') && (peek(pos) != '@')))
+        return false;
+    ++pos;
+    t.m_instance = skipWhile(isDigit);
+    if (t.m_instance.isEmpty() || (peek(pos) != '.'))
+        return false;
+    ++pos;
+    t.m_method = skipWhile(isWord);
+    if (t.m_method.isEmpty() || (peek(pos) != '('))
+        return false;
+    ++pos;
+    // the regexp's greedy (.*) matches up to the last ')', which has to be the last character
+    if ((end - pos < 1) || (line.at(end - 1) != ')'))
+        return false;
+    t.m_arguments = line.sliced(pos, end - 1 - pos);
+    return true;
+}
 
-Message *Parser::parseLine(const QString &line)
+bool Parser::tokenizeLineRegex(QByteArrayView line, LineTokens &t)
 {
-    if ((!line.startsWith(u'<') && !line.startsWith(u'[')) || !line.endsWith(u')'))
-        return nullptr;
-
+    // not used for parsing anymore: this is the reference tokenizeLine() is checked against,
+    // see compareTokenizers() and wlanalyze-bench --check-tokenizers
     // https://regex101.com/r/8yVF1H/3
     static QRegularExpression re(uR"(^(<(?'connection'[^>]+)> )?\[ *(?'msec'\d+)\.(?'usec'\d+)\] +(\{(?'queue'[^\}]+)\})? *(?'send'->)? *(?'object'\w+)[#@](?'instance'\d+)\.(?'method'\w+)\((?'args'.*)\)$)"_s);
-    auto match = re.match(line);
+
+    // Latin-1 maps every byte to exactly one QChar, so the capture offsets are byte offsets
+    const QString str = QString::fromLatin1(line);
+    auto match = re.match(str);
     if (!match.hasMatch())
-        return nullptr;
+        return false;
     if (match.lastCapturedIndex() != 11)
-        return nullptr;
+        return false;
+
+    auto captured = [&](QStringView name) {
+        if (!match.hasCaptured(name))
+            return QByteArrayView { };
+        return line.sliced(match.capturedStart(name), match.capturedLength(name));
+    };
+
+    t.m_connection = captured(u"connection");
+    t.m_msec = captured(u"msec");
+    t.m_usec = captured(u"usec");
+    t.m_queue = captured(u"queue");
+    t.m_send = match.hasCaptured(u"send");
+    t.m_object = captured(u"object");
+    t.m_instance = captured(u"instance");
+    t.m_method = captured(u"method");
+    t.m_arguments = captured(u"args");
+    return true;
+}
+
+QString Parser::compareTokenizers(QByteArrayView line, bool *accepted)
+{
+    LineTokens scanned;
+    LineTokens matched;
+    const bool scannedOk = tokenizeLine(line, scanned);
+    const bool matchedOk = tokenizeLineRegex(line, matched);
+    if (accepted)
+        *accepted = scannedOk;
+
+    if (scannedOk != matchedOk) {
+        return scannedOk ? u"only accepted by the scanner"_s
+                         : u"only accepted by the regexp"_s;
+    }
+    if (!scannedOk)
+        return { };
+
+    QStringList differences;
+    auto compare = [&](const char *field, QByteArrayView a, QByteArrayView b) {
+        // an optional field that is missing is a null view in one and an empty one in the other
+        if (a != b) {
+            differences << u"%1: \"%2\" vs. \"%3\""_s.arg(QLatin1StringView(field),
+                                                           QString::fromLatin1(a), QString::fromLatin1(b));
+        }
+    };
+    compare("connection", scanned.m_connection, matched.m_connection);
+    compare("msec", scanned.m_msec, matched.m_msec);
+    compare("usec", scanned.m_usec, matched.m_usec);
+    compare("queue", scanned.m_queue, matched.m_queue);
+    if (scanned.m_send != matched.m_send)
+        differences << (scanned.m_send ? u"send: only seen by the scanner"_s : u"send: only seen by the regexp"_s);
+    compare("object", scanned.m_object, matched.m_object);
+    compare("instance", scanned.m_instance, matched.m_instance);
+    compare("method", scanned.m_method, matched.m_method);
+    compare("arguments", scanned.m_arguments, matched.m_arguments);
+
+    // the conversion into a message has to come out the same as well: numbers, atoms and the
+    // created and destroyed objects
+    ParsedChunk scannedChunk;
+    ParsedChunk matchedChunk;
+    const bool scannedParsed = parseLine(line, scannedChunk);
+    const bool matchedParsed = parseLine(line, matchedChunk, &Parser::tokenizeLineRegex);
+    auto describe = [](const ParsedChunk &chunk) {
+        const MessageStore &ms = chunk.m_messages;
+        auto atom = [&chunk](Atom a) { return QString::fromLatin1(chunk.m_atoms.m_strings.value(a)); };
+        auto objects = [&](const QList<ObjectRef> &pool) {
+            QStringList names;
+            for (const auto &o : pool)
+                names << u"%1#%2"_s.arg(atom(o.m_class)).arg(o.m_instance);
+            return names.join(u' ');
+        };
+        const ObjectRef &o = ms.m_object.at(0);
+        return u"%1 <%2> {%3} %4 %5#%6.%7(%8) created [%9] destroyed [%10]"_s
+            .arg(ms.m_time.at(0)).arg(atom(ms.m_connection.at(0)), atom(ms.m_queue.at(0)))
+            .arg(int(ms.m_direction.at(0))).arg(atom(o.m_class)).arg(o.m_instance)
+            .arg(atom(ms.m_method.at(0)), QString::fromLatin1(ms.arguments(0)),
+                 objects(ms.m_createdPool), objects(ms.m_destroyedPool));
+    };
+    if (scannedParsed != matchedParsed) {
+        differences << (scannedParsed ? u"message: only from the scanner"_s : u"message: only from the regexp"_s);
+    } else if (scannedParsed) {
+        const QString a = describe(scannedChunk);
+        const QString b = describe(matchedChunk);
+        if (a != b)
+            differences << u"message: \"%1\" vs. \"%2\""_s.arg(a, b);
+    }
+    return differences.join(u", ");
+}
+
+bool Parser::parseLine(QByteArrayView line, ParsedChunk &chunk, Tokenizer tokenize)
+{
+    if ((!line.startsWith('<') && !line.startsWith('[')) || !line.endsWith(')'))
+        return false;
+
+    // both tokenizers accept the same grammar, so there is no point in falling back to the
+    // regexp for lines the scanner rejects
+    LineTokens t;
+    if (!tokenize(line, t))
+        return false;
 
-    auto m = std::make_unique<Message>();
-    m->m_connection = match.captured("connection");
-    if (!m_connectionRegistry.contains(m->m_connection))
-        m_connectionRegistry[m->m_connection].create("wl_display", 1);
-
-    m->m_queue = match.captured("queue");
-    m->m_direction = match.hasCaptured("send") ? Direction::ToCompositor : Direction::FromCompositor;
-    m->m_time = match.captured("msec").toULongLong() * 1000 + match.captured("usec").toULongLong();
-    m->m_object = m_connectionRegistry[m->m_connection].resolve(match.captured("object"), match.captured("instance").toUInt());
-    m->m_method = match.captured("method");
-    m->m_arguments = match.captured("args").split(u", "_s);
-    for (const auto &arg : std::as_const(m->m_arguments)) {
-        if (arg.startsWith(u"new id ")) {
-            auto p = arg.indexOf(u'@');
+    // the object, created and destroyed references are only placeholders (generation 0)
+    // until replayMessage() resolves them against the connection's registry
+    MessageStore &store = chunk.m_messages;
+    ChunkAtoms &atoms = chunk.m_atoms;
+
+    store.m_connection.append(atoms.intern(t.m_connection));
+    store.m_queue.append(atoms.intern(t.m_queue));
+    store.m_direction.append(t.m_send ? Direction::ToCompositor : Direction::FromCompositor);
+    store.m_time.append(t.m_msec.toULongLong() * 1000 + t.m_usec.toULongLong());
+    store.m_object.append(ObjectRef(atoms.intern(t.m_object), t.m_instance.toUInt()));
+    store.m_method.append(atoms.intern(t.m_method));
+    store.m_arguments.append(chunk.m_mapped ? t.m_arguments : store.m_arena.store(t.m_arguments));
+
+    // only new ids and delete_id need the structured arguments this early
+    const bool isDeleteId = (t.m_method == "delete_id");
+    const auto args = (isDeleteId || (t.m_arguments.indexOf("new id ") >= 0))
+                          ? MessageStore::splitArguments(t.m_arguments) : MessageStore::ArgumentList { };
+    for (const auto &arg : args) {
+        if (arg.startsWith("new id ")) {
+            auto p = arg.indexOf('@');
             if (p < 0)
-                p = arg.indexOf(u'#');
+                p = arg.indexOf('#');
             if (p > 0) {
-                QString class_ = arg.mid(7, p - 7);
-                uint instance = arg.mid(p + 1).toUInt();
+                QByteArrayView class_ = arg.sliced(7, p - 7);
+                uint instance = arg.sliced(p + 1).toUInt();
 
                 // special case: registry binds
-                if ((m->m_object.m_class == u"wl_registry")
-                    && (m->m_method == u"bind")
-                    && (m->m_arguments.size() == 4)
-                    && (class_ == u"[unknown]")) {
-                    class_ = m->m_arguments.at(1).mid(1).chopped(1); // remove quotes
+                if ((t.m_object == "wl_registry")
+                    && (t.m_method == "bind")
+                    && (args.size() == 4)
+                    && (class_ == "[unknown]")
+                    && (args.at(1).size() >= 2)) {
+                    class_ = args.at(1).sliced(1).chopped(1); // remove quotes
 
                     qWarning() << "FOund a reg bind for " << class_;
                 }
-
-                if (instance >= 0xff000000) // server side, but there are no delete_id calls
-                    m_connectionRegistry[m->m_connection].destroyIfExists(instance);
-
-                m->m_created << m_connectionRegistry[m->m_connection].create(class_, instance);
+                store.m_createdPool.append(ObjectRef(atoms.intern(class_), instance));
             }
         }
     }
-    if ((m->m_method == u"delete_id") && (m->m_arguments.size() == 1)) {
-        uint id = m->m_arguments.constFirst().toUInt();
+    store.m_createdOffsets.append(quint32(store.m_createdPool.size()));
+
+    if (isDeleteId && (args.size() == 1)) {
+        uint id = args.at(0).toUInt();
         if (id)
-            m->m_destroyed << m_connectionRegistry[m->m_connection].destroy(id);
+            store.m_destroyedPool.append(ObjectRef(AtomTable::EmptyAtom, id));
     }
-    return m.release();
+    store.m_destroyedOffsets.append(quint32(store.m_destroyedPool.size()));
+    return true;
 };
 
+Atom Parser::ChunkAtoms::intern(QByteArrayView str)
+{
+    if (str.isEmpty())
+        return AtomTable::EmptyAtom;
+    auto it = m_atoms.constFind(str);
+    if (it != m_atoms.cend())
+        return it.value();
+    if (m_strings.size() >= AtomTable::NoAtom) {
+        m_overflow = true;
+        return AtomTable::EmptyAtom;
+    }
+    Atom atom = Atom(m_strings.size());
+    m_strings.append(str);
+    m_atoms.insert(str, atom);
+    return atom;
+}
+
+void Parser::replayMessage(MessageStore &store, qsizetype i)
+{
+    const Atom connection = store.m_connection.at(i);
+    auto regIt = m_connectionRegistry.find(connection);
+    if (regIt == m_connectionRegistry.end()) {
+        regIt = m_connectionRegistry.insert(connection, ObjectRegistry(&m_atoms));
+        regIt->create(m_atoms.intern(u"wl_display"_s), 1);
+    }
+    ObjectRegistry &registry = *regIt;
+
+    ObjectRef &object = store.m_object[i];
+    object = registry.resolve(object.m_class, object.m_instance);
+    for (auto j = store.m_createdOffsets.at(i); j < store.m_createdOffsets.at(i + 1); ++j) {
+        ObjectRef &o = store.m_createdPool[j];
+        if (o.m_instance >= 0xff000000) // server side, but there are no delete_id calls
+            registry.destroyIfExists(o.m_instance);
+        o = registry.create(o.m_class, o.m_instance);
+    }
+    for (auto j = store.m_destroyedOffsets.at(i); j < store.m_destroyedOffsets.at(i + 1); ++j) {
+        ObjectRef &o = store.m_destroyedPool[j];
+        o = registry.destroy(o.m_instance);
+    }
+}
+
+
+bool LogMerger::merge(const QList<LogSource> &sources, Parser::Batch &result,
+                      const ProgressHandler &progress, const std::atomic_bool *canceled)
+{
+    struct Parsed
+    {
+        QStringList m_atoms = { QString { } };
+        MessageStore m_messages;
+        bool m_complete = false;
+        QString m_error;
+        qint64 m_bytesRead = 0;
+        qint64 m_bytesTotal = 0;
+    };
+
+    // every log gets a thread of its own, as the parsers already keep the thread pool busy
+    std::vector<Parsed> parsed(sources.size());
+    QMutex progressMutex;
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (qsizetype s = 0; s < sources.size(); ++s) {
+        threads.emplace_back(QThread::create([&, s]() {
+            Parsed &p = parsed[s];
+            try {
+                Parser parser(sources.at(s).m_fileName);
+                p.m_complete = parser.parse([&](const Parser::Batch &batch) {
+                    p.m_atoms.append(batch.m_newAtoms);
+                    p.m_messages.append(batch.m_messages);
+                    if (!progress)
+                        return;
+                    QMutexLocker locker(&progressMutex);
+                    p.m_bytesRead = batch.m_bytesRead;
+                    p.m_bytesTotal = batch.m_bytesTotal;
+                    qint64 bytesRead = 0;
+                    qint64 bytesTotal = 0;
+                    for (const auto &other : parsed) {
+                        bytesRead += other.m_bytesRead;
+                        bytesTotal += other.m_bytesTotal;
+                    }
+                    progress(bytesRead, bytesTotal);
+                }, canceled);
+            } catch (const Exception &e) {
+                p.m_error = u"%1: %2"_s.arg(sources.at(s).m_fileName, e.errorString());
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads)
+        thread->wait();
+
+    for (const auto &p : parsed) {
+        if (!p.m_error.isEmpty())
+            throw Exception(p.m_error);
+    }
+    if (!std::all_of(parsed.cbegin(), parsed.cend(), [](const Parsed &p) { return p.m_complete; }))
+        return false;
+
+    // each log uses the atoms of its own parser: map them to a common table, with the
+    // connections of every log in a namespace of their own
+    struct Cursor
+    {
+        const MessageStore *m_messages;
+        const QStringList *m_strings;
+        QString m_label;
+        QList<Atom> m_atoms;
+        QList<Atom> m_connections; // NoAtom until the atom shows up as a connection
+        qint64 m_clockOffset;
+        qsizetype m_next = 0;
+
+        quint64 time() const
+        {
+            const qint64 t = qint64(m_messages->m_time.at(m_next)) + m_clockOffset;
+            return quint64(std::max<qint64>(t, 0));
+        }
+    };
+
+    AtomTable atoms;
+    std::vector<Cursor> cursors;
+    qsizetype rows = 0;
+    MessageStore &out = result.m_messages;
+    out.clear();
+    for (qsizetype s = 0; s < sources.size(); ++s) {
+        const Parsed &p = parsed[s];
+        const LogSource &source = sources.at(s);
+        const QString label = source.m_label.isEmpty() ? QFileInfo(source.m_fileName).fileName()
+                                                        : source.m_label;
+        Cursor cursor { &p.m_messages, &p.m_atoms, label, { }, { }, source.m_clockOffset };
+        cursor.m_atoms.reserve(p.m_atoms.size());
+        for (const QString &str : p.m_atoms)
+            cursor.m_atoms.append(atoms.intern(str));
+        // only a handful of atoms are connections: the prefixed names are added as they show
+        // up, or every class and method would take up two entries of the 16 bit table
+        cursor.m_connections.fill(AtomTable::NoAtom, p.m_atoms.size());
+        cursors.push_back(std::move(cursor));
+        out.m_arena.adopt(p.m_messages.m_arena);
+        rows += p.m_messages.size();
+        result.m_bytesRead += p.m_bytesRead;
+        result.m_bytesTotal += p.m_bytesTotal;
+    }
+
+    out.m_time.reserve(rows);
+    out.m_direction.reserve(rows);
+    out.m_connection.reserve(rows);
+    out.m_queue.reserve(rows);
+    out.m_object.reserve(rows);
+    out.m_method.reserve(rows);
+    out.m_arguments.reserve(rows);
+    out.m_createdOffsets.reserve(rows + 1);
+    out.m_destroyedOffsets.reserve(rows + 1);
+
+    // k-way merge: the heap holds the next row of every log and equal times are taken in
+    // the order of the sources, so the result does not depend on the thread timing
+    using Head = std::pair<quint64, qsizetype>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (qsizetype s = 0; s < qsizetype(cursors.size()); ++s) {
+        if (!cursors[s].m_messages->isEmpty())
+            heads.emplace(cursors[s].time(), s);
+    }
+
+    auto mapRefs = [](QList<ObjectRef> &pool, std::span<const ObjectRef> refs, const Cursor &c) {
+        for (const ObjectRef &ref : refs)
+            pool.append(ObjectRef(c.m_atoms.at(ref.m_class), ref.m_instance, ref.m_generation));
+    };
+
+    while (!heads.empty()) {
+        const auto [time, s] = heads.top();
+        heads.pop();
+        Cursor &c = cursors[s];
+        const MessageStore &in = *c.m_messages;
+        const qsizetype i = c.m_next;
+
+        out.m_time.append(time);
+        out.m_direction.append(in.m_direction.at(i));
+        Atom &connection = c.m_connections[in.m_connection.at(i)];
+        if (connection == AtomTable::NoAtom) {
+            const QString &str = c.m_strings->at(in.m_connection.at(i));
+            connection = atoms.intern(str.isEmpty() ? c.m_label : c.m_label + u':' + str);
+        }
+        out.m_connection.append(connection);
+        out.m_queue.append(c.m_atoms.at(in.m_queue.at(i)));
+        const ObjectRef &object = in.m_object.at(i);
+        out.m_object.append(ObjectRef(c.m_atoms.at(object.m_class), object.m_instance, object.m_generation));
+        out.m_method.append(c.m_atoms.at(in.m_method.at(i)));
+        out.m_arguments.append(in.arguments(i)); // still in the source's arena, adopted above
+        mapRefs(out.m_createdPool, in.created(i), c);
+        out.m_createdOffsets.append(quint32(out.m_createdPool.size()));
+        mapRefs(out.m_destroyedPool, in.destroyed(i), c);
+        out.m_destroyedOffsets.append(quint32(out.m_destroyedPool.size()));
+
+        if (++c.m_next < in.size())
+            heads.emplace(c.time(), s);
+    }
+
+    result.m_newAtoms.clear();
+    for (qsizetype a = 1; a < atoms.size(); ++a)
+        result.m_newAtoms.append(atoms.string(Atom(a)));
+    return true;
+}
+
+
+Loader::Loader(const QString &fileName, Model *model, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_model(model)
+{ }
+
+Loader::Loader(const QList<LogSource> &sources, Model *model, QObject *parent)
+    : QObject(parent)
+    , m_fileName(sources.isEmpty() ? QString { } : sources.constFirst().m_fileName)
+    , m_sources(sources)
+    , m_model(model)
+{ }
+
+Loader::~Loader()
+{
+    m_canceled = true;
+    stopFollowing();
+    m_worker.waitForFinished();
+}
+
+void Loader::start()
+{
+    if (isRunning())
+        return;
+    m_canceled = false;
+
+    if (m_sources.size() > 1) {
+        startMerge();
+        return;
+    }
+
+    // the parser outlives the worker when following, so both live here
+    m_file = std::make_unique<QFile>();
+    if (m_fileName == u"-"_s) {
+        m_file->open(stdin, QIODevice::ReadOnly);
+    } else {
+        m_file->setFileName(m_fileName);
+        m_file->open(QIODevice::ReadOnly);
+    }
+    m_parser = std::make_unique<Parser>(m_file.get());
+    m_parser->setFollow(m_follow);
+
+#if defined(Q_OS_UNIX)
+    if (m_follow && m_file->isSequential()) {
+        // a pipe only ends when the writer goes away: there is nothing to load up front
+        QMetaObject::invokeMethod(this, &Loader::follow, Qt::QueuedConnection);
+        return;
+    }
+#endif
+
+    // the batches travel to the GUI thread as queued calls: they are dropped together with
+    // this object if it goes away first
+    const bool useTraceCache = m_useTraceCache && !m_follow && !m_ringBufferSize && !m_file->isSequential();
+    m_worker = QtConcurrent::run([this, useTraceCache]() {
+        try {
+            TraceCache::Content content;
+            if (useTraceCache && TraceCache::load(m_fileName, content)) {
+                QMetaObject::invokeMethod(this, [this, content]() {
+                    m_model->setMessages(content.m_atoms, content.m_messages, content.m_index);
+                    emit progressChanged(1, 1);
+                    m_model->finishLoading();
+                    emit finished(false);
+                }, Qt::QueuedConnection);
+                return;
+            }
+
+            const bool complete = m_parser->parse([this](const Parser::Batch &batch) {
+                QMetaObject::invokeMethod(this, [this, batch]() {
+                    append(batch);
+                }, Qt::QueuedConnection);
+            }, &m_canceled);
+
+            QMetaObject::invokeMethod(this, [this, complete]() {
+                m_model->finishLoading();
+                if (complete && useTraceCache)
+                    saveTraceCache();
+                if (complete && m_follow && !m_parser->isCompressed())
+                    follow();
+                else
+                    emit finished(!complete);
+            }, Qt::QueuedConnection);
+        } catch (const Exception &e) {
+            QMetaObject::invokeMethod(this, [this, error = e.errorString()]() {
+                m_model->finishLoading();
+                emit failed(error);
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void Loader::cancel()
+{
+    m_canceled = true;
+    if (isFollowing()) {
+        stopFollowing();
+        m_model->finishLoading();
+        emit finished(true);
+    }
+}
+
+void Loader::startMerge()
+{
+    // nothing can be shown before all logs are parsed: only then it is known which one
+    // comes first
+    m_worker = QtConcurrent::run([this]() {
+        try {
+            Parser::Batch merged;
+            const bool complete = LogMerger::merge(m_sources, merged, [this](qint64 bytesRead, qint64 bytesTotal) {
+                QMetaObject::invokeMethod(this, [this, bytesRead, bytesTotal]() {
+                    emit progressChanged(bytesRead, bytesTotal);
+                }, Qt::QueuedConnection);
+            }, &m_canceled);
+
+            QMetaObject::invokeMethod(this, [this, complete, merged = std::move(merged)]() {
+                if (complete)
+                    append(merged);
+                m_model->finishLoading();
+                emit finished(!complete);
+            }, Qt::QueuedConnection);
+        } catch (const Exception &e) {
+            QMetaObject::invokeMethod(this, [this, error = e.errorString()]() {
+                m_model->finishLoading();
+                emit failed(error);
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+bool Loader::isRunning() const
+{
+    return m_worker.isRunning() || isFollowing();
+}
+
+void Loader::saveTraceCache()
+{
+    // the copies are shallow and the model cannot change underneath, as nothing gets appended
+    // to it without follow
+    TraceCache::Content content;
+    for (qsizetype a = 0; a < m_model->atoms().size(); ++a)
+        content.m_atoms.append(m_model->atoms().string(Atom(a)));
+    content.m_messages = m_model->messages();
+    content.m_index = m_model->messageIndex();
+
+    // nothing in there points back to us: no need to wait for it
+    m_cacheWriter = QtConcurrent::run([fileName = m_fileName, content]() {
+        try {
+            TraceCache::save(fileName, content);
+        } catch (const Exception &e) {
+            qWarning().noquote() << e.errorString();
+        }
+    });
+}
+
+void Loader::follow()
+{
+    if (m_canceled)
+        return;
+    if (!m_file->isReadable()) {
+        emit failed(u"Wayland log is not readable"_s);
+        return;
+    }
+
+#if defined(Q_OS_UNIX)
+    if (m_file->isSequential()) {
+        m_notifier = new QSocketNotifier(m_file->handle(), QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &Loader::readMore);
+        emit followingStarted();
+        return;
+    }
+#endif
+    // inotify and friends are quick, but do not work on every file system
+    m_watcher = new QFileSystemWatcher({ m_fileName }, this);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &Loader::readMore);
+    m_pollTimer = new QTimer(this);
+    m_pollTimer->setInterval(1000);
+    connect(m_pollTimer, &QTimer::timeout, this, &Loader::readMore);
+    m_pollTimer->start();
+    emit followingStarted();
+}
+
+void Loader::stopFollowing()
+{
+    delete m_notifier;
+    m_notifier = nullptr;
+    delete m_watcher;
+    m_watcher = nullptr;
+    delete m_pollTimer;
+    m_pollTimer = nullptr;
+}
+
+void Loader::readMore()
+{
+    QByteArray data;
+#if defined(Q_OS_UNIX)
+    if (m_notifier) {
+        // the notifier only promises that a single read() does not block
+        data.resize(1024 * 1024);
+        const auto bytes = ::read(m_file->handle(), data.data(), size_t(data.size()));
+        if ((bytes < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+            return;
+        if (bytes <= 0) {
+            // the writer closed the pipe
+            stopFollowing();
+            m_model->finishLoading();
+            emit finished(false);
+            return;
+        }
+        data.resize(bytes);
+    } else
+#endif
+    {
+        data = m_file->readAll();
+    }
+    if (data.isEmpty())
+        return;
+
+    try {
+        m_parser->feed(data, [this](const Parser::Batch &batch) { append(batch); });
+    } catch (const Exception &e) {
+        stopFollowing();
+        emit failed(e.errorString());
+    }
+}
+
+void Loader::append(const Parser::Batch &batch)
+{
+    m_model->appendMessages(batch.m_messages, batch.m_newAtoms);
+
+    // trim in steps of an eighth of the limit: every trim has to renumber all rows
+    if (m_ringBufferSize > 0) {
+        const qsizetype size = m_model->messages().size();
+        if (size > m_ringBufferSize + m_ringBufferSize / 8)
+            m_model->removeFirstMessages(size - m_ringBufferSize);
+    }
+    emit progressChanged(batch.m_bytesRead, batch.m_bytesTotal);
+}
+
+
+void Filter::compile(const AtomTable &atoms, const ArgumentCache *arguments, const MessageIndex *index,
+                     const MessageStore *store, const LifetimeIndex *lifetimes)
+{
+    m_argumentCache = arguments;
+    m_lifetimes = lifetimes;
+
+    auto toAtoms = [&atoms](const QStringList &strings) {
+        QList<Atom> result;
+        result.reserve(strings.size());
+        for (const auto &str : strings)
+            result.append(atoms.find(str)); // unknown strings become NoAtom and never match
+        return result;
+    };
+
+    m_connectionAtoms = toAtoms(m_connectionMatch);
+    m_queueAtoms = toAtoms(m_queueMatch);
+    m_classAtoms = toAtoms(m_classMatch);
+    m_methodAtoms = toAtoms(m_methodMatch);
+    m_destroyClassAtoms = toAtoms(m_destroyClassMatch);
+    m_createClassAtoms = toAtoms(m_createClassMatch);
+
+    m_argumentBytes.clear();
+    for (const auto &arg : std::as_const(m_argumentMatch))
+        m_argumentBytes.append(arg.toUtf8());
+
+    m_objectKeys.clear();
+    for (const auto &object : std::as_const(m_objectMatch)) {
+        m_objectKeys.append({ atoms.find(object.m_connection),
+                              ObjectRef(atoms.find(object.m_class), object.m_instance, object.m_generation) });
+    }
+
+    m_plan.reset();
+    if (!m_query.trimmed().isEmpty()) {
+        try {
+            m_plan = std::make_shared<Query>(Query::parse(m_query));
+        } catch (const Exception &) {
+            m_plan = std::make_shared<Query>(Query::nothing());
+        }
+        m_plan->compile(atoms, arguments, index, store);
+    }
+
+    m_candidates.clear();
+    m_hasCandidates = false;
+    m_timeIndexed = false;
+    m_scanned = false;
+    m_queryIndexed = false;
+    if (!index)
+        return;
+
+    int timeFirst = 0;
+    int timeLast = 0;
+    if ((m_timeMin || m_timeMax) && store)
+        m_timeIndexed = index->timeRange(*store, m_timeMin, m_timeMax, timeFirst, timeLast);
+
+    // every criterion is an OR over its values and an AND with all the other criteria
+    QList<MessageIndex::Postings> criteria;
+    auto addCriterion = [&](MessageIndex::Field field, const auto &keys) {
+        if (keys.isEmpty())
+            return;
+        QList<MessageIndex::Postings> lists;
+        for (const auto &key : keys)
+            lists.append(index->postings(field, uint(key)));
+        criteria.append(MessageIndex::unite(lists));
+    };
+    addCriterion(MessageIndex::Class, m_classAtoms);
+    addCriterion(MessageIndex::Instance, m_instanceMatch);
+    addCriterion(MessageIndex::Method, m_methodAtoms);
+    addCriterion(MessageIndex::CreatedClass, m_createClassAtoms);
+    addCriterion(MessageIndex::DestroyedClass, m_destroyClassAtoms);
+    if (!m_argumentBytes.isEmpty()) {
+        QList<MessageIndex::Postings> lists;
+        for (const auto &arg : std::as_const(m_argumentBytes))
+            lists.append(index->argumentPostings(arg));
+        criteria.append(MessageIndex::unite(lists));
+    }
+    if (!m_objectKeys.isEmpty() && lifetimes) {
+        QList<MessageIndex::Postings> lists;
+        for (const auto &key : std::as_const(m_objectKeys)) {
+            if (const auto *lifetime = lifetimes->lifetime(key))
+                lists.append(lifetime->m_messages);
+        }
+        criteria.append(MessageIndex::unite(lists));
+    }
+    const int rangeFirst = m_timeIndexed ? timeFirst : 0;
+    const int rangeLast = m_timeIndexed ? timeLast : int(store ? store->size() : 0);
+
+    if (!criteria.isEmpty()) {
+        // start with the most selective one, so the intersections only get cheaper
+        std::sort(criteria.begin(), criteria.end(), [](const auto &p1, const auto &p2) {
+            return p1.size() < p2.size();
+        });
+        m_candidates = criteria.takeFirst();
+        for (const auto &postings : std::as_const(criteria)) {
+            if (m_candidates.isEmpty())
+                break;
+            m_candidates = MessageIndex::intersect(m_candidates, postings);
+        }
+        if (m_timeIndexed) {
+            // ordinals are in time order as well: cut out the window
+            const auto from = std::lower_bound(m_candidates.cbegin(), m_candidates.cend(), rangeFirst);
+            const auto to = std::lower_bound(from, m_candidates.cend(), rangeLast);
+            m_candidates = m_candidates.sliced(from - m_candidates.cbegin(), to - from);
+        }
+        m_hasCandidates = true;
+    }
+
+    // the query plan does its own ordering: it only has to look at what is left over
+    if (m_plan && store) {
+        m_candidates = m_plan->evaluate(*store, rangeFirst, rangeLast, m_hasCandidates ? &m_candidates : nullptr);
+        m_hasCandidates = true;
+        m_queryIndexed = true;
+    }
+
+    // direction, connection and queue only have a handful of different values each, so a
+    // postings list would not help much: scan their columns instead. Unless there are only a
+    // few candidates left, which are cheaper to check one by one.
+    const bool needsScan = (m_directionMatch == Direction::FromCompositor)
+                           || (m_directionMatch == Direction::ToCompositor)
+                           || !m_connectionAtoms.isEmpty() || !m_queueAtoms.isEmpty();
+    if (needsScan && store && (!m_hasCandidates || (m_candidates.size() * 8 > rangeLast - rangeFirst))) {
+        const BitmapScan::Bitmap bits = scan(*store, rangeFirst, rangeLast);
+        if (m_hasCandidates) {
+            m_candidates.removeIf([&bits, rangeFirst](int o) { return !BitmapScan::test(bits, o - rangeFirst); });
+        } else {
+            m_candidates = BitmapScan::toOrdinals(bits.constData(), rangeLast - rangeFirst);
+            if (rangeFirst) {
+                for (int &o : m_candidates)
+                    o += rangeFirst;
+            }
+        }
+        m_scanned = true;
+        m_hasCandidates = true;
+    } else if (!m_hasCandidates && m_timeIndexed) {
+        m_candidates.resize(rangeLast - rangeFirst);
+        std::iota(m_candidates.begin(), m_candidates.end(), rangeFirst);
+        m_hasCandidates = true;
+    }
+}
+
+QList<quint64> Filter::scan(const MessageStore &store, int first, int last) const
+{
+    static constexpr qsizetype ChunkRows = 64 * 1024; // a multiple of 64
+
+    const qsizetype rows = last - first;
+    BitmapScan::Bitmap bits(BitmapScan::words(rows));
+
+    QList<qsizetype> chunks;
+    for (qsizetype from = 0; from < rows; from += ChunkRows)
+        chunks.append(from);
+
+    QtConcurrent::blockingMap(chunks, [&](qsizetype from) {
+        const qsizetype offset = first + from;
+        const qsizetype count = std::min(ChunkRows, rows - from);
+        quint64 *chunkBits = bits.data() + from / 64;
+        bool intersect = false;
+
+        if ((m_directionMatch == Direction::FromCompositor) || (m_directionMatch == Direction::ToCompositor)) {
+            static_assert(sizeof(Direction) == sizeof(quint8));
+            const quint8 direction = quint8(m_directionMatch);
+            BitmapScan::matchBytes(reinterpret_cast<const quint8 *>(store.m_direction.constData()) + offset,
+                                   count, { &direction, 1 }, chunkBits, intersect);
+            intersect = true;
+        }
+        if (!m_connectionAtoms.isEmpty()) {
+            BitmapScan::matchAtoms(store.m_connection.constData() + offset, count,
+                                   std::span<const Atom>(m_connectionAtoms.constData(), size_t(m_connectionAtoms.size())),
+                                   chunkBits, intersect);
+            intersect = true;
+        }
+        if (!m_queueAtoms.isEmpty()) {
+            BitmapScan::matchAtoms(store.m_queue.constData() + offset, count,
+                                   std::span<const Atom>(m_queueAtoms.constData(), size_t(m_queueAtoms.size())),
+                                   chunkBits, intersect);
+        }
+    });
+    return bits;
+}
+
+bool Filter::hasUnindexedCriteria() const
+{
+    if (!m_timeIndexed && (m_timeMin || m_timeMax))
+        return true;
+    if (m_plan && !m_queryIndexed)
+        return true;
+    return !m_scanned
+           && (((m_directionMatch == Direction::FromCompositor) || (m_directionMatch == Direction::ToCompositor))
+               || !m_connectionAtoms.isEmpty()
+               || !m_queueAtoms.isEmpty());
+}
+
+bool Filter::match(const MessageStore &store, qsizetype i) const
+{
+    return match(store, i, true);
+}
+
+bool Filter::matchUnindexed(const MessageStore &store, qsizetype i) const
+{
+    return match(store, i, !m_hasCandidates);
+}
 
-bool Filter::match(const Message *m) const
+bool Filter::match(const MessageStore &store, qsizetype i, bool withIndexed) const
 {
-    if (!m)
+    if ((i < 0) || (i >= store.size()))
         return false;
         
     if ((m_directionMatch == Direction::FromCompositor) || (m_directionMatch == Direction::ToCompositor)) {
-        if (m_directionMatch != m->m_direction)
+        if (m_directionMatch != store.m_direction.at(i))
             return false;
     }
-    if (m_timeMin || m_timeMax) {
-        if ((m_timeMin && (m->m_time < m_timeMin)) || (m_timeMax && (m->m_time > m_timeMax)))
+    if ((m_timeMin || m_timeMax) && (withIndexed || !m_timeIndexed)) {
+        const quint64 time = store.m_time.at(i);
+        if ((m_timeMin && (time < m_timeMin)) || (m_timeMax && (time > m_timeMax)))
             return false;
     }
-    if (!m_connectionMatch.isEmpty()) {
-        if (!m_connectionMatch.contains(m->m_connection))
+    if (!m_connectionAtoms.isEmpty()) {
+        if (!m_connectionAtoms.contains(store.m_connection.at(i)))
             return false;
     }
-    if (!m_queueMatch.isEmpty()) {
-        if (!m_queueMatch.contains(m->m_queue))
+    if (!m_queueAtoms.isEmpty()) {
+        if (!m_queueAtoms.contains(store.m_queue.at(i)))
             return false;
     }
-    if (!m_classMatch.isEmpty()) {
-        if (!m_classMatch.contains(m->m_object.m_class))
+    if (m_plan && (withIndexed || !m_queryIndexed)) {
+        if (!m_plan->match(store, i))
+            return false;
+    }
+    if (!withIndexed)
+        return true;
+
+    if (!m_classAtoms.isEmpty()) {
+        if (!m_classAtoms.contains(store.m_object.at(i).m_class))
             return false;
     }
     if (!m_instanceMatch.isEmpty()) {
-        if (!m_instanceMatch.contains(m->m_object.m_instance))
+        if (!m_instanceMatch.contains(store.m_object.at(i).m_instance))
             return false;
     }
-    if (!m_methodMatch.isEmpty()) {
-        if (!m_methodMatch.contains(m->m_method))
+    if (!m_methodAtoms.isEmpty()) {
+        if (!m_methodAtoms.contains(store.m_method.at(i)))
             return false;
     }
-    if (!m_argumentMatch.isEmpty()) {
+    if (!m_argumentBytes.isEmpty()) {
         bool found = false;
-        for (const auto &arg : m->m_arguments) {
-            if (m_argumentMatch.contains(arg)) {
+        const auto args = m_argumentCache ? m_argumentCache->texts(store, i) : store.argumentList(i);
+        for (const auto &arg : args) {
+            if (std::any_of(m_argumentBytes.cbegin(), m_argumentBytes.cend(),
+                            [arg](const QByteArray &match) { return QByteArrayView(match) == arg; })) {
                 found = true;
                 break;
             }
@@ -506,10 +3065,10 @@ bool Filter::match(const Message *m) const
         if (!found)
             return false;
     }
-    if (!m_createClassMatch.isEmpty()) {
+    if (!m_createClassAtoms.isEmpty()) {
         bool found = false;
-        for (const auto &o : m->m_created) {
-            if (m_createClassMatch.contains(o.m_class)) {
+        for (const auto &o : store.created(i)) {
+            if (m_createClassAtoms.contains(o.m_class)) {
                 found = true;
                 break;
             }
@@ -517,10 +3076,10 @@ bool Filter::match(const Message *m) const
         if (!found)
             return false;
     }
-    if (!m_destroyClassMatch.isEmpty()) {
+    if (!m_destroyClassAtoms.isEmpty()) {
         bool found = false;
-        for (const auto &o : m->m_destroyed) {
-            if (m_destroyClassMatch.contains(o.m_class )) {
+        for (const auto &o : store.destroyed(i)) {
+            if (m_destroyClassAtoms.contains(o.m_class)) {
                 found = true;
                 break;
             }
@@ -528,10 +3087,62 @@ bool Filter::match(const Message *m) const
         if (!found)
             return false;
     }
+    if (!m_objectKeys.isEmpty()) {
+        const Atom connection = store.m_connection.at(i);
+        auto refersTo = [&](const LifetimeIndex::Key &key) {
+            if (m_lifetimes)
+                return m_lifetimes->refersTo(key, int(i));
+            if (key.m_connection != connection)
+                return false;
+            auto isObject = [&key](const ObjectRef &o) { return o == key.m_object; };
+            const auto created = store.created(i);
+            const auto destroyed = store.destroyed(i);
+            return isObject(store.m_object.at(i))
+                   || std::any_of(created.begin(), created.end(), isObject)
+                   || std::any_of(destroyed.begin(), destroyed.end(), isObject);
+        };
+        if (std::none_of(m_objectKeys.cbegin(), m_objectKeys.cend(), refersTo))
+            return false;
+    }
         
     return true;
 }
 
+bool Filter::isSubsetOf(const Filter &other) const
+{
+    // true if every message matched by this filter is also matched by other
+    auto listSubset = [](const auto &mine, const auto &theirs) {
+        if (theirs.isEmpty())
+            return true;
+        if (mine.isEmpty())
+            return false;
+        return std::all_of(mine.cbegin(), mine.cend(), [&theirs](const auto &v) { return theirs.contains(v); });
+    };
+    auto direction = [](Direction d) {
+        return ((d == Direction::FromCompositor) || (d == Direction::ToCompositor)) ? d : Direction::Any;
+    };
+
+    if ((direction(other.m_directionMatch) != Direction::Any)
+        && (direction(other.m_directionMatch) != direction(m_directionMatch))) {
+        return false;
+    }
+    if (other.m_timeMin && (!m_timeMin || (m_timeMin < other.m_timeMin)))
+        return false;
+    if (other.m_timeMax && (!m_timeMax || (m_timeMax > other.m_timeMax)))
+        return false;
+
+    return listSubset(m_connectionMatch, other.m_connectionMatch)
+           && listSubset(m_queueMatch, other.m_queueMatch)
+           && listSubset(m_classMatch, other.m_classMatch)
+           && listSubset(m_instanceMatch, other.m_instanceMatch)
+           && listSubset(m_methodMatch, other.m_methodMatch)
+           && listSubset(m_argumentMatch, other.m_argumentMatch)
+           && listSubset(m_createClassMatch, other.m_createClassMatch)
+           && listSubset(m_destroyClassMatch, other.m_destroyClassMatch)
+           && listSubset(m_objectMatch, other.m_objectMatch)
+           && (other.m_query.trimmed().isEmpty() || (m_query.trimmed() == other.m_query.trimmed()));
+}
+
 bool Filter::isEmpty() const
 {
     return (m_directionMatch == Direction::Any)
@@ -544,7 +3155,62 @@ bool Filter::isEmpty() const
            && m_methodMatch.isEmpty()
            && m_argumentMatch.isEmpty()
            && m_createClassMatch.isEmpty()
-           && m_destroyClassMatch.isEmpty();
+           && m_destroyClassMatch.isEmpty()
+           && m_objectMatch.isEmpty()
+           && m_query.trimmed().isEmpty();
+}
+
+bool Filter::usesArguments() const
+{
+    if (!m_argumentMatch.isEmpty())
+        return true;
+    try {
+        return Query::parse(m_query).uses(Query::Argument);
+    } catch (const Exception &) {
+        return false;
+    }
+}
+
+QString Filter::toQuery() const
+{
+    auto term = [](QStringView field, const QStringList &values) {
+        QStringList quoted;
+        for (const auto &value : values)
+            quoted << Query::quoted(value);
+        return field.toString() + u':' + quoted.join(u',');
+    };
+
+    QStringList terms;
+    if (m_directionMatch == Direction::ToCompositor)
+        terms << u"direction:request"_s;
+    else if (m_directionMatch == Direction::FromCompositor)
+        terms << u"direction:event"_s;
+    if (m_timeMin && m_timeMax)
+        terms << u"time:%1..%2"_s.arg(m_timeMin).arg(m_timeMax);
+    else if (m_timeMin)
+        terms << u"time:>=%1"_s.arg(m_timeMin);
+    else if (m_timeMax)
+        terms << u"time:<=%1"_s.arg(m_timeMax);
+    for (const auto &[field, values] : { std::pair { u"connection", &m_connectionMatch },
+                                         std::pair { u"queue", &m_queueMatch },
+                                         std::pair { u"class", &m_classMatch } }) {
+        if (!values->isEmpty())
+            terms << term(field, *values);
+    }
+    if (!m_instanceMatch.isEmpty()) {
+        QStringList instances;
+        for (uint instance : m_instanceMatch)
+            instances << QString::number(instance);
+        terms << term(u"instance", instances);
+    }
+    for (const auto &[field, values] : { std::pair { u"method", &m_methodMatch },
+                                         std::pair { u"arg", &m_argumentMatch },
+                                         std::pair { u"created", &m_createClassMatch },
+                                         std::pair { u"destroyed", &m_destroyClassMatch } }) {
+        if (!values->isEmpty())
+            terms << term(field, *values);
+    }
+    return terms.join(u" AND "_s);
 }
 
 } // namespace WaylandDebug
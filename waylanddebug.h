@@ -3,17 +3,31 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <span>
 
 #include <QAbstractTableModel>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QList>
 #include <QString>
+#include <QStringList>
+#include <QVarLengthArray>
 
 QT_FORWARD_DECLARE_CLASS(QIODevice)
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QFileSystemWatcher)
+QT_FORWARD_DECLARE_CLASS(QSocketNotifier)
+QT_FORWARD_DECLARE_CLASS(QTimer)
 
 namespace WaylandDebug {
 
-enum class Direction {
+enum class Direction : quint8 {
     Any            = 0,
     FromCompositor = 1,
     ToCompositor   = 2,
@@ -21,75 +35,341 @@ enum class Direction {
 };
 
 
-class ObjectRef
+// Class, method, connection and queue names are only a few hundred distinct strings, even in
+// huge logs: they are stored as indexes into a per-model AtomTable.
+using Atom = quint16;
+
+class AtomTable
 {
 public:
-    ObjectRef() = default;
-    ObjectRef(const QString &class_, uint instance, uint generation = 0);
+    AtomTable();
 
-#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
-    auto operator<=>(const ObjectRef &) const = default;
-#else
-    auto operator<=>(const ObjectRef &other) const {
-        auto class_compare = m_class.compare(other.m_class);
+    static constexpr Atom EmptyAtom = 0;   // the empty string
+    static constexpr Atom NoAtom = 0xffff; // never assigned: used for strings that are not in the table
 
-        if (class_compare != 0)
-            return class_compare <=> 0;
+    Atom intern(const QString &str);
+    Atom find(const QString &str) const;
+    const QString &string(Atom atom) const { return m_strings.at(atom); }
+    qsizetype size() const { return m_strings.size(); }
+
+    // rank[atom] is the position of the atom's string in an alphabetically sorted table
+    QList<uint> ranks() const;
+
+private:
+    QList<QString> m_strings;
+    QHash<QString, Atom> m_atoms;
+};
 
-        if (m_instance == other.m_instance)
-            return m_generation <=> other.m_generation;
+class ObjectRef
+{
+public:
+    ObjectRef() = default;
+    ObjectRef(Atom class_, uint instance, uint generation = 0);
 
-        return m_instance <=> other.m_instance;
-    }
-#endif
+    auto operator<=>(const ObjectRef &) const = default;
 
-    QString m_class;
+    Atom m_class = AtomTable::EmptyAtom;
     uint m_instance = 0;
     uint m_generation = 0;
 };
 
+// A single message, copied out of a MessageStore
 class Message {
 public:
     Message() = default;
 
     Direction m_direction = Direction::Unknown;
-    QString m_connection;
-    QString m_queue;
+    Atom m_connection = AtomTable::EmptyAtom;
+    Atom m_queue = AtomTable::EmptyAtom;
     quint64 m_time = 0;
     ObjectRef m_object;
-    QString m_method;
+    Atom m_method = AtomTable::EmptyAtom;
     QStringList m_arguments;
     QList<ObjectRef> m_created;
     QList<ObjectRef> m_destroyed;
 };
 
+// A bump allocator for data that lives as long as the model. Memory is handed out from big
+// blocks that are never moved and only freed all at once. Copies share the blocks that are
+// already filled, but allocate new data into blocks of their own.
+class Arena
+{
+public:
+    Arena() = default;
+    Arena(const Arena &other);
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(const Arena &other);
+    Arena &operator=(Arena &&other) noexcept;
+    ~Arena() = default;
+
+    char *allocate(qsizetype size);
+    QByteArrayView store(QByteArrayView data);
+    void adopt(const Arena &other);
+    // memory that is owned elsewhere, e.g. a mapped file: the deleter of block releases it
+    void adopt(std::shared_ptr<char[]> block, qsizetype size);
+    void clear();
+
+    qsizetype bytesUsed() const { return m_bytesUsed; }
+    qsizetype bytesAllocated() const { return m_bytesAllocated; }
+    qsizetype blockCount() const { return m_blocks.size(); }
+
+private:
+    static constexpr qsizetype BlockSize = 1024 * 1024;
+
+    QList<std::shared_ptr<char[]>> m_blocks;
+    char *m_current = nullptr;
+    qsizetype m_left = 0;
+    qsizetype m_bytesUsed = 0;
+    qsizetype m_bytesAllocated = 0;
+};
+
+// The messages of a log, stored column by column. The raw argument text of each row is kept
+// in the arena, the objects it created and destroyed are found in the respective pools at
+// [m_xxxOffsets[i], m_xxxOffsets[i + 1]).
+class MessageStore
+{
+public:
+    MessageStore();
+
+    using ArgumentList = QVarLengthArray<QByteArrayView, 8>;
+
+    qsizetype size() const { return m_time.size(); }
+    bool isEmpty() const { return m_time.isEmpty(); }
+    void clear();
+    void append(const MessageStore &other);
+    // a deep copy of the rows from 'from' to the end, with an arena of its own
+    MessageStore mid(qsizetype from) const;
+
+    QByteArrayView arguments(qsizetype i) const { return m_arguments.at(i); }
+    ArgumentList argumentList(qsizetype i) const;
+    static ArgumentList splitArguments(QByteArrayView arguments);
+    std::span<const ObjectRef> created(qsizetype i) const;
+    std::span<const ObjectRef> destroyed(qsizetype i) const;
+
+    Message message(qsizetype i) const;
+
+    QList<quint64> m_time;
+    QList<Direction> m_direction;
+    QList<Atom> m_connection;
+    QList<Atom> m_queue;
+    QList<ObjectRef> m_object;
+    QList<Atom> m_method;
+
+    Arena m_arena;
+    QList<QByteArrayView> m_arguments;
+    QList<quint32> m_createdOffsets;
+    QList<ObjectRef> m_createdPool;
+    QList<quint32> m_destroyedOffsets;
+    QList<ObjectRef> m_destroyedPool;
+};
+
+// One decoded message argument. All views point into the message's raw argument text.
+class Argument
+{
+public:
+    enum class Type : quint8 {
+        Unknown,
+        Int,
+        UInt,
+        Fixed,
+        String,
+        Object,
+        NewId,
+        Array,
+        Fd,
+        Nil,
+    };
+
+    static Type typeOf(QByteArrayView text);
+    static Argument decode(QByteArrayView text, Type type);
+    static Argument decode(QByteArrayView text) { return decode(text, typeOf(text)); }
+    static QString typeName(Type type);
+
+    Type m_type = Type::Unknown;
+    QByteArrayView m_text;
+    QByteArrayView m_string; // String: without the quotes, Object and NewId: the class name
+    qint64 m_value = 0;      // Int, UInt, Fd, Array (size), Object and NewId (instance)
+    double m_fixed = 0;
+};
+
+// The argument splits and types of every message, decoded the first time anybody needs them.
+// decodeAll() builds compact tokens for all rows in parallel, after which texts() is safe to call
+// from any thread. If it gets canceled, the rows decoded until then are kept. arguments() is meant for the GUI: rows without tokens are decoded on the fly
+// and kept in a small cache.
+class ArgumentCache
+{
+public:
+    using Arguments = QVarLengthArray<Argument, 8>;
+
+    ArgumentCache() = default;
+    // copies share the tokens, but not the recently decoded arguments
+    ArgumentCache(const ArgumentCache &other);
+    ArgumentCache &operator=(const ArgumentCache &other);
+
+    void clear();
+    void decodeAll(const MessageStore &store, const std::atomic_bool *canceled = nullptr);
+    bool isComplete(const MessageStore &store) const { return m_rows == store.size(); }
+
+    MessageStore::ArgumentList texts(const MessageStore &store, qsizetype i) const;
+    Arguments arguments(const MessageStore &store, qsizetype i) const;
+
+private:
+    struct Token
+    {
+        quint16 m_offset;
+        quint16 m_size;
+        Argument::Type m_type;
+    };
+
+    bool hasTokens(qsizetype i) const;
+
+    // rows with more than 64KB of argument text get no tokens and are split on every access
+    QList<quint32> m_offsets = { 0 };
+    QList<Token> m_tokens;
+    qsizetype m_rows = 0;
+    mutable QCache<qsizetype, Arguments> m_recent { 2000 };
+};
+
+// Postings lists: for every class, instance, method, created and destroyed class and argument
+// the ascending ordinals of the messages containing it. The argument lists are only built the
+// first time somebody filters on arguments, as they are by far the biggest.
+class MessageIndex
+{
+public:
+    using Postings = QList<int>;
+
+    enum Field : quint8 {
+        Class,
+        Instance,
+        Method,
+        CreatedClass,
+        DestroyedClass,
+
+        FieldCount
+    };
+
+    void clear();
+    void update(const MessageStore &store);
+    void updateArguments(const MessageStore &store, const ArgumentCache &cache,
+                         const std::atomic_bool *canceled = nullptr);
+    bool hasArguments(const MessageStore &store) const { return m_argumentRows == store.size(); }
+
+    Postings postings(Field field, uint key) const { return m_postings[field].value(key); }
+    Postings argumentPostings(QByteArrayView text) const { return m_argumentPostings.value(text); }
+
+    // WAYLAND_DEBUG traces are written in time order, so a time window is just a range of
+    // ordinals [first, last). Returns false if the store is not ordered by time.
+    bool timeRange(const MessageStore &store, quint64 min, quint64 max, int &first, int &last) const;
+
+    static Postings unite(const QList<Postings> &lists);
+    static Postings intersect(const Postings &p1, const Postings &p2);
+
+private:
+    QHash<uint, Postings> m_postings[FieldCount];
+    QHash<QByteArrayView, Postings> m_argumentPostings;
+    qsizetype m_rows = 0;
+    qsizetype m_argumentRows = 0;
+    bool m_timeOrdered = true;
+
+    friend class TraceCache;
+};
+
+// When every object lived and which messages refer to it: as the target, by creating or
+// destroying it, or as an object argument. Objects are told apart by connection and generation,
+// so every incarnation of a wl_surface#12 gets a lifetime of its own. Like the MessageIndex it
+// only ever grows at the end, batch by batch.
+class LifetimeIndex
+{
+public:
+    struct Key
+    {
+        Atom m_connection = AtomTable::EmptyAtom;
+        ObjectRef m_object;
+
+        auto operator<=>(const Key &) const = default;
+        friend size_t qHash(const Key &key, size_t seed = 0) noexcept
+        {
+            return qHashMulti(seed, key.m_connection, key.m_object.m_class, key.m_object.m_instance,
+                              key.m_object.m_generation);
+        }
+    };
+
+    struct Lifetime
+    {
+        int m_created = -1;   // ordinal of the creating message, -1 if the object predates the log
+        int m_destroyed = -1; // -1 if the object outlived the log
+        quint64 m_birth = 0;  // time of the creation, or of the first message if there is none
+        quint64 m_death = 0;  // time of the destruction, or of the last message if there is none
+        MessageIndex::Postings m_messages;
+    };
+
+    void clear();
+    void update(const MessageStore &store);
+    qsizetype size() const { return m_lifetimes.size(); }
+
+    const Lifetime *lifetime(const Key &key) const;
+    bool refersTo(const Key &key, int ordinal) const;
+    // objects that were created in the log, but never destroyed, in order of creation
+    QList<Key> leaks() const;
+
+private:
+    QHash<Key, Lifetime> m_lifetimes;
+    QHash<std::pair<Atom, uint>, ObjectRef> m_alive; // by connection and instance
+    qsizetype m_rows = 0;
+};
+
 class ObjectRegistry
 {
 public:
-    ObjectRef create(const QString &class_, uint instance);
+    explicit ObjectRegistry(const AtomTable *atoms = nullptr);
+
+    ObjectRef create(Atom class_, uint instance);
     ObjectRef destroy(uint instance);
     ObjectRef destroyIfExists(uint instance);
-    ObjectRef resolve(const QString &class_, uint instance);
+    ObjectRef resolve(Atom class_, uint instance);
 
 private:
-    qsizetype findInstance(uint instance);
-
-    QList<ObjectRef> m_objects;
-    QHash<std::pair<QString, uint>, uint> m_generations;
-    QList<ObjectRef> m_graveyard;
+    const ObjectRef *find(uint instance) const;
+    void insert(const ObjectRef &o);
+    ObjectRef take(uint instance);
+    QString className(Atom class_) const;
+
+    const AtomTable *m_atoms = nullptr;
+
+    // client side ids are handed out densely by libwayland, so they index straight into a
+    // list (m_instance == 0 marks a free slot). Everything else, most notably the server side
+    // 0xff000000+ range, goes into a hash.
+    static constexpr uint DenseInstanceLimit = 1 << 20;
+    QList<ObjectRef> m_denseObjects;
+    QHash<uint, ObjectRef> m_sparseObjects;
+    QHash<std::pair<Atom, uint>, uint> m_generations;
+    QHash<std::pair<Atom, uint>, ObjectRef> m_graveyard; // last destroyed per class#instance
 };
 
 
+class Query;
 
 class Filter
 {
 public:
     bool isEmpty() const;
-    bool match(const Message *m) const;
+    // argument criteria need the decoded arguments and their postings lists
+    bool usesArguments() const;
+    bool isSubsetOf(const Filter &other) const;
+    void compile(const AtomTable &atoms, const ArgumentCache *arguments = nullptr,
+                 const MessageIndex *index = nullptr, const MessageStore *store = nullptr,
+                 const LifetimeIndex *lifetimes = nullptr);
+    bool match(const MessageStore &store, qsizetype i) const;
+
+    // only valid after compile() with an index: the ascending ordinals of all messages that
+    // survive the indexed criteria. matchUnindexed() checks the remaining ones.
+    const MessageIndex::Postings *candidates() const { return m_hasCandidates ? &m_candidates : nullptr; }
+    bool hasUnindexedCriteria() const;
+    bool matchUnindexed(const MessageStore &store, qsizetype i) const;
 
     Direction m_directionMatch = Direction::Any;
-    quint64 m_timeMin;
-    quint64 m_timeMax;
+    quint64 m_timeMin = 0;
+    quint64 m_timeMax = 0;
     QStringList m_connectionMatch;
     QStringList m_queueMatch;
     QStringList m_classMatch;
@@ -99,11 +379,76 @@ public:
 
     QStringList m_destroyClassMatch;
     QStringList m_createClassMatch;
+
+    // one incarnation of an object: every message that refers to it, even as an argument.
+    // Without a LifetimeIndex only its own, create and destroy messages match.
+    struct ObjectMatch
+    {
+        QString m_connection;
+        QString m_class;
+        uint m_instance = 0;
+        uint m_generation = 0;
+
+        bool operator==(const ObjectMatch &) const = default;
+    };
+    QList<ObjectMatch> m_objectMatch;
+
+    // a Query expression, ANDed with all of the above. One that does not parse matches nothing.
+    QString m_query;
+    // the criteria above as a Query expression, without m_objectMatch
+    QString toQuery() const;
+
+private:
+    // the string matches above, resolved against the model's AtomTable by compile()
+    QList<Atom> m_connectionAtoms;
+    QList<Atom> m_queueAtoms;
+    QList<Atom> m_classAtoms;
+    QList<Atom> m_methodAtoms;
+    QList<Atom> m_destroyClassAtoms;
+    QList<Atom> m_createClassAtoms;
+    QList<QByteArray> m_argumentBytes;
+    QList<LifetimeIndex::Key> m_objectKeys;
+    const ArgumentCache *m_argumentCache = nullptr;
+    const LifetimeIndex *m_lifetimes = nullptr;
+    std::shared_ptr<Query> m_plan;
+    MessageIndex::Postings m_candidates;
+    bool m_hasCandidates = false;
+    bool m_timeIndexed = false;
+    bool m_scanned = false;
+    bool m_queryIndexed = false;
+
+    bool match(const MessageStore &store, qsizetype i, bool withIndexed) const;
+    QList<quint64> scan(const MessageStore &store, int first, int last) const;
+};
+
+// The distribution of the absolute time deltas in the current view. Exact up to a million rows,
+// above that the quantiles come from a log-linear histogram and are within about 6%.
+class TimeDeltaStatistics
+{
+public:
+    static TimeDeltaStatistics compute(std::span<const qint64> deltas);
+    // cheap update for a few appended deltas: only widens the smallest/biggest range, the
+    // quantiles stay as they are until the next compute()
+    void extend(std::span<const qint64> deltas);
+
+    // 0 (smallest) .. 0.5 (median) .. 0.75 (p90) .. 0.9 (p99) .. 1 (biggest), log scaled
+    // in between
+    double percent(qint64 delta) const;
+
+    quint64 m_smallest = 0;
+    quint64 m_median = 0;
+    quint64 m_p90 = 0;
+    quint64 m_p99 = 0;
+    quint64 m_biggest = 0;
+
+    bool operator==(const TimeDeltaStatistics &other) const = default;
 };
 
 class Model : public QAbstractTableModel {
+    Q_OBJECT
+
 public:
-    Model() = default;
+    Model();
     ~Model() override;
 
     enum Column {
@@ -120,38 +465,101 @@ public:
     };
 
     enum ModelRole {
-        BackgroundTintRole = Qt::UserRole,
-        BackgroundTintWidthRole
+        BackgroundTintRole = Qt::UserRole, // a BackgroundTint
     };
 
+    // filtering runs in the background: the model switches over to the new filter once it is
+    // done. A newer filter cancels the one that is still running.
     void setFilter(Filter *filter);
+    bool isFiltering() const;
     void sort(int column, Qt::SortOrder order) override;
 
     int rowCount(const QModelIndex &parent) const override;
     int columnCount(const QModelIndex &parent) const override;
     QVariant data(const QModelIndex &index, int role) const override;
+    // fill the cell cache for the rows a view is about to show
+    void prefetch(int firstRow, int lastRow) const;
+
+    // progressive loading: new messages show up at the end, in whatever order and filter is
+    // active. finishLoading() re-sorts and starts the background work for the complete log.
+    void appendMessages(const MessageStore &messages, const QStringList &newAtoms);
+    void finishLoading();
+    // a complete log with a ready made index, e.g. from a TraceCache
+    void setMessages(const QStringList &atoms, const MessageStore &messages, const MessageIndex &index);
+    // for live captures with a bounded history: drops the oldest messages
+    void removeFirstMessages(qsizetype count);
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
 
-    const Message *message(const QModelIndex &index) const;
+    const AtomTable &atoms() const { return m_atoms; }
+    const MessageStore &messages() const { return m_messages; }
+    const Arena &arena() const { return m_messages.m_arena; }
+    const MessageIndex &messageIndex() const { return m_index; }
+    const LifetimeIndex &lifetimeIndex() const { return m_lifetimes; }
+    // the ordinals of the rows that pass the filter, in sort order
+    const QList<int> &visibleOrdinals() const { return m_filtered; }
+    int ordinal(const QModelIndex &index) const;
+    Message message(const QModelIndex &index) const;
     QModelIndex index(int row, int column, const QModelIndex &parent = { }) const override;
-    QModelIndex index(const Message *message, int column) const;
+    QModelIndex indexForOrdinal(int ordinal, int column) const;
+
+signals:
+    void filteringChanged(bool running);
+    void filterProgressChanged(int value, int maximum);
 
 private:
+    struct FilterJob;
+
+    std::shared_ptr<Filter> suspendFiltering();
+    void startFiltering(const std::shared_ptr<Filter> &filter);
+    void cancelFiltering();
+    void filteringFinished();
+    void applyFilterResult(const QList<int> &filtered);
+    void adoptFilterJob(const FilterJob &job);
+    void rebuildSortedPosition();
+    static QList<int> computeSortOrder(int column, const MessageStore &ms, const QList<uint> &ranks,
+                                       const ArgumentCache *arguments, bool parallel);
+    QList<int> sortOrder(int column);
+    void precomputeSortOrders();
     void init();
+    QVariant cellData(const QModelIndex &index, int role) const;
     void recalculateTimeDelta();
     void rebuildFilteredIndex();
-
-    QList<Message *> m_messages;
-    QList<Message *> m_sorted;
-    QList<Message *> m_filtered;
-    mutable QHash<const Message *, int> m_filteredIndex;
+    qint64 timeDelta(int ordinal) const;
+    bool applyFilteredIncrementally(const QList<int> &filtered, bool narrowed);
+
+    AtomTable m_atoms;
+    MessageStore m_messages;
+    ArgumentCache m_argumentCache;
+    MessageIndex m_index;
+    LifetimeIndex m_lifetimes;
+    // ordinals (row numbers in m_messages) in sort order and the visible subset of those
+    QList<int> m_sorted;
+    QList<int> m_filtered;
+    QList<int> m_filteredRow; // ordinal -> row in m_filtered, -1 if hidden
+    QList<int> m_sortedPosition; // ordinal -> index in m_sorted
+    bool m_sortedByOrdinal = true;
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+    // ascending sort permutations per column, computed once and reversed for descending
+    QList<int> m_sortOrders[Count];
+    QFuture<QList<int>> m_sortJobs[Count];
+    qsizetype m_sortJobsRows = -1; // the store size the jobs were started for, -1 after a replacement
 
     QList<qint64> m_filteredTimeDeltas;
-    quint64 m_smallestTimeDelta = 0;
-    quint64 m_medianTimeDelta = 0;
-    quint64 m_biggestTimeDelta = 0;
+    TimeDeltaStatistics m_timeDeltaStatistics;
+    QElapsedTimer m_filterClock; // for the PerfCounters
+    qsizetype m_statisticsRows = 0; // rows the quantiles were computed from
 
-    std::unique_ptr<Filter> m_filter;
+    // formatted cells by row, column and role: only valid until the next filter or sort
+    static constexpr int CellCacheSize = 16 * 1024;
+    mutable QCache<quint64, QVariant> m_cellCache { CellCacheSize };
+
+    std::shared_ptr<Filter> m_filter;
+    std::shared_ptr<Filter> m_pendingFilter;
+    std::shared_ptr<FilterJob> m_filterJob;
+    QFutureWatcher<QList<int>> m_filterWatcher;
+    bool m_pendingNarrowed = false;
+    bool m_pendingWidened = false;
 
     friend class Parser;
 };
@@ -163,14 +571,172 @@ public:
     Parser(QIODevice *device);
     ~Parser();
 
+    // a slice of the log, ready to be appended to a Model. The messages use the atoms of the
+    // parser's own AtomTable, m_newAtoms are the strings it gained since the previous batch.
+    struct Batch
+    {
+        MessageStore m_messages;
+        QStringList m_newAtoms;
+        qint64 m_bytesRead = 0;
+        qint64 m_bytesTotal = 0; // 0 if unknown
+    };
+    using BatchHandler = std::function<void(const Batch &batch)>;
+
     Model *parse();
+    // parses the log slice by slice and hands over every slice as soon as it is done: the
+    // first one is kept small, so something can be shown right away. Returns false if
+    // canceled was set before the end of the log.
+    bool parse(const BatchHandler &handler, const std::atomic_bool *canceled = nullptr);
+
+    // live tail: parse() leaves an incomplete last line for later, and feed() continues with
+    // data that arrived after it returned. The object registries carry over.
+    void setFollow(bool follow) { m_follow = follow; }
+    // gzip, zstd and xz logs are decompressed on the fly, but cannot be followed
+    bool isCompressed() const { return m_compressed; }
+    QIODevice *device() const { return m_device; }
+    uint lineCount() const { return m_lineNumber; }
+    void feed(QByteArrayView data, const BatchHandler &handler);
+
+    // runs the line through the scanner and the reference regexp and describes where their
+    // tokens or the resulting messages differ, an empty string if they do not. accepted is set
+    // if the scanner took the line.
+    static QString compareTokenizers(QByteArrayView line, bool *accepted = nullptr);
 
 private:
-    Message *parseLine(const QString &line);
+    struct LineTokens
+    {
+        QByteArrayView m_connection;
+        QByteArrayView m_msec;
+        QByteArrayView m_usec;
+        QByteArrayView m_queue;
+        bool m_send = false;
+        QByteArrayView m_object;
+        QByteArrayView m_instance;
+        QByteArrayView m_method;
+        QByteArrayView m_arguments;
+    };
+
+    // atoms in the parallel stage are only local to one chunk: they are mapped to the
+    // model's AtomTable when the chunk is replayed
+    struct ChunkAtoms
+    {
+        Atom intern(QByteArrayView str);
+
+        QList<QByteArrayView> m_strings = { QByteArrayView { } };
+        QHash<QByteArrayView, Atom> m_atoms;
+        bool m_overflow = false;
+    };
+
+    struct ParsedChunk
+    {
+        QByteArrayView m_data;
+        ChunkAtoms m_atoms;
+        MessageStore m_messages;
+        QList<uint> m_lineNumbers; // relative to the start of the chunk
+        uint m_lineCount = 0;
+        bool m_mapped = false; // the arguments can stay in m_data, instead of going to the arena
+    };
+
+    void parseBuffer(QByteArrayView data, uint &lineNumber, const std::shared_ptr<char[]> &mapping = { });
+    void publish(const BatchHandler &handler, qint64 bytesRead, qint64 bytesTotal);
+    static void parseChunk(ParsedChunk &chunk);
+    using Tokenizer = bool (*)(QByteArrayView line, LineTokens &t);
+    static bool parseLine(QByteArrayView line, ParsedChunk &chunk, Tokenizer tokenize = &Parser::tokenizeLine);
+    void replayMessage(MessageStore &store, qsizetype i);
+    static bool tokenizeLine(QByteArrayView line, LineTokens &t);
+    static bool tokenizeLineRegex(QByteArrayView line, LineTokens &t);
 
     QIODevice *m_device = nullptr;
     bool m_ownsDevice = false;
-    QHash<QString, ObjectRegistry> m_connectionRegistry;
+    AtomTable m_atoms;
+    qsizetype m_publishedAtoms = m_atoms.size();
+    MessageStore m_batch;
+    QHash<Atom, ObjectRegistry> m_connectionRegistry;
+    bool m_follow = false;
+    bool m_compressed = false;
+    QByteArray m_tail; // the incomplete last line when following
+    uint m_lineNumber = 0;
+    qint64 m_bytesRead = 0;
+};
+
+// one of several logs that are merged into a single timeline
+struct LogSource
+{
+    QString m_fileName;
+    QString m_label; // prefix for the connection names, the file name if empty
+    qint64 m_clockOffset = 0; // added to every timestamp of this log, in µs
+};
+
+// Merges the logs of several processes (e.g. a compositor and its clients) by time. Every log
+// gets a Parser and a thread of its own, so each keeps its own connections and object
+// registries. The connection names are prefixed with the source's label to keep them apart.
+// The logs are only interleaved, never re-sorted: the rows of each log stay in their order.
+class LogMerger
+{
+public:
+    using ProgressHandler = std::function<void(qint64 bytesRead, qint64 bytesTotal)>;
+
+    // the result can be appended to an empty Model. Returns false if canceled was set before
+    // all logs were parsed; throws an Exception if one of them is unreadable.
+    static bool merge(const QList<LogSource> &sources, Parser::Batch &result,
+                      const ProgressHandler &progress = { },
+                      const std::atomic_bool *canceled = nullptr);
+};
+
+// Runs a Parser on a worker thread and feeds its batches into a Model, which can already be
+// shown while the rest of the log is still being read. The model has to outlive the loader.
+// With follow set, the loader keeps appending whatever gets written to the log afterwards:
+// "-" reads from stdin. Several sources are merged by a LogMerger instead: neither following
+// nor the TraceCache apply to them.
+class Loader : public QObject
+{
+    Q_OBJECT
+
+public:
+    Loader(const QString &fileName, Model *model, QObject *parent = nullptr);
+    Loader(const QList<LogSource> &sources, Model *model, QObject *parent = nullptr);
+    ~Loader() override;
+
+    Model *model() const { return m_model; }
+    void setFollow(bool follow) { m_follow = follow; }
+    // keep at most this many messages by dropping the oldest ones, 0 for no limit
+    void setRingBufferSize(qsizetype messages) { m_ringBufferSize = messages; }
+    // read complete logs from their TraceCache and write one after parsing them
+    void setUseTraceCache(bool use) { m_useTraceCache = use; }
+    void start();
+    void cancel();
+    bool isRunning() const;
+    bool isFollowing() const { return m_notifier || m_watcher; }
+
+signals:
+    void progressChanged(qint64 bytesRead, qint64 bytesTotal);
+    // the existing part of the log is loaded, from now on new messages trickle in
+    void followingStarted();
+    void finished(bool canceled);
+    void failed(const QString &errorString);
+
+private:
+    void follow();
+    void stopFollowing();
+    void readMore();
+    void append(const Parser::Batch &batch);
+    void saveTraceCache();
+    void startMerge();
+
+    QString m_fileName;
+    QList<LogSource> m_sources; // only set when merging
+    Model *m_model;
+    bool m_follow = false;
+    qsizetype m_ringBufferSize = 0;
+    bool m_useTraceCache = true;
+    std::unique_ptr<QFile> m_file;
+    std::unique_ptr<Parser> m_parser;
+    std::atomic_bool m_canceled = false;
+    QFuture<void> m_worker;
+    QFuture<void> m_cacheWriter;
+    QSocketNotifier *m_notifier = nullptr; // pipes and stdin
+    QFileSystemWatcher *m_watcher = nullptr; // growing files
+    QTimer *m_pollTimer = nullptr; // in case the watcher misses a change
 };
 
 } // namespace WaylandDebug